@@ -0,0 +1,137 @@
+/*
+  Asset Partition
+
+  Dashboard files and configuration defaults live in their own flash partition as one
+  indexed blob, so they can be changed without rebuilding the firmware. The board
+  memory-maps the partition at boot and uses the blob where it lies: opening it is a
+  bounds and CRC check plus a pointer, a lookup is a binary search of the index, and
+  a file is sent straight from flash without being copied to RAM.
+
+  Layout (all integers little-endian):
+    header (32 bytes):  magic "PKA1"(4) version(2) count(2) totalBytes(4) crc32(4)
+                        generation(4) reserved(12)
+    index (count x 48): name(32, NUL-padded, sorted) offset(4) length(4) crc32(4)
+                        type(1) flags(1) mime(1) reserved(1)
+    records:            each starts on an ASSET_ALIGN boundary
+  The header's crc32 covers everything after the header up to totalBytes. A config
+  record holds name(24, NUL-padded) value(4, float) pairs.
+
+  Built by tools/pack_assets.cpp, which also checks blobs on Linux with this header.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+const uint32_t ASSET_MAGIC = 0x31414B50; // "PKA1"
+const uint16_t ASSET_VERSION = 1;
+const uint32_t ASSET_ALIGN = 16;
+const int ASSET_NAME_BYTES = 32;
+const int ASSET_CONFIG_NAME_BYTES = 24;
+
+enum AssetType : uint8_t {
+  ASSET_FILE = 0,    // Served over HTTP under its name
+  ASSET_CONFIG = 1,  // Runtime configuration defaults
+};
+
+const uint8_t ASSET_GZIP = 1; // Stored gzip-compressed; sent with Content-Encoding: gzip
+
+const char* const ASSET_MIME_TYPES[] = { "application/octet-stream", "text/html", "text/css",
+                                         "application/javascript",   "application/json", "image/svg+xml",
+                                         "image/png",                "image/x-icon",     "text/plain" };
+const int ASSET_MIME_COUNT = sizeof(ASSET_MIME_TYPES) / sizeof(ASSET_MIME_TYPES[0]);
+
+struct AssetHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t count;
+  uint32_t totalBytes;
+  uint32_t crc32;
+  uint32_t generation; // Bumped by the packer on every build, reported by /assets
+  uint8_t reserved[12];
+};
+
+struct AssetEntry {
+  char name[ASSET_NAME_BYTES];
+  uint32_t offset;     // From the start of the blob
+  uint32_t length;
+  uint32_t crc32;
+  AssetType type;
+  uint8_t flags;
+  uint8_t mime;        // Index into ASSET_MIME_TYPES
+  uint8_t reserved;
+};
+
+struct AssetConfigValue {
+  char name[ASSET_CONFIG_NAME_BYTES];
+  float value;
+};
+
+static_assert(sizeof(AssetHeader) == 32, "AssetHeader is read in place");
+static_assert(sizeof(AssetEntry) == 48, "AssetEntry is read in place");
+static_assert(sizeof(AssetConfigValue) == 28, "AssetConfigValue is read in place");
+
+inline uint32_t assetCrc32(const uint8_t* data, size_t len, uint32_t crc = 0) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *data++;
+    for (int k = 0; k < 8; k++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+// Checks a mapped blob; returns its header, or nullptr if the partition holds no
+// valid blob (erased, half-written, or from an incompatible packer)
+inline const AssetHeader* assetsOpen(const uint8_t* base, size_t size) {
+  const AssetHeader* h = (const AssetHeader*)base;
+  if (size < sizeof(AssetHeader) || h->magic != ASSET_MAGIC || h->version != ASSET_VERSION ||
+      h->totalBytes > size || h->totalBytes < sizeof(AssetHeader) + h->count * sizeof(AssetEntry)) {
+    return nullptr;
+  }
+  if (assetCrc32(base + sizeof(AssetHeader), h->totalBytes - sizeof(AssetHeader)) != h->crc32) {
+    return nullptr;
+  }
+  const AssetEntry* index = (const AssetEntry*)(h + 1);
+  for (int i = 0; i < h->count; i++) {
+    if (index[i].offset % ASSET_ALIGN != 0 || index[i].offset > h->totalBytes ||
+        index[i].length > h->totalBytes - index[i].offset || index[i].mime >= ASSET_MIME_COUNT ||
+        index[i].name[ASSET_NAME_BYTES - 1] != '\0') {
+      return nullptr;
+    }
+  }
+  return h;
+}
+
+inline const AssetEntry* assetIndex(const AssetHeader* h) {
+  return (const AssetEntry*)(h + 1);
+}
+
+// Binary search of the sorted index; nullptr if there is no such record
+inline const AssetEntry* assetFind(const AssetHeader* h, const char* name, AssetType type = ASSET_FILE) {
+  if (h == nullptr) {
+    return nullptr;
+  }
+  const AssetEntry* index = assetIndex(h);
+  int lo = 0, hi = h->count - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    int c = strncmp(name, index[mid].name, ASSET_NAME_BYTES);
+    if (c == 0) {
+      return index[mid].type == type ? &index[mid] : nullptr;
+    }
+    if (c < 0) {
+      hi = mid - 1;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return nullptr;
+}
+
+inline const uint8_t* assetData(const AssetHeader* h, const AssetEntry* e) {
+  return (const uint8_t*)h + e->offset;
+}
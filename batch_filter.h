@@ -0,0 +1,161 @@
+/*
+  Batch Distance Filter
+
+  Filters blocks of distance samples from many sensors at once. Samples are laid
+  out structure-of-arrays style: each row holds one sample per sensor, so a row
+  is a contiguous int16 array that can be processed several sensors at a time.
+
+  Each sensor gets a 3-sample median (removes single echo dropouts and spikes)
+  followed by an exponential moving average in fixed point. All arithmetic is
+  integer, so the SIMD and scalar paths produce bit-identical output.
+
+  Used by the sketch for the bays, and by tools/bench_batch_filter.cpp on Linux.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+const int BATCH_FILTER_FRAC_BITS = 8;  // Fractional bits of the EMA accumulator
+const int BATCH_FILTER_SHIFT = 2;      // EMA weight of a new sample = 1 / 2^BATCH_FILTER_SHIFT
+
+// Per-sensor filter state; each array holds one entry per sensor
+struct BatchFilterState {
+  int sensors;
+  int16_t* prev1;  // Previous raw sample
+  int16_t* prev2;  // Raw sample before that
+  int32_t* ema;    // Smoothed value, in input units << BATCH_FILTER_FRAC_BITS
+};
+
+// Starts every sensor at `initial` as if it had been reading it forever
+inline void batchFilterReset(BatchFilterState& st, const int16_t* initial) {
+  for (int s = 0; s < st.sensors; s++) {
+    st.prev1[s] = initial[s];
+    st.prev2[s] = initial[s];
+    st.ema[s] = (int32_t)initial[s] << BATCH_FILTER_FRAC_BITS;
+  }
+}
+
+// Starts one sensor afresh at `initial`, e.g. once it works again after a fault
+inline void batchFilterResetSensor(BatchFilterState& st, int s, int16_t initial) {
+  st.prev1[s] = initial;
+  st.prev2[s] = initial;
+  st.ema[s] = (int32_t)initial << BATCH_FILTER_FRAC_BITS;
+}
+
+// Filters sensors [from, st.sensors) of one row
+inline void batchFilterRowScalar(BatchFilterState& st, const int16_t* in, int16_t* out, int from) {
+  for (int s = from; s < st.sensors; s++) {
+    int16_t a = in[s], b = st.prev1[s], c = st.prev2[s];
+    int16_t lo = a < b ? a : b;
+    int16_t hi = a < b ? b : a;
+    int16_t hiC = hi < c ? hi : c;
+    int16_t median = lo > hiC ? lo : hiC;
+    st.prev2[s] = b;
+    st.prev1[s] = a;
+
+    int32_t ema = st.ema[s];
+    ema += (((int32_t)median << BATCH_FILTER_FRAC_BITS) - ema) >> BATCH_FILTER_SHIFT;
+    st.ema[s] = ema;
+    out[s] = (int16_t)((ema + (1 << (BATCH_FILTER_FRAC_BITS - 1))) >> BATCH_FILTER_FRAC_BITS);
+  }
+}
+
+// Reference implementation: `rows` rows of st.sensors samples each, in and out row-major
+inline void batchFilterScalar(BatchFilterState& st, const int16_t* in, int16_t* out, int rows) {
+  for (int r = 0; r < rows; r++) {
+    batchFilterRowScalar(st, in + r * st.sensors, out + r * st.sensors, 0);
+  }
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+#if defined(__AVX2__)
+typedef __m256i BatchVec16;
+const int BATCH_LANES = 16;
+#define BATCH_FILTER_SIMD_NAME "AVX2"
+#define BF_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define BF_STORE(p, v) _mm256_storeu_si256((__m256i*)(p), v)
+#define BF_MIN16 _mm256_min_epi16
+#define BF_MAX16 _mm256_max_epi16
+#define BF_ADD32 _mm256_add_epi32
+#define BF_SUB32 _mm256_sub_epi32
+#define BF_SLLI32 _mm256_slli_epi32
+#define BF_SRAI32 _mm256_srai_epi32
+#define BF_SET32 _mm256_set1_epi32
+// Widening and narrowing work within 128-bit lanes, so go through the halves explicitly
+#define BF_WIDEN_LO(v) _mm256_cvtepi16_epi32(_mm256_castsi256_si128(v))
+#define BF_WIDEN_HI(v) _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1))
+#define BF_NARROW(lo, hi) _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8)
+#else
+typedef __m128i BatchVec16;
+const int BATCH_LANES = 8;
+#define BATCH_FILTER_SIMD_NAME "SSE2"
+#define BF_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define BF_STORE(p, v) _mm_storeu_si128((__m128i*)(p), v)
+#define BF_MIN16 _mm_min_epi16
+#define BF_MAX16 _mm_max_epi16
+#define BF_ADD32 _mm_add_epi32
+#define BF_SUB32 _mm_sub_epi32
+#define BF_SLLI32 _mm_slli_epi32
+#define BF_SRAI32 _mm_srai_epi32
+#define BF_SET32 _mm_set1_epi32
+#define BF_WIDEN_LO(v) _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)
+#define BF_WIDEN_HI(v) _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)
+#define BF_NARROW(lo, hi) _mm_packs_epi32(lo, hi)
+#endif
+
+// Vectorised implementation; sensors beyond the last full vector use the scalar code
+inline void batchFilterSimd(BatchFilterState& st, const int16_t* in, int16_t* out, int rows) {
+  const int half = BATCH_LANES / 2;
+  const int vectorEnd = st.sensors - st.sensors % BATCH_LANES;
+  const BatchVec16 round = BF_SET32(1 << (BATCH_FILTER_FRAC_BITS - 1));
+  for (int r = 0; r < rows; r++) {
+    const int16_t* row = in + r * st.sensors;
+    int16_t* outRow = out + r * st.sensors;
+    for (int s = 0; s < vectorEnd; s += BATCH_LANES) {
+      BatchVec16 a = BF_LOAD(row + s);
+      BatchVec16 b = BF_LOAD(st.prev1 + s);
+      BatchVec16 c = BF_LOAD(st.prev2 + s);
+      BatchVec16 median = BF_MAX16(BF_MIN16(a, b), BF_MIN16(BF_MAX16(a, b), c));
+      BF_STORE(st.prev2 + s, b);
+      BF_STORE(st.prev1 + s, a);
+
+      BatchVec16 emaLo = BF_LOAD(st.ema + s);
+      BatchVec16 emaHi = BF_LOAD(st.ema + s + half);
+      BatchVec16 targetLo = BF_SLLI32(BF_WIDEN_LO(median), BATCH_FILTER_FRAC_BITS);
+      BatchVec16 targetHi = BF_SLLI32(BF_WIDEN_HI(median), BATCH_FILTER_FRAC_BITS);
+      emaLo = BF_ADD32(emaLo, BF_SRAI32(BF_SUB32(targetLo, emaLo), BATCH_FILTER_SHIFT));
+      emaHi = BF_ADD32(emaHi, BF_SRAI32(BF_SUB32(targetHi, emaHi), BATCH_FILTER_SHIFT));
+      BF_STORE(st.ema + s, emaLo);
+      BF_STORE(st.ema + s + half, emaHi);
+
+      BatchVec16 outLo = BF_SRAI32(BF_ADD32(emaLo, round), BATCH_FILTER_FRAC_BITS);
+      BatchVec16 outHi = BF_SRAI32(BF_ADD32(emaHi, round), BATCH_FILTER_FRAC_BITS);
+      BF_STORE(outRow + s, BF_NARROW(outLo, outHi));
+    }
+    batchFilterRowScalar(st, row, outRow, vectorEnd);
+  }
+}
+
+#else
+
+// No SIMD on this target (e.g. the original ESP32): the scalar loop is the fast path
+inline void batchFilterSimd(BatchFilterState& st, const int16_t* in, int16_t* out, int rows) {
+  batchFilterScalar(st, in, out, rows);
+}
+
+#define BATCH_FILTER_SIMD_NAME "none (scalar only)"
+
+#endif
+
+// Filters a block with the fastest implementation available on this target
+inline void batchFilter(BatchFilterState& st, const int16_t* in, int16_t* out, int rows) {
+  batchFilterSimd(st, in, out, rows);
+}
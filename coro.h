@@ -0,0 +1,261 @@
+/*
+  Cooperative Coroutine Scheduler
+
+  Lets sequences that wait on hardware (trigger a sensor and wait for its echo, move
+  the servo and wait for it to settle) be written as straight-line C++20 coroutines
+  that co_await a timer or a signal, instead of blocking in delay() or pulseIn(). The
+  scheduler resumes them from loop(), so they interleave with HTTP handling and with
+  each other.
+
+  - Frames come from a fixed pool of CORO_MAX_FRAMES slots of CORO_FRAME_BYTES each;
+    nothing is allocated on the heap. A sequence whose frame does not fit, or that is
+    spawned when the pool is empty, is refused (coSpawn returns false).
+  - Sleeping sequences sit in a binary min-heap ordered by wake-up time; a signal
+    wait with a timeout sits there too and is taken out when the signal fires.
+  - Everything runs in the caller's thread. Interrupt handlers must not fire signals
+    directly: they set a flag that loop() turns into coFire().
+
+  Define CORO_FRAME_BYTES and CORO_MAX_FRAMES before including this header to size
+  the pool. Used by the sketch, and by tools/bench_coro.cpp on Linux.
+*/
+
+#pragma once
+
+#include <coroutine>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef CORO_FRAME_BYTES
+#define CORO_FRAME_BYTES 256
+#endif
+#ifndef CORO_MAX_FRAMES
+#define CORO_MAX_FRAMES 16
+#endif
+
+// Frame pool shared by all coroutines; slots are handed out from a free list
+struct CoFramePool {
+  alignas(16) uint8_t slots[CORO_MAX_FRAMES][CORO_FRAME_BYTES];
+  int32_t nextFree[CORO_MAX_FRAMES]; // Free-list link, stored as index + 1 so 0 means "none"
+  int32_t freeHead;                  // Index + 1 of the first free slot, 0 if none
+  int32_t untouched;                 // Slots from here on have never been used
+  uint32_t inUse;
+  uint32_t peak;
+  uint32_t refused;                  // Spawns refused for lack of a slot or an oversized frame
+  size_t largestFrame;               // Largest frame size the compiler asked for
+};
+
+inline CoFramePool coFrames;
+
+inline void* coFrameAlloc(size_t size) {
+  if (size > coFrames.largestFrame) coFrames.largestFrame = size;
+  int32_t slot;
+  if (size > CORO_FRAME_BYTES) {
+    slot = -1;
+  } else if (coFrames.freeHead != 0) {
+    slot = coFrames.freeHead - 1;
+    coFrames.freeHead = coFrames.nextFree[slot];
+  } else if (coFrames.untouched < CORO_MAX_FRAMES) {
+    slot = coFrames.untouched++;
+  } else {
+    slot = -1;
+  }
+  if (slot < 0) {
+    coFrames.refused++;
+    return nullptr;
+  }
+  if (++coFrames.inUse > coFrames.peak) coFrames.peak = coFrames.inUse;
+  return coFrames.slots[slot];
+}
+
+inline void coFrameFree(void* frame) {
+  int32_t slot = ((uint8_t(*)[CORO_FRAME_BYTES])frame) - coFrames.slots;
+  coFrames.nextFree[slot] = coFrames.freeHead;
+  coFrames.freeHead = slot + 1;
+  coFrames.inUse--;
+}
+
+// Return type of a sequence. It starts suspended and is started by coSpawn; its frame
+// goes back to the pool when it returns.
+struct CoTask {
+  struct promise_type {
+    static void* operator new(size_t size) noexcept { return coFrameAlloc(size); }
+    static void operator delete(void* frame) noexcept { coFrameFree(frame); }
+    static CoTask get_return_object_on_allocation_failure() noexcept { return CoTask{}; }
+    CoTask get_return_object() noexcept { return CoTask{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { abort(); }
+  };
+  std::coroutine_handle<promise_type> handle;
+};
+
+struct CoSignal;
+
+// A suspended sequence waiting for a time and/or a signal
+struct CoWait {
+  std::coroutine_handle<> handle;
+  uint64_t wakeUs;     // Deadline, if in the timer heap
+  int32_t heapIndex;   // Position in the timer heap, -1 if not in it
+  CoSignal* signal;    // Signal waited on, nullptr for a plain sleep
+  bool fired;          // Resumed by the signal rather than the deadline
+};
+
+struct CoScheduler {
+  uint64_t nowUs;                               // Time passed to the current coRun
+  std::coroutine_handle<> ready[CORO_MAX_FRAMES]; // Ring of sequences to resume
+  int32_t readyHead;
+  int32_t readyCount;
+  CoWait* timers[CORO_MAX_FRAMES];              // Min-heap on wakeUs
+  int32_t timerCount;
+  uint64_t resumes;
+};
+
+// A one-shot event with at most one waiter
+struct CoSignal {
+  CoScheduler* scheduler;
+  CoWait* waiter;
+};
+
+inline void coMakeReady(CoScheduler& s, std::coroutine_handle<> handle) {
+  s.ready[(s.readyHead + s.readyCount) % CORO_MAX_FRAMES] = handle;
+  s.readyCount++;
+}
+
+inline void coHeapSwap(CoScheduler& s, int32_t a, int32_t b) {
+  CoWait* t = s.timers[a];
+  s.timers[a] = s.timers[b];
+  s.timers[b] = t;
+  s.timers[a]->heapIndex = a;
+  s.timers[b]->heapIndex = b;
+}
+
+inline void coHeapUp(CoScheduler& s, int32_t i) {
+  while (i > 0 && s.timers[(i - 1) / 2]->wakeUs > s.timers[i]->wakeUs) {
+    coHeapSwap(s, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+inline void coHeapDown(CoScheduler& s, int32_t i) {
+  while (true) {
+    int32_t smallest = i, l = 2 * i + 1, r = l + 1;
+    if (l < s.timerCount && s.timers[l]->wakeUs < s.timers[smallest]->wakeUs) smallest = l;
+    if (r < s.timerCount && s.timers[r]->wakeUs < s.timers[smallest]->wakeUs) smallest = r;
+    if (smallest == i) return;
+    coHeapSwap(s, i, smallest);
+    i = smallest;
+  }
+}
+
+inline void coAddTimer(CoScheduler& s, CoWait* wait) {
+  wait->heapIndex = s.timerCount;
+  s.timers[s.timerCount++] = wait;
+  coHeapUp(s, wait->heapIndex);
+}
+
+inline void coRemoveTimer(CoScheduler& s, CoWait* wait) {
+  int32_t i = wait->heapIndex;
+  wait->heapIndex = -1;
+  if (--s.timerCount == i) return;
+  s.timers[i] = s.timers[s.timerCount];
+  s.timers[i]->heapIndex = i;
+  coHeapUp(s, i);
+  coHeapDown(s, s.timers[i]->heapIndex);
+}
+
+inline void coInit(CoScheduler& s, uint64_t nowUs) {
+  s = {};
+  s.nowUs = nowUs;
+}
+
+// Starts a sequence; returns false if its frame could not be allocated
+inline bool coSpawn(CoScheduler& s, CoTask task) {
+  if (!task.handle || s.readyCount == CORO_MAX_FRAMES) {
+    if (task.handle) task.handle.destroy();
+    return false;
+  }
+  coMakeReady(s, task.handle);
+  return true;
+}
+
+// Resumes every sequence that is due; call often from loop(). Sequences made ready
+// while this runs wait for the next call, so one busy sequence cannot starve the rest.
+// Returns the number of resumptions.
+inline int coRun(CoScheduler& s, uint64_t nowUs) {
+  s.nowUs = nowUs;
+  while (s.timerCount > 0 && s.timers[0]->wakeUs <= nowUs) {
+    CoWait* wait = s.timers[0];
+    coRemoveTimer(s, wait);
+    if (wait->signal != nullptr) wait->signal->waiter = nullptr; // Timed out
+    coMakeReady(s, wait->handle);
+  }
+  int n = s.readyCount;
+  for (int i = 0; i < n; i++) {
+    std::coroutine_handle<> handle = s.ready[s.readyHead];
+    s.readyHead = (s.readyHead + 1) % CORO_MAX_FRAMES;
+    s.readyCount--;
+    handle.resume();
+  }
+  s.resumes += n;
+  return n;
+}
+
+// Earliest wake-up time of a sleeping sequence, or UINT64_MAX if none sleeps
+inline uint64_t coNextWakeUs(const CoScheduler& s) {
+  return s.readyCount > 0 ? s.nowUs : s.timerCount > 0 ? s.timers[0]->wakeUs : UINT64_MAX;
+}
+
+struct CoSleep {
+  CoScheduler& scheduler;
+  uint64_t us;
+  CoWait wait;
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> handle) noexcept {
+    wait = { handle, scheduler.nowUs + us, -1, nullptr, false };
+    coAddTimer(scheduler, &wait);
+  }
+  void await_resume() const noexcept {}
+};
+
+// co_await coSleep(scheduler, us): resumes on the first coRun at or after now + us
+inline CoSleep coSleep(CoScheduler& s, uint64_t us) {
+  return CoSleep{ s, us, {} };
+}
+
+struct CoSignalWait {
+  CoSignal& signal;
+  uint64_t timeoutUs;
+  CoWait wait;
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> handle) noexcept {
+    CoScheduler& s = *signal.scheduler;
+    wait = { handle, s.nowUs + timeoutUs, -1, &signal, false };
+    signal.waiter = &wait;
+    if (timeoutUs > 0) coAddTimer(s, &wait);
+  }
+  bool await_resume() const noexcept { return wait.fired; }
+};
+
+inline void coSignalInit(CoSignal& signal, CoScheduler& s) {
+  signal.scheduler = &s;
+  signal.waiter = nullptr;
+}
+
+// co_await coWaitFor(signal, timeoutUs): true if the signal fired, false on timeout.
+// A timeout of 0 waits forever.
+inline CoSignalWait coWaitFor(CoSignal& signal, uint64_t timeoutUs) {
+  return CoSignalWait{ signal, timeoutUs, {} };
+}
+
+// Wakes the signal's waiter, if any, on the next coRun. Returns whether one was waiting.
+inline bool coFire(CoSignal& signal) {
+  CoWait* wait = signal.waiter;
+  if (wait == nullptr) return false;
+  signal.waiter = nullptr;
+  wait->fired = true;
+  if (wait->heapIndex >= 0) coRemoveTimer(*signal.scheduler, wait);
+  coMakeReady(*signal.scheduler, wait->handle);
+  return true;
+}
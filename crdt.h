@@ -0,0 +1,285 @@
+/*
+  Conflict-Free Replicated Lot State
+
+  Lets several boards with overlapping views of a lot (shared lanes, bays seen by
+  more than one sensor) agree on counters and bay states without a coordinator.
+  Every board applies its own changes locally and broadcasts them as deltas; any
+  board can merge any message, in any order and any number of times, and all
+  boards that have seen the same changes hold the same state.
+
+  - Counters are PN-counters: each board only ever raises its own increment and
+    decrement totals, and merging takes the per-board maximum.
+  - Bay states are last-writer-wins registers stamped with a hybrid logical clock
+    (wall-clock milliseconds plus a logical counter), so a later change wins even
+    if the clocks of the boards disagree by a little, and ties go to the higher
+    node ID.
+
+  Deltas carry absolute entry values, so a lost or repeated message does no harm;
+  periodic full-state rounds (crdtMarkAllDirty) repair whatever was lost.
+
+  Wire format (all integers little-endian, varints are LEB128 as in slot_bitmap.h):
+    header:   'C' 'R' version(1) node(1) sequence(4) baseTime(8) counterCount(2) slotCount(2)
+    counter:  counter(varint) node(1) increments(varint) decrements(varint)
+    slot:     slotGap(varint) ageMs(varint) ageLogical(varint) node(1) value(1)
+  Slots are sent in ascending order; slotGap is the distance from the previous one.
+  The age is baseTime minus the register's time, split into its millisecond and
+  logical parts so a change from a few seconds ago takes three bytes.
+
+  Used by the sketch, and by tools/sim_crdt.cpp on Linux.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "slot_bitmap.h"
+
+const int CRDT_MAX_NODES = 16;
+const uint8_t CRDT_VERSION = 1;
+const size_t CRDT_HEADER_BYTES = 20;
+
+// Hybrid logical clock time: wall-clock milliseconds in the high 48 bits, logical counter in the low 16
+typedef uint64_t HlcTime;
+
+inline HlcTime hlcFromMs(uint64_t physicalMs) {
+  return physicalMs << 16;
+}
+
+struct HybridClock {
+  HlcTime last;
+};
+
+// Timestamp for a local change; always later than anything seen so far
+inline HlcTime hlcTick(HybridClock& clock, uint64_t physicalMs) {
+  HlcTime now = hlcFromMs(physicalMs);
+  clock.last = now > clock.last ? now : clock.last + 1;
+  return clock.last;
+}
+
+// Takes in a remote timestamp, so local changes made after it order after it
+inline void hlcObserve(HybridClock& clock, HlcTime remote) {
+  if (remote > clock.last) clock.last = remote;
+}
+
+struct PNCounter {
+  uint32_t increments[CRDT_MAX_NODES];
+  uint32_t decrements[CRDT_MAX_NODES];
+};
+
+inline int32_t pnValue(const PNCounter& counter) {
+  int32_t value = 0;
+  for (int n = 0; n < CRDT_MAX_NODES; n++) value += (int32_t)(counter.increments[n] - counter.decrements[n]);
+  return value;
+}
+
+struct LwwRegister {
+  HlcTime time;  // 0 until first written
+  uint8_t node;
+  uint8_t value;
+};
+
+// Whether a write stamped (time, node) replaces the register's current value
+inline bool lwwWins(const LwwRegister& reg, HlcTime time, uint8_t node) {
+  return time > reg.time || (time == reg.time && node > reg.node);
+}
+
+inline size_t putVarint64(uint8_t* out, size_t cap, size_t pos, uint64_t value) {
+  do {
+    if (pos >= cap) return 0;
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    out[pos++] = byte | (value ? 0x80 : 0);
+  } while (value);
+  return pos;
+}
+
+inline size_t getVarint64(const uint8_t* in, size_t len, size_t pos, uint64_t* value) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 70; shift += 7) {
+    if (pos >= len) return 0;
+    uint8_t byte = in[pos++];
+    result |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return pos;
+    }
+  }
+  return 0;
+}
+
+template <int COUNTERS, int SLOTS>
+struct CrdtLot {
+  uint8_t node;
+  uint32_t sequence;
+  HybridClock clock;
+  PNCounter counters[COUNTERS];
+  LwwRegister slots[SLOTS];
+  uint16_t dirtyCounters[COUNTERS];  // One bit per node entry not yet sent
+  SlotBitmap<SLOTS> dirtySlots;
+};
+
+template <int C, int S>
+void crdtInit(CrdtLot<C, S>& lot, uint8_t node) {
+  memset(&lot, 0, sizeof(lot));
+  lot.node = node;
+}
+
+// Adds `delta` (positive or negative) to a counter on behalf of this node
+template <int C, int S>
+void crdtAdd(CrdtLot<C, S>& lot, int counter, int32_t delta) {
+  if (delta >= 0) {
+    lot.counters[counter].increments[lot.node] += delta;
+  } else {
+    lot.counters[counter].decrements[lot.node] += -delta;
+  }
+  lot.dirtyCounters[counter] |= 1u << lot.node;
+}
+
+// Records a local change of a slot's state
+template <int C, int S>
+void crdtSetSlot(CrdtLot<C, S>& lot, int slot, uint8_t value, uint64_t physicalMs) {
+  LwwRegister& reg = lot.slots[slot];
+  if (reg.time != 0 && reg.value == value) return;
+  reg.time = hlcTick(lot.clock, physicalMs);
+  reg.node = lot.node;
+  reg.value = value;
+  lot.dirtySlots.set(slot, true);
+}
+
+// Queues the whole state for sending, to repair messages lost on the way
+template <int C, int S>
+void crdtMarkAllDirty(CrdtLot<C, S>& lot) {
+  for (int c = 0; c < C; c++) {
+    for (int n = 0; n < CRDT_MAX_NODES; n++) {
+      if (lot.counters[c].increments[n] != 0 || lot.counters[c].decrements[n] != 0) {
+        lot.dirtyCounters[c] |= 1u << n;
+      }
+    }
+  }
+  for (int s = 0; s < S; s++) {
+    if (lot.slots[s].time != 0) lot.dirtySlots.set(s, true);
+  }
+}
+
+template <int C, int S>
+bool crdtHasDirty(const CrdtLot<C, S>& lot) {
+  for (int c = 0; c < C; c++) {
+    if (lot.dirtyCounters[c]) return true;
+  }
+  return lot.dirtySlots.next(0, true, S) < S;
+}
+
+// Encodes as many unsent entries as fit in `cap` bytes; they are then considered sent
+// and the rest wait for the next message. Returns the length, or 0 if nothing was unsent.
+template <int C, int S>
+size_t crdtEncodeDelta(CrdtLot<C, S>& lot, uint8_t* buf, size_t cap) {
+  if (cap < CRDT_HEADER_BYTES || !crdtHasDirty(lot)) return 0;
+  HlcTime base = lot.clock.last;
+  size_t pos = CRDT_HEADER_BYTES;
+  uint16_t counterEntries = 0, slotEntries = 0;
+  bool full = false;
+
+  for (int c = 0; c < C && !full; c++) {
+    for (int n = 0; n < CRDT_MAX_NODES && lot.dirtyCounters[c]; n++) {
+      if (!(lot.dirtyCounters[c] & (1u << n))) continue;
+      size_t at = putVarint(buf, cap, pos, c);
+      if (at == 0 || at >= cap) { full = true; break; }
+      buf[at++] = n;
+      at = putVarint(buf, cap, at, lot.counters[c].increments[n]);
+      if (at != 0) at = putVarint(buf, cap, at, lot.counters[c].decrements[n]);
+      if (at == 0) { full = true; break; }
+      pos = at;
+      lot.dirtyCounters[c] &= ~(1u << n);
+      counterEntries++;
+    }
+  }
+
+  int previous = 0;
+  for (int s = lot.dirtySlots.next(0, true, S); s < S && !full && slotEntries < 0xFFFF;
+       s = lot.dirtySlots.next(s + 1, true, S)) {
+    const LwwRegister& reg = lot.slots[s];
+    size_t at = putVarint(buf, cap, pos, s - previous);
+    if (at != 0) at = putVarint64(buf, cap, at, (base - reg.time) >> 16);
+    if (at != 0) at = putVarint(buf, cap, at, (uint32_t)((base - reg.time) & 0xFFFF));
+    if (at == 0 || at + 2 > cap) break;
+    buf[at++] = reg.node;
+    buf[at++] = reg.value;
+    pos = at;
+    previous = s;
+    lot.dirtySlots.set(s, false);
+    slotEntries++;
+  }
+
+  buf[0] = 'C';
+  buf[1] = 'R';
+  buf[2] = CRDT_VERSION;
+  buf[3] = lot.node;
+  putLe32(buf + 4, ++lot.sequence);
+  putLe32(buf + 8, (uint32_t)base);
+  putLe32(buf + 12, (uint32_t)(base >> 32));
+  buf[16] = counterEntries;
+  buf[17] = counterEntries >> 8;
+  buf[18] = slotEntries;
+  buf[19] = slotEntries >> 8;
+  return pos;
+}
+
+// Merges a received message. Returns false if it is malformed (entries decoded before the
+// problem are kept, which is safe since every entry merges on its own). `changed` counts
+// entries that altered the local state.
+template <int C, int S>
+bool crdtApply(CrdtLot<C, S>& lot, const uint8_t* buf, size_t len, int& changed) {
+  changed = 0;
+  if (len < CRDT_HEADER_BYTES || buf[0] != 'C' || buf[1] != 'R' || buf[2] != CRDT_VERSION ||
+      buf[3] >= CRDT_MAX_NODES || buf[3] == lot.node) {
+    return false;
+  }
+  HlcTime base = getLe32(buf + 8) | ((HlcTime)getLe32(buf + 12) << 32);
+  int counterEntries = buf[16] | (buf[17] << 8);
+  int slotEntries = buf[18] | (buf[19] << 8);
+  size_t pos = CRDT_HEADER_BYTES;
+
+  for (int e = 0; e < counterEntries; e++) {
+    uint32_t counter, increments, decrements;
+    pos = getVarint(buf, len, pos, &counter);
+    if (pos == 0 || pos >= len || counter >= (uint32_t)C || buf[pos] >= CRDT_MAX_NODES) return false;
+    uint8_t node = buf[pos++];
+    pos = getVarint(buf, len, pos, &increments);
+    if (pos != 0) pos = getVarint(buf, len, pos, &decrements);
+    if (pos == 0) return false;
+    PNCounter& target = lot.counters[counter];
+    if (increments > target.increments[node]) {
+      target.increments[node] = increments;
+      changed++;
+    }
+    if (decrements > target.decrements[node]) {
+      target.decrements[node] = decrements;
+      changed++;
+    }
+  }
+
+  uint32_t slot = 0;
+  for (int e = 0; e < slotEntries; e++) {
+    uint32_t gap, ageLogical;
+    uint64_t ageMs;
+    pos = getVarint(buf, len, pos, &gap);
+    if (pos != 0) pos = getVarint64(buf, len, pos, &ageMs);
+    if (pos != 0) pos = getVarint(buf, len, pos, &ageLogical);
+    slot += gap;
+    HlcTime age = (ageMs << 16) | (ageLogical & 0xFFFF);
+    if (pos == 0 || pos + 2 > len || slot >= (uint32_t)S || ageMs > (base >> 16) || age > base) return false;
+    HlcTime time = base - age;
+    uint8_t node = buf[pos++];
+    uint8_t value = buf[pos++];
+    LwwRegister& reg = lot.slots[slot];
+    if (lwwWins(reg, time, node)) {
+      reg.time = time;
+      reg.node = node;
+      reg.value = value;
+      changed++;
+    }
+  }
+  hlcObserve(lot.clock, base);
+  return pos == len;
+}
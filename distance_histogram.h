@@ -0,0 +1,82 @@
+/*
+  Sliding-Window Distance Histogram
+
+  Counts readings per fixed-width distance bin over the last SLICES time slices, for
+  example the last hour as 12 slices of 5 minutes. Each slice keeps its own counts
+  and a running total holds their sum, so adding a reading is two increments and
+  reading the window is the total as it stands. When the current slice is over, the
+  oldest slice is subtracted from the total and reused, which costs one pass over the
+  bins once per slice: O(1) per reading, amortised. The window moves in slice steps,
+  so it spans between SLICES - 1 and SLICES slices.
+
+  A slice counts up to 65535 readings per bin and then stops counting that bin (the
+  total stays the sum of the slices); at the sketch's default sensor interval an
+  hour-long slice takes 7200 readings.
+
+  Used by the sketch for each bay, and by tools/bench_histogram.cpp on Linux.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+template <int BINS, int SLICES>
+struct SlidingHistogram {
+  uint16_t slices[SLICES][BINS];
+  uint32_t total[BINS];  // Sum of all slices: the window
+  int64_t sliceUs;       // Length of one slice
+  int64_t sliceEndUs;    // When the current slice is over
+  int current;           // Slice being filled
+};
+
+template <int BINS, int SLICES>
+void histReset(SlidingHistogram<BINS, SLICES>& h, int64_t sliceUs, int64_t nowUs) {
+  memset(h.slices, 0, sizeof(h.slices));
+  memset(h.total, 0, sizeof(h.total));
+  h.sliceUs = sliceUs;
+  h.sliceEndUs = nowUs + sliceUs;
+  h.current = 0;
+}
+
+// Drops the slices that have fallen out of the window by `nowUs`
+template <int BINS, int SLICES>
+void histAdvance(SlidingHistogram<BINS, SLICES>& h, int64_t nowUs) {
+  if (nowUs < h.sliceEndUs) {
+    return;
+  }
+  if (nowUs - h.sliceEndUs >= h.sliceUs * SLICES) {
+    // Nothing was added for a whole window: start over rather than step through it
+    histReset(h, h.sliceUs, nowUs);
+    return;
+  }
+  while (nowUs >= h.sliceEndUs) {
+    h.current = (h.current + 1) % SLICES;
+    uint16_t* oldest = h.slices[h.current];
+    for (int b = 0; b < BINS; b++) {
+      h.total[b] -= oldest[b];
+      oldest[b] = 0;
+    }
+    h.sliceEndUs += h.sliceUs;
+  }
+}
+
+template <int BINS, int SLICES>
+void histAdd(SlidingHistogram<BINS, SLICES>& h, int bin, int64_t nowUs) {
+  histAdvance(h, nowUs);
+  uint16_t& count = h.slices[h.current][bin];
+  if (count < UINT16_MAX) {
+    count++;
+    h.total[bin]++;
+  }
+}
+
+// Readings in the window, across all bins
+template <int BINS, int SLICES>
+uint32_t histCount(const SlidingHistogram<BINS, SLICES>& h) {
+  uint32_t n = 0;
+  for (int b = 0; b < BINS; b++) {
+    n += h.total[b];
+  }
+  return n;
+}
@@ -0,0 +1,122 @@
+/*
+  Entry Lane Queue Estimate
+
+  Estimates how busy the entry barrier is from the lane beams alone. An arrival is an
+  entering vehicle reaching the barrier (beam A blocked first); a departure is it
+  being counted in. The barrier is a single server:
+  - arrival rate (lambda): a count of arrivals that decays with time constant
+    `windowUs`, divided by the window, i.e. an exponentially weighted rate;
+  - service rate (mu): one over the smoothed service time. A vehicle that reached the
+    barrier within `moveUpUs` of the previous departure was queued behind it, and its
+    service runs from that departure, which includes moving up and waiting for the
+    arm: under load this is the discharge headway, i.e. the lane's real capacity;
+  - utilisation rho = lambda / mu, and the expected vehicles waiting or being served,
+    rho / (1 - rho) as for an M/M/1 queue, capped at `QUEUE_LENGTH_CAP`.
+  Vehicles queued behind the barrier cannot be seen, so when arrivals outrun the
+  barrier the observed arrival rate settles at the service rate; rho near 1 is
+  therefore the overload signal, raised at one ratio and cleared at a lower one.
+  `backToBack` counts queued arrivals in a row, the direct sign of a standing queue.
+
+  Used by the sketch (section 9), and by tools/sim_queue.cpp on Linux, which runs it
+  against a simulated lane with a known queue.
+*/
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+const float QUEUE_LENGTH_CAP = 20;   // rho / (1 - rho) grows without bound as rho nears 1
+const float QUEUE_SERVICE_WEIGHT = 0.2; // Weight of a new service time in the smoothed mean
+
+struct LaneQueue {
+  int64_t windowUs;       // Time constant of the arrival rate
+  int64_t moveUpUs;       // An arrival this soon after a departure was queued behind it
+  int64_t updatedUs;      // When `arrivals` was last decayed
+  float arrivals;         // Decaying arrival count; / window = rate
+  float serviceS;         // Smoothed service time, 0 until the first departure
+  uint32_t services;      // Departures measured
+  int64_t arrivalUs;      // When the vehicle at the barrier arrived, 0 if none
+  bool queued;            // It arrived within moveUpUs of the previous departure
+  int64_t lastDepartureUs;
+  uint32_t backToBack;    // Queued arrivals in a row
+  bool overloaded;
+};
+
+inline void laneQueueInit(LaneQueue& q, int64_t windowUs, int64_t moveUpUs, int64_t nowUs) {
+  q = {};
+  q.windowUs = windowUs;
+  q.moveUpUs = moveUpUs;
+  q.updatedUs = nowUs;
+}
+
+inline void laneQueueDecay(LaneQueue& q, int64_t nowUs) {
+  if (nowUs > q.updatedUs) {
+    q.arrivals *= expf(-(float)(nowUs - q.updatedUs) / q.windowUs);
+    q.updatedUs = nowUs;
+  }
+}
+
+inline void laneQueueArrive(LaneQueue& q, int64_t nowUs) {
+  laneQueueDecay(q, nowUs);
+  q.arrivals += 1;
+  q.arrivalUs = nowUs;
+  q.queued = q.lastDepartureUs != 0 && nowUs - q.lastDepartureUs <= q.moveUpUs;
+  q.backToBack = q.queued ? q.backToBack + 1 : 0;
+}
+
+// The vehicle at the barrier has gone: counted in if `served`, otherwise it turned
+// back or was not a vehicle, and only the arrival counts
+inline void laneQueueDepart(LaneQueue& q, int64_t nowUs, bool served) {
+  if (q.arrivalUs == 0) {
+    return;
+  }
+  if (served) {
+    float serviceS = (nowUs - (q.queued ? q.lastDepartureUs : q.arrivalUs)) / 1e6f;
+    q.serviceS = q.services == 0 ? serviceS : q.serviceS + (serviceS - q.serviceS) * QUEUE_SERVICE_WEIGHT;
+    q.services++;
+    q.lastDepartureUs = nowUs;
+  }
+  q.arrivalUs = 0;
+}
+
+// Arrivals per second
+inline float laneArrivalRate(LaneQueue& q, int64_t nowUs) {
+  laneQueueDecay(q, nowUs);
+  return q.arrivals * 1e6f / q.windowUs;
+}
+
+// Departures per second the barrier can manage, 0 until measured
+inline float laneServiceRate(const LaneQueue& q) {
+  return q.serviceS > 0 ? 1 / q.serviceS : 0;
+}
+
+inline float laneUtilization(LaneQueue& q, int64_t nowUs) {
+  float mu = laneServiceRate(q);
+  return mu > 0 ? laneArrivalRate(q, nowUs) / mu : 0;
+}
+
+// Expected vehicles waiting or at the barrier
+inline float laneQueueLength(LaneQueue& q, int64_t nowUs) {
+  float rho = laneUtilization(q, nowUs);
+  return rho >= QUEUE_LENGTH_CAP / (QUEUE_LENGTH_CAP + 1) ? QUEUE_LENGTH_CAP : rho / (1 - rho);
+}
+
+// Raises the overload alarm once rho reaches `raiseAt` or `runAt` cars in a row have
+// been queued, whichever comes first: a sudden rush builds a queue long before the
+// averaged rate catches up. Clears it once rho is below `clearAt` and a car has
+// found the barrier free. Returns +1 when raised, -1 when cleared, 0 otherwise;
+// needs `minServices` measured departures first.
+inline int laneQueueCheck(LaneQueue& q, int64_t nowUs, float raiseAt, float clearAt, uint32_t runAt,
+                          uint32_t minServices) {
+  float rho = laneUtilization(q, nowUs);
+  if (!q.overloaded && q.services >= minServices && (rho >= raiseAt || q.backToBack >= runAt)) {
+    q.overloaded = true;
+    return 1;
+  }
+  if (q.overloaded && rho < clearAt && q.backToBack == 0) {
+    q.overloaded = false;
+    return -1;
+  }
+  return 0;
+}
@@ -13,16 +13,48 @@
   - IR Sensor (Digital Output): IR Sensor Pin
 
   NOTE: The HTML content includes Tailwind CSS via CDN and JavaScript for AJAX updates.
-  The server provides two endpoints: "/" for the HTML and "/status" for JSON data updates.
+  The server provides "/" for the HTML and "/status" for JSON data updates, plus the
+  bitmap, calibration and configuration endpoints listed in README.md.
 */
 
 #include <WiFi.h>
+#include <WiFiUdp.h>
+#include <HTTPClient.h>
 #include <WebServer.h>
 #include <ESP32Servo.h>
+#include <Preferences.h>
+#include <LittleFS.h>
+#include "batch_filter.h"
+#include "slot_bitmap.h"
+#include "replication.h"
+#include "crdt.h"
+#define CORO_MAX_FRAMES 4 // The sensor and gate sequences, with room to spare
+#include "coro.h"
+#include "spsc_ring.h"
+#include "mono_clock.h"
+#include "ota_stream.h"
+#include "assets.h"
+#include "distance_histogram.h"
+#include "lane_queue.h"
+#include <esp_https_server.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+// HTTPS is built in when a certificate has been generated with tools/make_tls_cert.sh
+#if __has_include("tls_cert.h")
+#include "tls_cert.h"
+#define HTTPS_ENABLED 1
+#else
+#define HTTPS_ENABLED 0
+#endif
 
 // ------------------------------------
 // 1. CONFIGURATION
 // ------------------------------------
+// Thresholds, sensor interval, servo angles, lane and gate-hold settings below are
+// defaults only; they can be changed at runtime through /config (see section 3).
 // WiFi Credentials
 const char* ssid = "YOUR_WIFI_SSID";
 const char* password = "YOUR_WIFI_PASSWORD";
@@ -31,21 +63,121 @@ const char* password = "YOUR_WIFI_PASSWORD";
 const int TRIG_PIN = 5;  // Ultrasonic Trigger (e.g., GPIO 5)
 const int ECHO_PIN = 18; // Ultrasonic Echo (e.g., GPIO 18)
 const int SERVO_PIN = 19; // Servo Motor Signal (e.g., GPIO 19)
-const int IR_PIN = 34;    // IR Sensor Digital Output (e.g., GPIO 34 - Input Only)
+const int IR_PIN = 34;    // IR Sensor Digital Output, beam A on the street side (e.g., GPIO 34 - Input Only)
+const int IR_PIN_B = 35;  // Second IR Sensor, beam B on the lot side (e.g., GPIO 35 - Input Only)
+
+// Bay Definitions (one ultrasonic sensor per bay; add pins here for more bays)
+const int BAY_COUNT = 1;
+const int BAY_TRIG_PINS[BAY_COUNT] = { TRIG_PIN };
+const int BAY_ECHO_PINS[BAY_COUNT] = { ECHO_PIN };
+const int ZONE_COUNT = 1;
+const int BAY_ZONES[BAY_COUNT] = { 0 }; // Zone (e.g., level or row) of each bay, 0 .. ZONE_COUNT - 1
+const uint8_t BAY_EV = 1;               // Bay attribute flags, combined in BAY_ATTRIBUTES (e.g., BAY_EV | BAY_COMPACT)
+const uint8_t BAY_ACCESSIBLE = 2;
+const uint8_t BAY_COMPACT = 4;
+const uint8_t BAY_ATTRIBUTES[BAY_COUNT] = { 0 }; // EV charger, accessible and compact-only bays
 
 // Parking Logic Constants
-const float MAX_DISTANCE_CM = 25.0; // Max distance for spot to be considered 'occupied' (adjust based on setup)
+const float MAX_DISTANCE_CM = 25.0; // Default 'occupied' threshold, used until a bay has been calibrated
+const float DEFAULT_HYSTERESIS_CM = 4.0; // Default width of the band around the threshold where the state holds
 const int MAX_PARKING_DISTANCE = 400; // Max distance for the sensor in cm (HC-SR04 limit)
 
+// Sensor Fault Constants (a bay whose sensor has failed is held or counter-derived, see section 8)
+const int SENSOR_FAIL_READINGS = 20;      // Timeouts or out-of-range readings in a row before a sensor has failed (~10 s)
+const int SENSOR_STUCK_READINGS = 600;    // Identical readings in a row before a sensor is stuck (~5 min); live echoes jitter
+const int SENSOR_RECOVER_READINGS = 10;   // Good readings in a row before a failed sensor is trusted again
+
+// Calibration Constants
+const int CAL_BIN_CM = 2;                           // Histogram bin width
+const int CAL_BINS = MAX_PARKING_DISTANCE / CAL_BIN_CM;
+const unsigned long CAL_MIN_SAMPLES = 600;          // Readings before a threshold is first derived (~5 min)
+const float CAL_MIN_CLASS_FRACTION = 0.05;          // Each of empty/occupied must hold this share of readings
+const float CAL_MIN_SEPARATION_CM = 10.0;           // Empty and occupied peaks must be at least this far apart
+
+// Distance Histogram Constants (raw readings per bay over the last hour and day, served by /histogram)
+const int HIST_BIN_CM = 5;                                     // Bin width
+const int HIST_BINS = MAX_PARKING_DISTANCE / HIST_BIN_CM + 1;  // The last bin holds timeouts and out-of-range readings
+const int HIST_HOUR_SLICES = 12;                               // The hour window moves in 5-minute steps
+const int HIST_DAY_SLICES = 24;                                // The day window moves in 1-hour steps
+
+// Session and Event Log Constants (see section 7)
+const int SESSION_TAG_LENGTH = 16;               // Room for a tag ID (e.g., RFID or plate) and its terminating NUL
+const char* EVENT_LOG_PATH = "/events.log";      // Fixed-size records on LittleFS, newest file
+const char* EVENT_LOG_OLD_PATH = "/events.1";    // The file before it, kept after rotation
+const uint32_t EVENT_LOG_MAX_RECORDS = 10000;    // Records per file before rotating (~400 KB)
+const char* NTP_SERVER = "pool.ntp.org";         // Wall-clock time for session start and end
+
+// Lane Counting Constants (beam A is crossed first when entering, beam B first when leaving)
+const unsigned long MIN_VEHICLE_BREAK_MS = 400; // Beam breaks shorter than this are treated as pedestrians
+const int LOT_CAPACITY = 20;                    // Total spaces in the lot, used for counter-based availability
+const float BEAM_SPACING_M = 0.6;               // Distance between beam A and beam B along the lane
+
+// Entry Queue Constants (arrival and service rate at the barrier, see lane_queue.h)
+const unsigned long QUEUE_WINDOW_MS = 120000;   // Time constant of the arrival rate
+const unsigned long QUEUE_MOVE_UP_MS = 3000;    // A vehicle reaching the barrier this soon after the last one left was queued
+const float QUEUE_OVERLOAD_RHO = 0.9;           // Overload once arrivals reach this share of the measured service rate...
+const uint32_t QUEUE_OVERLOAD_RUN = 5;          // ...or this many vehicles in a row were queued
+const float QUEUE_CLEAR_RHO = 0.7;              // The overload clears below this share
+const uint32_t QUEUE_MIN_SERVICES = 5;          // Vehicles timed before the service rate is trusted
+
+// Gate Hold Constants (how long the gate stays open before closing on its own)
+const float GATE_CLEARANCE_M = 3.0;                 // Distance a vehicle travels past the beams to clear the barrier arm
+const unsigned long GATE_HOLD_DEFAULT_MS = 10000;   // Used until a vehicle speed has been measured
+const unsigned long GATE_HOLD_MIN_MS = 3000;
+const unsigned long GATE_HOLD_MAX_MS = 30000;
+
 // Servo Constants
 const int SERVO_OPEN_ANGLE = 90;  // Angle to open the barrier (e.g., 90 degrees)
 const int SERVO_CLOSED_ANGLE = 0; // Angle to close the barrier (e.g., 0 degrees)
+const unsigned long SERVO_SETTLE_MS = 500; // Time the servo needs to finish a move
+
+// Hot-Standby Constants (two boards on one gate, see section 12; leave PEER_IP empty for one board)
+const char* PEER_IP = "";                      // Address of the other controller, e.g. "192.168.1.101"
+const int REPLICATION_PORT = 4210;             // UDP port used by both controllers
+const uint8_t REPLICATION_PRIORITY = 1;        // 1 on the preferred primary, 0 on the standby
+const unsigned long HEARTBEAT_MS = 100;        // The primary sends its state at least this often
+const unsigned long FAILOVER_TIMEOUT_MS = 500; // The standby takes over after this long without a heartbeat
+
+// Webhook Constants (events are POSTed in batches to each URL, see section 13; empty URLs are skipped)
+const int WEBHOOK_COUNT = 2;
+const char* WEBHOOK_URLS[WEBHOOK_COUNT] = { "", "" }; // e.g. "http://192.168.1.50:8000/events"
+const int EVENT_QUEUE_LENGTH = 64;                // Events waiting to be picked up by the webhook task
+const int WEBHOOK_BACKLOG = 128;                  // Undelivered events kept per destination
+const int WEBHOOK_BATCH_SIZE = 32;                // Most events sent in one POST
+const unsigned long WEBHOOK_BATCH_DELAY_MS = 250; // How long the oldest event waits for a batch to fill
+const unsigned long WEBHOOK_TIMEOUT_MS = 2000;    // Connect and response timeout of one POST
+const unsigned long WEBHOOK_BACKOFF_MIN_MS = 500; // First retry delay, doubled after every failure
+const unsigned long WEBHOOK_BACKOFF_MAX_MS = 60000;
+
+// Raw Sample Stream Constants (every echo streamed to one diagnostics client, see section 15)
+const uint32_t RAW_SAMPLE_RING = 256; // Samples waiting for the stream task; a power of two
+const int STREAM_BATCH = 64;          // Most samples sent in one chunk
+
+// Event Log Export Constants (records streamed to one client at a time, see section 16)
+const int EXPORT_BATCH = 32;          // Records read from LittleFS and sent as one chunk
+
+// Peer Sync Constants (boards sharing one lot merge bay states and the vehicle count, see section 14)
+const int CRDT_NODE_ID = -1;                   // 0 .. 15, unique per board (both boards of a hot-standby pair too); -1 turns it off
+const int CRDT_PORT = 4211;                    // UDP port, broadcast on the local subnet
+const int CRDT_SLOT_COUNT = 64;                // Bays in the whole lot, across all boards
+const int BAY_GLOBAL_SLOTS[BAY_COUNT] = { 0 }; // Lot-wide slot of each local bay, 0 .. CRDT_SLOT_COUNT - 1
+const unsigned long CRDT_DELTA_MS = 100;       // Local changes are collected this long before they are sent
+const unsigned long CRDT_FULL_SYNC_MS = 5000;  // The whole state is resent this often, repairing lost deltas
+
+// Firmware Update Constants (images are streamed to the inactive partition, see section 17)
+const char* OTA_TOKEN = "";                         // Required as ?token= by POST /ota; updates are refused while empty
+const unsigned long OTA_BURST_GAP_MS = 20;          // Pause after every one-sector flash burst, left to sensing
+const unsigned long OTA_STALL_TIMEOUT_MS = 10000;   // The download fails after this long without data
+const unsigned long OTA_HEALTH_TIMEOUT_MS = 60000;  // A new image that is not healthy this long after boot is rolled back
+const unsigned long OTA_HEALTH_SENSOR_ROUNDS = 3;   // Sensor rounds a new image must complete to be kept
+const char* ASSETS_PARTITION = "assets";            // Data partition with dashboard files and config defaults (partitions.csv)
 
 // Global State
 bool isGateOpen = false;
-bool isSpotOccupied = false;
-unsigned long lastSensorReadTime = 0;
-const long sensorInterval = 500; // Read sensor every 500ms
+unsigned long gateHoldMs = GATE_HOLD_DEFAULT_MS; // Adapted to measured vehicle speeds
+int64_t gateCloseAt = 0;                         // monoUs() at which the gate closes itself, 0 when not scheduled
+uint32_t stateVersion = 1; // Bumped whenever anything served by /status changes
+const long SENSOR_INTERVAL_MS = 500; // Default sensor read period
 
 // ------------------------------------
 // 2. GLOBALS & INITIALIZATION
@@ -53,23 +185,468 @@ const long sensorInterval = 500; // Read sensor every 500ms
 WebServer server(80);
 Servo gateServo;
 
+// Invalidates the cached status responses; call after changing any reported state
+void markStateChanged() {
+  stateVersion++;
+}
+
+// Sensing and gate sequences run as coroutines (see coro.h), resumed from loop() between
+// HTTP requests instead of blocking it while they wait for an echo or the servo
+CoScheduler sequences;
+CoSignal echoSignal;        // Fired when the echo of the bay being measured has come back
+CoSignal gateCommandSignal; // Fired when a gate command is waiting
+
+// Hot-standby role (see section 12). Only the active controller drives the servo, decodes
+// the lane and reads the bay sensors; a standby mirrors the primary's state instead.
+ReplicationNode replication;
+bool replicationEnabled = false;
+
+bool isActiveController() {
+  return !replicationEnabled || replication.role == ROLE_PRIMARY;
+}
+
+const char* replicationRoleName() {
+  if (!replicationEnabled) {
+    return "standalone";
+  }
+  return replication.role == ROLE_PRIMARY ? "primary" : "standby";
+}
+
+// Lot-wide state merged with peer boards (see section 14)
+const int CRDT_COUNTERS = 1;
+const int CRDT_VEHICLES = 0; // Counter: vehicles in the lot, over all lanes
+typedef CrdtLot<CRDT_COUNTERS, CRDT_SLOT_COUNT> SharedLot;
+SharedLot sharedLot;
+bool crdtEnabled = false;
+
+// Wall-clock milliseconds for the hybrid clock; before NTP sync this is time since boot,
+// which the logical part of the clock copes with once a peer has been heard from
+uint64_t crdtPhysicalMs() {
+  struct timeval now;
+  gettimeofday(&now, nullptr);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+// Publishes a local bay's state. Called on every sensor pass: if a peer's later write
+// disagrees with what this board's sensor sees, the local reading is stamped again and wins.
+void crdtPublishBay(int i, bool occupied) {
+  if (crdtEnabled) {
+    crdtSetSlot(sharedLot, BAY_GLOBAL_SLOTS[i], occupied ? 1 : 0, crdtPhysicalMs());
+  }
+}
+
+void crdtCountVehicle(int32_t delta) {
+  if (crdtEnabled) {
+    crdtAdd(sharedLot, CRDT_VEHICLES, delta);
+  }
+}
+
+// Occupancy, gate and lane events, delivered to integrators by the webhook task (see section 13)
+enum ParkingEventType : uint8_t {
+  EVENT_BAY_OCCUPIED,
+  EVENT_BAY_FREED,
+  EVENT_GATE_OPENED,
+  EVENT_GATE_CLOSED,
+  EVENT_VEHICLE_IN,
+  EVENT_VEHICLE_OUT,
+  EVENT_LANE_OVERLOAD,
+  EVENT_LANE_OVERLOAD_CLEARED,
+};
+const char* PARKING_EVENT_NAMES[] = { "bay_occupied", "bay_freed", "gate_opened", "gate_closed", "vehicle_in", "vehicle_out",
+                                      "lane_overload", "lane_overload_cleared" };
+
+struct ParkingEvent {
+  uint32_t seq;     // Numbers every published event, so receivers can spot gaps
+  int64_t timeUs;   // monoUs() when it happened
+  ParkingEventType type;
+  int16_t bay;      // Bay of bay events, -1 for the others
+  int64_t edgeUs;   // monoUs() of the sensor edge behind it, 0 if none (gate events)
+};
+
+QueueHandle_t eventQueue = nullptr; // Created by startWebhooks() when a URL is configured
+uint32_t eventSeq = 0;
+volatile uint32_t eventsDroppedQueueFull = 0;
+
+// Detection latency. Changes detected by a sensor carry the time of the sensor edge that
+// caused them, so the status cache (section 10), webhooks (section 13) and /metrics can
+// report how long each change took to reach them.
+const int LATENCY_BUCKET_COUNT = 10;
+const uint32_t LATENCY_BUCKETS_MS[LATENCY_BUCKET_COUNT] = { 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000 };
+
+struct LatencyHistogram {
+  uint32_t buckets[LATENCY_BUCKET_COUNT + 1]; // The last one counts everything above the largest bound
+  uint32_t count;
+  uint64_t sumUs;
+};
+
+LatencyHistogram publishLatency; // Sensor edge to the /status response that reports it
+LatencyHistogram deliverLatency; // Sensor edge to a webhook receiver's 2xx, written by the webhook task
+LatencyHistogram renderLatency;  // /status publish to the dashboard showing it, reported by the browser
+
+void recordLatency(LatencyHistogram& h, int64_t us) {
+  if (us < 0) {
+    us = 0;
+  }
+  int b = 0;
+  while (b < LATENCY_BUCKET_COUNT && us > LATENCY_BUCKETS_MS[b] * 1000LL) {
+    b++;
+  }
+  h.buckets[b]++;
+  h.count++;
+  h.sumUs += us;
+}
+
+// Scheduling jitter, in microseconds of monoUs(): how late the sensor sequence wakes
+// after its interval, and how long loop() takes to come round again
+struct TimingStats {
+  uint32_t count;
+  uint64_t sumUs;
+  int64_t maxUs;
+};
+
+TimingStats sensorWakeLate;
+TimingStats loopGap;
+int64_t lastLoopUs = 0;
+
+void recordTiming(TimingStats& t, int64_t us) {
+  t.count++;
+  t.sumUs += us > 0 ? us : 0;
+  if (us > t.maxUs) {
+    t.maxUs = us;
+  }
+}
+
+// Latest sensor-detected change, reported by /status as last_change
+struct DetectedChange {
+  uint32_t seq;       // Event sequence number
+  ParkingEventType type;
+  int16_t bay;
+  int64_t edgeUs;
+  int64_t publishUs;  // When the status cache first reported it, 0 until then
+};
+DetectedChange lastChange = {};
+const int UNPUBLISHED_EDGES = 8;
+int64_t unpublishedEdges[UNPUBLISHED_EDGES]; // Edges of changes the status cache has not reported yet
+int unpublishedCount = 0;
+
+// Hands an event to the webhook task. Never blocks: if the task has fallen behind,
+// the event is dropped and counted. `edgeUs` is the sensor edge behind it, 0 if none.
+void publishEvent(ParkingEventType type, int bay, int64_t edgeUs = 0) {
+  ParkingEvent event = { ++eventSeq, monoUs(), type, (int16_t)bay, edgeUs };
+  if (edgeUs != 0) {
+    lastChange = { event.seq, type, (int16_t)bay, edgeUs, 0 };
+    if (unpublishedCount < UNPUBLISHED_EDGES) {
+      unpublishedEdges[unpublishedCount++] = edgeUs;
+    }
+  }
+  if (eventQueue != nullptr && xQueueSend(eventQueue, &event, 0) != pdTRUE) {
+    eventsDroppedQueueFull = eventsDroppedQueueFull + 1;
+  }
+}
+
+// ------------------------------------
+// 3. RUNTIME CONFIGURATION
+// ------------------------------------
+
+// Settings that can be changed over HTTP without re-flashing. The constants above
+// are the defaults; changes are validated as a whole, swapped in between loop()
+// iterations and saved to NVS so they survive a reboot.
+struct RuntimeConfig {
+  float thresholdCm;          // Occupied threshold for bays that have not been calibrated
+  float hysteresisCm;         // Hysteresis for bays that have not been calibrated
+  long sensorIntervalMs;
+  long servoOpenAngle;
+  long servoClosedAngle;
+  long minVehicleBreakMs;
+  long lotCapacity;
+  long gateHoldMinMs;
+  long gateHoldMaxMs;
+};
+
+const RuntimeConfig BUILT_IN_CONFIG = {
+  MAX_DISTANCE_CM, DEFAULT_HYSTERESIS_CM, SENSOR_INTERVAL_MS, SERVO_OPEN_ANGLE, SERVO_CLOSED_ANGLE,
+  (long)MIN_VEHICLE_BREAK_MS, LOT_CAPACITY, (long)GATE_HOLD_MIN_MS, (long)GATE_HOLD_MAX_MS
+};
+RuntimeConfig config = BUILT_IN_CONFIG;
+
+enum ConfigType { CONFIG_LONG, CONFIG_FLOAT };
+
+// Name, type, location and allowed range of each setting
+struct ConfigField {
+  const char* name;
+  ConfigType type;
+  size_t offset;
+  float minValue;
+  float maxValue;
+};
+
+const ConfigField CONFIG_FIELDS[] = {
+  { "threshold_cm", CONFIG_FLOAT, offsetof(RuntimeConfig, thresholdCm), 2, MAX_PARKING_DISTANCE },
+  { "hysteresis_cm", CONFIG_FLOAT, offsetof(RuntimeConfig, hysteresisCm), 0, 50 },
+  { "sensor_interval_ms", CONFIG_LONG, offsetof(RuntimeConfig, sensorIntervalMs), 50, 60000 },
+  { "servo_open_angle", CONFIG_LONG, offsetof(RuntimeConfig, servoOpenAngle), 0, 180 },
+  { "servo_closed_angle", CONFIG_LONG, offsetof(RuntimeConfig, servoClosedAngle), 0, 180 },
+  { "min_vehicle_break_ms", CONFIG_LONG, offsetof(RuntimeConfig, minVehicleBreakMs), 0, 5000 },
+  { "lot_capacity", CONFIG_LONG, offsetof(RuntimeConfig, lotCapacity), 1, 100000 },
+  { "gate_hold_min_ms", CONFIG_LONG, offsetof(RuntimeConfig, gateHoldMinMs), 500, 600000 },
+  { "gate_hold_max_ms", CONFIG_LONG, offsetof(RuntimeConfig, gateHoldMaxMs), 500, 600000 },
+};
+const int CONFIG_FIELD_COUNT = sizeof(CONFIG_FIELDS) / sizeof(CONFIG_FIELDS[0]);
+const uint32_t CONFIG_VERSION = 1; // Bump when RuntimeConfig changes layout
+
+Preferences configPrefs;
+
+float getConfigValue(const RuntimeConfig& cfg, const ConfigField& field) {
+  const uint8_t* base = (const uint8_t*)&cfg + field.offset;
+  return field.type == CONFIG_FLOAT ? *(const float*)base : (float)*(const long*)base;
+}
+
+void setConfigValue(RuntimeConfig& cfg, const ConfigField& field, float value) {
+  uint8_t* base = (uint8_t*)&cfg + field.offset;
+  if (field.type == CONFIG_FLOAT) {
+    *(float*)base = value;
+  } else {
+    *(long*)base = lroundf(value);
+  }
+}
+
+const ConfigField* findConfigField(const String& name) {
+  for (int f = 0; f < CONFIG_FIELD_COUNT; f++) {
+    if (name == CONFIG_FIELDS[f].name) return &CONFIG_FIELDS[f];
+  }
+  return nullptr;
+}
+
+// Checks a complete configuration. Returns nullptr if valid, otherwise why not.
+const char* validateConfig(const RuntimeConfig& cfg) {
+  for (int f = 0; f < CONFIG_FIELD_COUNT; f++) {
+    float value = getConfigValue(cfg, CONFIG_FIELDS[f]);
+    if (isnan(value) || value < CONFIG_FIELDS[f].minValue || value > CONFIG_FIELDS[f].maxValue) {
+      return CONFIG_FIELDS[f].name;
+    }
+  }
+  if (cfg.gateHoldMinMs > cfg.gateHoldMaxMs) {
+    return "gate_hold_min_ms must not exceed gate_hold_max_ms";
+  }
+  if (cfg.servoOpenAngle == cfg.servoClosedAngle) {
+    return "servo_open_angle and servo_closed_angle must differ";
+  }
+  return nullptr;
+}
+
+// The asset partition (see assets.h), mapped into the address space so its files are
+// served and its config defaults read in place. assets is nullptr when the partition
+// is missing, empty or invalid; the built-in dashboard and constants are used then.
+const esp_partition_t* assetsPartition = nullptr;
+esp_partition_mmap_handle_t assetsMap;
+const AssetHeader* assets = nullptr;
+unsigned long assetsServed = 0;
+
+void mapAssets() {
+  if (assetsPartition == nullptr) {
+    assetsPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ASSETS_PARTITION);
+    if (assetsPartition == nullptr) {
+      Serial.println("Assets: no partition, using the built-in dashboard");
+      return;
+    }
+  }
+  const void* base;
+  if (esp_partition_mmap(assetsPartition, 0, assetsPartition->size, ESP_PARTITION_MMAP_DATA, &base, &assetsMap) != ESP_OK) {
+    Serial.println("Assets: partition could not be mapped");
+    return;
+  }
+  assets = assetsOpen((const uint8_t*)base, assetsPartition->size);
+  if (assets == nullptr) {
+    esp_partition_munmap(assetsMap);
+    Serial.println("Assets: partition holds no valid blob, using the built-in dashboard");
+    return;
+  }
+  Serial.printf("Assets: generation %lu, %u record(s), %lu bytes\n", (unsigned long)assets->generation,
+                assets->count, (unsigned long)assets->totalBytes);
+}
+
+void unmapAssets() {
+  if (assets != nullptr) {
+    assets = nullptr;
+    esp_partition_munmap(assetsMap);
+  }
+}
+
+// Takes configuration defaults from the asset partition's config record, if any
+void applyAssetConfig() {
+  const AssetEntry* record = assetFind(assets, "config", ASSET_CONFIG);
+  if (record == nullptr) {
+    return;
+  }
+  const AssetConfigValue* values = (const AssetConfigValue*)assetData(assets, record);
+  RuntimeConfig cfg = config;
+  int applied = 0;
+  for (uint32_t i = 0; i < record->length / sizeof(AssetConfigValue); i++) {
+    char name[ASSET_CONFIG_NAME_BYTES + 1] = {};
+    memcpy(name, values[i].name, ASSET_CONFIG_NAME_BYTES);
+    const ConfigField* field = findConfigField(name);
+    if (field != nullptr) {
+      setConfigValue(cfg, *field, values[i].value);
+      applied++;
+    }
+  }
+  const char* invalid = validateConfig(cfg);
+  if (invalid != nullptr) {
+    Serial.printf("Assets: config defaults rejected (%s)\n", invalid);
+    return;
+  }
+  config = cfg;
+  Serial.printf("Assets: %d config default(s) applied\n", applied);
+}
+
+// Builds the config afresh: the constants, then the asset defaults, then the NVS settings.
+// Called at boot and again when a new asset blob has been mapped.
+void loadConfig() {
+  config = BUILT_IN_CONFIG;
+  applyAssetConfig();
+  RuntimeConfig stored;
+  configPrefs.begin("config", true);
+  bool found = configPrefs.getUInt("version", 0) == CONFIG_VERSION &&
+               configPrefs.getBytes("values", &stored, sizeof(stored)) == sizeof(stored);
+  configPrefs.end();
+  if (found && validateConfig(stored) == nullptr) {
+    config = stored;
+    Serial.println("Config: loaded from NVS");
+  } else {
+    Serial.println("Config: using defaults");
+  }
+}
+
+void saveConfig() {
+  configPrefs.begin("config", false);
+  configPrefs.putBytes("values", &config, sizeof(config));
+  configPrefs.putUInt("version", CONFIG_VERSION);
+  configPrefs.end();
+}
+
+String configJson() {
+  String json = "{";
+  for (int f = 0; f < CONFIG_FIELD_COUNT; f++) {
+    const ConfigField& field = CONFIG_FIELDS[f];
+    if (f > 0) json += ",";
+    json += "\"" + String(field.name) + "\":";
+    json += field.type == CONFIG_FLOAT ? String(getConfigValue(config, field), 2) : String((long)getConfigValue(config, field));
+  }
+  json += "}";
+  return json;
+}
+
 // ------------------------------------
-// 3. ULTRASONIC SENSOR FUNCTIONS
+// 4. ULTRASONIC SENSOR FUNCTIONS
 // ------------------------------------
 
-// Measures distance in centimeters using the ultrasonic sensor
-float measureDistance() {
+const unsigned long ECHO_TIMEOUT_US = 30000; // Longer than the echo from MAX_PARKING_DISTANCE
+const unsigned long ECHO_RELEASE_US = 50000; // An HC-SR04 with no echo holds ECHO high for ~38 ms
+
+// Edges of the echo pulse of the bay being measured, timestamped by its interrupt.
+// Bays are measured one at a time, so all echo pins share one capture; edges from any
+// other bay's pin (e.g. the late end of its no-echo pulse) are ignored.
+struct EchoCapture {
+  volatile int pin;       // Echo pin being measured, -1 if none
+  volatile int64_t riseUs;
+  volatile int64_t fallUs;
+  volatile bool done;
+};
+EchoCapture echo = { -1, 0, 0, false };
+
+void IRAM_ATTR onEchoEdge(void* arg) {
+  int64_t now = monoUs();
+  int pin = (int)(intptr_t)arg;
+  if (pin != echo.pin) {
+    return;
+  }
+  if (digitalRead(pin) == HIGH) {
+    echo.riseUs = now;
+  } else if (echo.riseUs != 0) {
+    echo.fallUs = now;
+    echo.done = true;
+  }
+}
+
+// An echo must not be timed while flash is being erased or written by a firmware update
+// (section 17): the cache is off meanwhile, so the echo interrupt would run late. The
+// sensor sequence claims the sensor for the echo and the update task claims the flash
+// for a burst; whichever comes second waits.
+portMUX_TYPE flashMux = portMUX_INITIALIZER_UNLOCKED;
+volatile bool echoInFlight = false;
+volatile bool flashBusy = false;
+unsigned long echoesDeferred = 0; // Triggers held back for a flash burst
+
+bool claimEcho() {
+  portENTER_CRITICAL(&flashMux);
+  bool ok = !flashBusy;
+  if (ok) {
+    echoInFlight = true;
+  }
+  portEXIT_CRITICAL(&flashMux);
+  return ok;
+}
+
+// Starts a measurement; the echo interrupt completes it and loop() fires echoSignal
+void triggerEcho(int trigPin, int echoPin) {
+  echo.riseUs = 0;
+  echo.fallUs = 0;
+  echo.done = false;
+  echo.pin = echoPin;
+
   // Clear the trigger pin by setting it LOW for 2 us
-  digitalWrite(TRIG_PIN, LOW);
+  digitalWrite(trigPin, LOW);
   delayMicroseconds(2);
 
   // Trigger the sensor by setting the trigger pin HIGH for 10 us
-  digitalWrite(TRIG_PIN, HIGH);
+  digitalWrite(trigPin, HIGH);
   delayMicroseconds(10);
-  digitalWrite(TRIG_PIN, LOW);
+  digitalWrite(trigPin, LOW);
+}
+
+// One measurement as sent by /stream: 16 bytes, little-endian like the ESP32 itself
+struct RawSample {
+  uint64_t timeUs;  // monoUs() at the trigger
+  uint32_t echoUs;  // Echo pulse length, 0 if no echo came back
+  uint16_t mm;      // Distance computed from it, before filtering
+  uint8_t bay;
+  uint8_t flags;    // RAW_BEAM_A / RAW_BEAM_B while that beam is interrupted, RAW_NO_ECHO
+};
+static_assert(sizeof(RawSample) == 16, "RawSample is sent as is");
+const uint8_t RAW_BEAM_A = 1;
+const uint8_t RAW_BEAM_B = 2;
+const uint8_t RAW_NO_ECHO = 4;
+
+// Filled by the sensor sequence, drained by the stream task on the other core
+SpscRing<RawSample, RAW_SAMPLE_RING> rawSamples;
+volatile bool streamActive = false;       // A /stream client is attached
+volatile uint32_t rawSamplesDropped = 0;  // Samples that found the ring full, since the client attached
 
-  // Read the echo pin, returns the sound wave travel time in microseconds
-  long duration = pulseIn(ECHO_PIN, HIGH);
+// Queues a sample for the stream client, if there is one. Never waits: when the
+// client cannot keep up the ring fills and samples are dropped and counted.
+void streamSample(int bay, uint64_t triggerUs, bool received, float rawCm) {
+  if (!streamActive) {
+    return;
+  }
+  RawSample sample;
+  sample.timeUs = triggerUs;
+  sample.echoUs = received ? (uint32_t)(echo.fallUs - echo.riseUs) : 0;
+  sample.mm = (uint16_t)lroundf(rawCm * 10);
+  sample.bay = bay;
+  sample.flags = (digitalRead(IR_PIN) == LOW ? RAW_BEAM_A : 0) | (digitalRead(IR_PIN_B) == LOW ? RAW_BEAM_B : 0) |
+                 (received ? 0 : RAW_NO_ECHO);
+  if (!spscPush(rawSamples, sample)) {
+    rawSamplesDropped = rawSamplesDropped + 1;
+  }
+}
+
+// Distance in centimeters from the captured echo; out of range if no echo came back
+float echoDistanceCm(bool received) {
+  if (!received) {
+    return MAX_PARKING_DISTANCE;
+  }
+  // The echo pulse lasts as long as the sound wave travelled, in microseconds
+  long duration = (long)(echo.fallUs - echo.riseUs);
 
   // Calculate the distance: Speed of sound = 343 m/s or 0.0343 cm/us.
   // Distance = (Time * Speed of Sound) / 2
@@ -84,266 +661,3181 @@ float measureDistance() {
 }
 
 // ------------------------------------
-// 4. SERVO CONTROL FUNCTIONS
+// 5. SERVO CONTROL FUNCTIONS
 // ------------------------------------
 
 void setGate(bool open) {
+  if (open != isGateOpen) {
+    publishEvent(open ? EVENT_GATE_OPENED : EVENT_GATE_CLOSED, -1);
+  }
   if (open) {
-    gateServo.write(SERVO_OPEN_ANGLE);
+    gateServo.write(config.servoOpenAngle);
     isGateOpen = true;
     Serial.println("Gate: OPEN");
   } else {
-    gateServo.write(SERVO_CLOSED_ANGLE);
+    gateServo.write(config.servoClosedAngle);
     isGateOpen = false;
     Serial.println("Gate: CLOSED");
   }
-  // Small delay for the servo to move
-  delay(500);
+  markStateChanged();
 }
 
 void openGate() {
   setGate(true);
+  gateCloseAt = monoUs() + gateHoldMs * MONO_MS;
 }
 
 void closeGate() {
   setGate(false);
+  gateCloseAt = 0;
+}
+
+// Gate commands from the HTTP and HTTPS handlers, carried out by gateSequence()
+enum GateCommand { GATE_COMMAND_NONE, GATE_COMMAND_OPEN, GATE_COMMAND_CLOSE };
+volatile int pendingGateCommand = GATE_COMMAND_NONE;
+
+// Carries out gate commands one at a time, letting the servo finish each move before
+// the next one starts. A standby leaves commands pending; they are replicated and
+// carried out if it takes over.
+CoTask gateSequence() {
+  while (true) {
+    int command = pendingGateCommand;
+    if (command == GATE_COMMAND_NONE || !isActiveController()) {
+      co_await coWaitFor(gateCommandSignal, 0);
+      continue;
+    }
+    pendingGateCommand = GATE_COMMAND_NONE;
+    if (command == GATE_COMMAND_OPEN) {
+      openGate();
+    } else {
+      closeGate();
+    }
+    co_await coSleep(sequences, SERVO_SETTLE_MS * 1000ULL);
+  }
 }
 
 // ------------------------------------
-// 5. PARKING LOGIC & STATUS UPDATE
+// 6. BAY CALIBRATION
 // ------------------------------------
 
-void updateStatus() {
-  float distance = measureDistance();
-  int irValue = digitalRead(IR_PIN);
+// Where a bay's occupied state comes from (see section 8)
+enum OccupancySource { SOURCE_SENSOR, SOURCE_HELD, SOURCE_COUNTERS };
+const char* OCCUPANCY_SOURCE_NAMES[] = { "sensor", "held", "counters" };
 
-  if (distance < MAX_DISTANCE_CM) {
-    isSpotOccupied = true;
-  } else {
-    isSpotOccupied = false;
+// Per-bay sensing state. Thresholds start at the compiled-in defaults and are
+// replaced by learned values once the bay has been calibrated.
+struct Bay {
+  float rawCm;            // Latest reading
+  float previousRawCm;    // Reading before it, for the stuck-sensor check
+  float distanceCm;       // Latest reading after the batch filter
+  bool occupied;
+  float thresholdCm;      // Occupied below this distance
+  float hysteresisCm;     // Total width of the band around the threshold
+  float baselineCm;       // Learned empty-bay distance, 0 until calibrated
+  float occupiedCm;       // Learned typical distance to a parked car, 0 until calibrated
+  bool calibrating;
+  unsigned long calSamples;
+  uint16_t calHistogram[CAL_BINS];
+  int64_t sampleUs;       // monoUs() of the latest reading
+  int64_t crossingUs;     // First raw reading past the band since the state last held, 0 if none
+  uint16_t badReadings;   // Timeouts and out-of-range readings in a row
+  uint16_t sameReadings;  // Identical readings in a row
+  uint16_t goodReadings;  // Good readings in a row since the sensor failed
+  bool sensorFailed;
+  OccupancySource source;
+  int64_t failedUs;       // sampleUs of the reading that failed the sensor, 0 while it works
+  bool counterAnchored;   // counterAnchor has been taken since the sensor failed
+  long counterAnchor;     // Vehicles counted in less out, less the other occupied bays, when taken
+};
+
+Bay bays[BAY_COUNT];
+Preferences bayPrefs;
+
+// Raw readings of each bay over sliding windows (see distance_histogram.h). Unlike the
+// calibration histogram they never stop or reset, so a misaligned sensor or a bay that
+// no longer shows two clear empty/occupied peaks can be spotted at any time.
+typedef SlidingHistogram<HIST_BINS, HIST_HOUR_SLICES> HourHistogram;
+typedef SlidingHistogram<HIST_BINS, HIST_DAY_SLICES> DayHistogram;
+HourHistogram hourHistograms[BAY_COUNT];
+DayHistogram dayHistograms[BAY_COUNT];
+
+void initDistanceHistograms() {
+  int64_t now = monoUs();
+  for (int i = 0; i < BAY_COUNT; i++) {
+    histReset(hourHistograms[i], 3600 * MONO_S / HIST_HOUR_SLICES, now);
+    histReset(dayHistograms[i], 86400 * MONO_S / HIST_DAY_SLICES, now);
   }
+}
 
-  Serial.printf("Distance: %.2f cm | Occupied: %s | IR Status: %s\n",
-                distance, isSpotOccupied ? "YES" : "NO", irValue == LOW ? "DETECTED" : "CLEAR");
+void recordDistance(int i, float rawCm, int64_t nowUs) {
+  int bin = rawCm >= MAX_PARKING_DISTANCE ? HIST_BINS - 1 : constrain((int)(rawCm / HIST_BIN_CM), 0, HIST_BINS - 2);
+  histAdd(hourHistograms[i], bin, nowUs);
+  histAdd(dayHistograms[i], bin, nowUs);
 }
 
-// ------------------------------------
-// 6. WEB SERVER HANDLERS
-// ------------------------------------
+// Lot state as one bit per bay (see slot_bitmap.h); kept in step with bays[] by updateStatus().
+// These double as the indexes behind /slots, so a query is a few word-wise ANDs.
+typedef SlotBitmap<BAY_COUNT> BayBitmap;
+BayBitmap occupiedBays;
+BayBitmap reservedBays;
+BayBitmap faultyBays;     // Latest reading timed out or was out of range
+BayBitmap freeBays;       // Not occupied, reserved or faulty; kept up to date by updateFreeBay()
+BayBitmap zoneBays[ZONE_COUNT];
 
-// Serves the main HTML dashboard
-void handleRoot() {
-  // The HTML content with Tailwind CSS CDN for styling and embedded JavaScript for AJAX
-  const char* htmlContent = R"rawliteral(
-<!DOCTYPE html>
-<html lang="en">
-<head>
-    <meta charset="UTF-8">
-    <meta name="viewport" content="width=device-width, initial-scale=1.0">
-    <title>Smart Parking Dashboard</title>
-    <!-- Tailwind CSS CDN -->
-    <script src="https://cdn.tailwindcss.com"></script>
-    <style>
-        body { font-family: 'Inter', sans-serif; background-color: #f7f9fc; }
-        .status-card { transition: all 0.3s ease; }
-    </style>
-</head>
-<body class="p-4 md:p-8">
-    <div class="max-w-4xl mx-auto">
-        <h1 class="text-3xl font-bold text-gray-800 mb-6 border-b pb-2">Smart Parking System (ESP32)</h1>
+const int BAY_ATTRIBUTE_COUNT = 3;
+const uint8_t BAY_ATTRIBUTE_FLAGS[BAY_ATTRIBUTE_COUNT] = { BAY_EV, BAY_ACCESSIBLE, BAY_COMPACT };
+const char* BAY_ATTRIBUTE_NAMES[BAY_ATTRIBUTE_COUNT] = { "ev", "accessible", "compact" };
+BayBitmap attributeBays[BAY_ATTRIBUTE_COUNT];
 
-        <div class="grid md:grid-cols-3 gap-6 mb-8">
-            <!-- Parking Spot Status Card -->
-            <div id="parkingStatusCard" class="status-card bg-white p-6 rounded-xl shadow-lg border-2 border-gray-100 md:col-span-2">
-                <h2 class="text-xl font-semibold mb-4 text-gray-700 flex items-center">
-                    <svg class="w-6 h-6 mr-2 text-indigo-500" fill="none" stroke="currentColor" viewBox="0 0 24 24" xmlns="http://www.w3.org/2000/svg"><path stroke-linecap="round" stroke-linejoin="round" stroke-width="2" d="M17.657 16.657L13.414 20.9a1.998 1.998 0 01-2.828 0l-4.244-4.243a8 8 0 1111.314 0z"></path><path stroke-linecap="round" stroke-linejoin="round" stroke-width="2" d="M15 11a3 3 0 11-6 0 3 3 0 016 0z"></path></svg>
-                    Parking Spot Status
-                </h2>
-                <p class="text-gray-500 mb-4">Spot distance: <span id="distanceCm" class="font-mono text-sm bg-gray-100 px-2 py-1 rounded">-- cm</span></p>
-                <div class="flex items-center space-x-3">
-                    <span id="occupancyIndicator" class="w-4 h-4 rounded-full"></span>
-                    <p id="occupancyText" class="text-2xl font-bold">---</p>
-                </div>
-            </div>
+// Version of the occupied, reserved and faulty bitmaps behind /occupancy.bin and
+// /state.bin. Unlike stateVersion, which every sensor pass bumps, it only moves when a
+// bit does, so the binary responses are rebuilt only when they would differ.
+uint32_t bitmapVersion = 1;
 
-            <!-- Gate Control Card -->
-            <div class="bg-white p-6 rounded-xl shadow-lg border-2 border-gray-100">
-                <h2 class="text-xl font-semibold mb-4 text-gray-700 flex items-center">
-                    <svg class="w-6 h-6 mr-2 text-green-500" fill="none" stroke="currentColor" viewBox="0 0 24 24" xmlns="http://www.w3.org/2000/svg"><path stroke-linecap="round" stroke-linejoin="round" stroke-width="2" d="M12 15v2m-6-6v6m-6-6v6m18-6v6m-6-6v6m-6-6v6m-6-6v6M3 9a9 9 0 0118 0v7a2 2 0 01-2 2H5a2 2 0 01-2-2V9z"></path></svg>
-                    Barrier Gate Control
-                </h2>
-                <p id="gateStatusText" class="text-lg font-medium mb-4">Status: <span class="font-bold text-gray-600">--</span></p>
-                <div class="flex space-x-3">
-                    <button onclick="sendCommand('open')" id="openBtn" class="bg-green-500 hover:bg-green-600 text-white font-bold py-2 px-4 rounded-lg shadow-md transition duration-150 active:scale-95">Open Gate</button>
-                    <button onclick="sendCommand('close')" id="closeBtn" class="bg-red-500 hover:bg-red-600 text-white font-bold py-2 px-4 rounded-lg shadow-md transition duration-150 active:scale-95">Close Gate</button>
-                </div>
-            </div>
-        </div>
-        
-        <!-- System Status Card -->
-        <div class="bg-white p-6 rounded-xl shadow-lg border-2 border-gray-100">
-            <h2 class="text-xl font-semibold mb-4 text-gray-700 flex items-center">
-                <svg class="w-6 h-6 mr-2 text-yellow-500" fill="none" stroke="currentColor" viewBox="0 0 24 24" xmlns="http://www.w3.org/2000/svg"><path stroke-linecap="round" stroke-linejoin="round" stroke-width="2" d="M13 10V3L4 14h7v7l9-11h-7z"></path></svg>
-                System Information
-            </h2>
-            <div class="grid grid-cols-2 gap-4">
-                <p><strong>IR Sensor:</strong> <span id="irStatusText" class="font-medium">---</span></p>
-                <p><strong>Gate Angle:</strong> <span id="gateAngleText" class="font-medium">--°</span></p>
-            </div>
-        </div>
+// Sets a bay's bit in occupiedBays, reservedBays or faultyBays; call updateFreeBay() after
+void setBayBit(BayBitmap& bitmap, int i, bool value) {
+  if (bitmap.test(i) != value) {
+    bitmap.set(i, value);
+    bitmapVersion++;
+  }
+}
 
-    </div>
+void initBayBitmaps() {
+  occupiedBays.clear();
+  reservedBays.clear();
+  faultyBays.clear();
+  freeBays.clear();
+  freeBays.fill(0, BAY_COUNT);
+  for (int z = 0; z < ZONE_COUNT; z++) {
+    zoneBays[z].clear();
+  }
+  for (int a = 0; a < BAY_ATTRIBUTE_COUNT; a++) {
+    attributeBays[a].clear();
+  }
+  for (int i = 0; i < BAY_COUNT; i++) {
+    zoneBays[BAY_ZONES[i]].set(i, true);
+    for (int a = 0; a < BAY_ATTRIBUTE_COUNT; a++) {
+      attributeBays[a].set(i, BAY_ATTRIBUTES[i] & BAY_ATTRIBUTE_FLAGS[a]);
+    }
+  }
+}
 
-    <script>
-        const API_URL = '/status';
-        const PARKED_COLOR = 'bg-red-500';
-        const AVAILABLE_COLOR = 'bg-green-500';
-        
-        async function fetchStatus() {
-            try {
-                const response = await fetch(API_URL);
-                if (!response.ok) throw new Error('Network response was not ok');
-                const data = await response.json();
-                updateDashboard(data);
-            } catch (error) {
-                console.error("Could not fetch status:", error);
-                document.getElementById('occupancyText').textContent = 'ERROR';
-            }
-        }
+// Call after changing a bay's occupied, reserved or faulty bit
+void updateFreeBay(int i) {
+  freeBays.set(i, !occupiedBays.test(i) && !reservedBays.test(i) && !faultyBays.test(i));
+}
 
-        function updateDashboard(data) {
-            // 1. Parking Spot Status
-            const statusCard = document.getElementById('parkingStatusCard');
-            const indicator = document.getElementById('occupancyIndicator');
-            const text = document.getElementById('occupancyText');
-            const distanceText = document.getElementById('distanceCm');
+void loadBayCalibration() {
+  bayPrefs.begin("bays", true);
+  for (int i = 0; i < BAY_COUNT; i++) {
+    char key[8];
+    Bay& bay = bays[i];
+    snprintf(key, sizeof(key), "thr%d", i);
+    bay.thresholdCm = bayPrefs.getFloat(key, config.thresholdCm);
+    snprintf(key, sizeof(key), "hys%d", i);
+    bay.hysteresisCm = bayPrefs.getFloat(key, config.hysteresisCm);
+    snprintf(key, sizeof(key), "base%d", i);
+    bay.baselineCm = bayPrefs.getFloat(key, 0);
+    snprintf(key, sizeof(key), "occ%d", i);
+    bay.occupiedCm = bayPrefs.getFloat(key, 0);
+    // Bays that have never been calibrated start learning straight away
+    bay.calibrating = bay.baselineCm == 0;
+    Serial.printf("Bay %d: threshold %.1f cm, hysteresis %.1f cm%s\n", i, bay.thresholdCm, bay.hysteresisCm,
+                  bay.calibrating ? " (uncalibrated, learning)" : "");
+  }
+  bayPrefs.end();
+}
 
-            distanceText.textContent = `${data.distance_cm.toFixed(2)} cm`;
-            
-            if (data.is_occupied) {
-                indicator.className = 'w-4 h-4 rounded-full ' + PARKED_COLOR;
-                text.textContent = 'OCCUPIED';
-                text.className = 'text-2xl font-bold text-red-600';
-                statusCard.classList.remove('border-green-300');
-                statusCard.classList.add('border-red-300');
-            } else {
-                indicator.className = 'w-4 h-4 rounded-full ' + AVAILABLE_COLOR;
-                text.textContent = 'AVAILABLE';
-                text.className = 'text-2xl font-bold text-green-600';
-                statusCard.classList.remove('border-red-300');
-                statusCard.classList.add('border-green-300');
-            }
+void saveBayCalibration(int i) {
+  char key[8];
+  Bay& bay = bays[i];
+  bayPrefs.begin("bays", false);
+  snprintf(key, sizeof(key), "thr%d", i);
+  bayPrefs.putFloat(key, bay.thresholdCm);
+  snprintf(key, sizeof(key), "hys%d", i);
+  bayPrefs.putFloat(key, bay.hysteresisCm);
+  snprintf(key, sizeof(key), "base%d", i);
+  bayPrefs.putFloat(key, bay.baselineCm);
+  snprintf(key, sizeof(key), "occ%d", i);
+  bayPrefs.putFloat(key, bay.occupiedCm);
+  bayPrefs.end();
+}
 
-            // 2. Gate Status
-            const gateText = document.getElementById('gateStatusText').querySelector('span');
-            const gateAngleText = document.getElementById('gateAngleText');
+void startCalibration(int i) {
+  Bay& bay = bays[i];
+  memset(bay.calHistogram, 0, sizeof(bay.calHistogram));
+  bay.calSamples = 0;
+  bay.calibrating = true;
+}
 
-            if (data.is_gate_open) {
-                gateText.textContent = 'OPEN';
-                gateText.className = 'font-bold text-green-500';
+// Index of the highest bin in [from, to)
+int peakBin(const uint16_t* hist, int from, int to) {
+  int best = from;
+  for (int b = from; b < to; b++) {
+    if (hist[b] > hist[best]) best = b;
+  }
+  return best;
+}
+
+// Splits the bay's histogram into an occupied (near) and empty (far) class and
+// places the threshold in the valley between them. Otsu's method finds the split
+// that best separates the two classes; the threshold is then moved to the
+// emptiest bin between the two class peaks so it sits in the valley.
+// Returns false while the readings do not yet show two distinct classes.
+bool deriveThreshold(Bay& bay) {
+  const uint16_t* hist = bay.calHistogram;
+  double total = 0, weighted = 0;
+  for (int b = 0; b < CAL_BINS; b++) {
+    total += hist[b];
+    weighted += (double)b * hist[b];
+  }
+  if (total == 0) return false;
+
+  int split = -1;
+  double bestVariance = 0, nearCount = 0, nearSum = 0;
+  for (int b = 0; b < CAL_BINS - 1; b++) {
+    nearCount += hist[b];
+    nearSum += (double)b * hist[b];
+    double farCount = total - nearCount;
+    if (nearCount == 0 || farCount == 0) continue;
+    double diff = nearSum / nearCount - (weighted - nearSum) / farCount;
+    double variance = nearCount * farCount * diff * diff;
+    if (variance > bestVariance) {
+      bestVariance = variance;
+      split = b;
+    }
+  }
+  if (split < 0) return false;
+
+  double nearShare = 0;
+  for (int b = 0; b <= split; b++) nearShare += hist[b];
+  nearShare /= total;
+  int nearPeak = peakBin(hist, 0, split + 1);
+  int farPeak = peakBin(hist, split + 1, CAL_BINS);
+  float separationCm = (farPeak - nearPeak) * CAL_BIN_CM;
+  if (nearShare < CAL_MIN_CLASS_FRACTION || nearShare > 1 - CAL_MIN_CLASS_FRACTION ||
+      separationCm < CAL_MIN_SEPARATION_CM) {
+    return false;
+  }
+
+  int valley = nearPeak;
+  for (int b = nearPeak; b <= farPeak; b++) {
+    if (hist[b] < hist[valley]) valley = b;
+  }
+
+  bay.occupiedCm = (nearPeak + 0.5) * CAL_BIN_CM;
+  bay.baselineCm = (farPeak + 0.5) * CAL_BIN_CM;
+  bay.thresholdCm = (valley + 0.5) * CAL_BIN_CM;
+  bay.hysteresisCm = constrain(separationCm * 0.2, (float)CAL_BIN_CM, 20.0f);
+  return true;
+}
+
+// Adds one reading to a calibrating bay and finishes calibration once both the
+// empty and the occupied distributions have been observed
+void feedCalibration(int i, float distanceCm) {
+  Bay& bay = bays[i];
+  if (!bay.calibrating || distanceCm <= 0 || distanceCm >= MAX_PARKING_DISTANCE) {
+    return; // Timeouts and clamped readings say nothing about the bay
+  }
+  int bin = constrain((int)(distanceCm / CAL_BIN_CM), 0, CAL_BINS - 1);
+  if (bay.calHistogram[bin] == UINT16_MAX) {
+    // Halve all bins so long-running calibrations keep their shape without overflowing
+    for (int b = 0; b < CAL_BINS; b++) bay.calHistogram[b] >>= 1;
+  }
+  bay.calHistogram[bin]++;
+  bay.calSamples++;
+
+  if (bay.calSamples >= CAL_MIN_SAMPLES && bay.calSamples % 100 == 0 && deriveThreshold(bay)) {
+    bay.calibrating = false;
+    saveBayCalibration(i);
+    Serial.printf("Bay %d calibrated: empty %.1f cm, occupied %.1f cm, threshold %.1f cm, hysteresis %.1f cm\n",
+                  i, bay.baselineCm, bay.occupiedCm, bay.thresholdCm, bay.hysteresisCm);
+  }
+}
+
+// ------------------------------------
+// 7. EVENT LOG & PARKING SESSIONS
+// ------------------------------------
+// A session runs from the moment a bay becomes occupied until it is free again.
+// Open sessions live in a fixed pool with a free list, indexed by bay, so opening
+// and closing are O(1) and never allocate. Closed sessions are appended to the
+// event log on LittleFS for billing and dwell analytics. The log holds fixed-size
+// records numbered across reboots and rotations, so readers can resume from a
+// record number.
+
+enum EventLogType : uint8_t {
+  LOG_SESSION_CLOSED = 1,
+};
+
+// One event log record. Times are UTC seconds, 0 if the clock had not been set yet.
+struct EventLogRecord {
+  uint32_t seq;        // Record number, counting across reboots and rotations
+  uint8_t type;
+  uint8_t reserved;
+  int16_t bay;
+  uint32_t sessionId;
+  uint32_t startTime;
+  uint32_t endTime;
+  uint32_t durationS;  // Measured with monoUs(), so right even without a clock
+  char tag[SESSION_TAG_LENGTH];
+};
+
+bool eventLogReady = false;
+uint32_t eventLogNextSeq = 0;
+uint32_t eventLogRecords = 0;     // Records in EVENT_LOG_PATH
+uint32_t eventLogWriteErrors = 0;
+
+// An open parking session
+struct ParkingSession {
+  uint32_t id;
+  int16_t bay;
+  int16_t nextFree;    // Free-list link while the entry is unused
+  int64_t startUs;     // monoUs() when it opened
+  uint32_t startTime;
+  char tag[SESSION_TAG_LENGTH];
+};
+
+const int SESSION_POOL_SIZE = BAY_COUNT; // A bay has at most one open session
+ParkingSession sessionPool[SESSION_POOL_SIZE];
+int16_t baySession[BAY_COUNT];           // Pool index of each bay's open session, -1 if none
+int16_t freeSessions = -1;               // Head of the free list
+uint32_t nextSessionId = 1;
+unsigned long sessionsOpened = 0;
+unsigned long sessionsClosed = 0;
+Preferences sessionPrefs;
+
+// Current UTC time in seconds, or 0 until NTP has set the clock
+uint32_t wallClock() {
+  time_t now = time(nullptr);
+  return now > 1600000000 ? (uint32_t)now : 0;
+}
+
+// Reads the number of the last record in a log file; returns false if it has none
+bool lastLogSeq(const char* path, uint32_t& seq) {
+  File file = LittleFS.open(path, FILE_READ);
+  if (!file || file.size() < sizeof(EventLogRecord)) {
+    return false;
+  }
+  EventLogRecord last;
+  file.seek(file.size() - file.size() % sizeof(last) - sizeof(last));
+  bool ok = file.read((uint8_t*)&last, sizeof(last)) == sizeof(last);
+  file.close();
+  seq = last.seq;
+  return ok;
+}
+
+void initEventLog() {
+  if (!LittleFS.begin(true)) {
+    Serial.println("Event log: LittleFS unavailable, closed sessions will not be logged");
+    return;
+  }
+  File file = LittleFS.open(EVENT_LOG_PATH, FILE_READ);
+  eventLogRecords = file ? file.size() / sizeof(EventLogRecord) : 0;
+  if (file) {
+    file.close();
+  }
+  uint32_t last;
+  if (lastLogSeq(EVENT_LOG_PATH, last) || lastLogSeq(EVENT_LOG_OLD_PATH, last)) {
+    eventLogNextSeq = last + 1;
+  }
+  eventLogReady = true;
+  Serial.printf("Event log: %lu records, next is #%lu\n", (unsigned long)eventLogRecords, (unsigned long)eventLogNextSeq);
+}
+
+void appendEventLog(EventLogRecord& record) {
+  if (!eventLogReady) {
+    return;
+  }
+  if (eventLogRecords >= EVENT_LOG_MAX_RECORDS) {
+    LittleFS.remove(EVENT_LOG_OLD_PATH);
+    LittleFS.rename(EVENT_LOG_PATH, EVENT_LOG_OLD_PATH);
+    eventLogRecords = 0;
+  }
+  record.seq = eventLogNextSeq;
+  File file = LittleFS.open(EVENT_LOG_PATH, FILE_APPEND);
+  if (file && file.write((const uint8_t*)&record, sizeof(record)) == sizeof(record)) {
+    eventLogNextSeq++;
+    eventLogRecords++;
+  } else {
+    eventLogWriteErrors++;
+  }
+  if (file) {
+    file.close();
+  }
+}
+
+void initSessions() {
+  for (int i = 0; i < BAY_COUNT; i++) {
+    baySession[i] = -1;
+  }
+  for (int s = SESSION_POOL_SIZE - 1; s >= 0; s--) {
+    sessionPool[s].nextFree = freeSessions;
+    freeSessions = s;
+  }
+  sessionPrefs.begin("sessions", false);
+  nextSessionId = sessionPrefs.getUInt("next", 1); // Session IDs stay unique across reboots
+}
+
+void openSession(int bay) {
+  if (baySession[bay] >= 0 || freeSessions < 0) {
+    return;
+  }
+  int16_t s = freeSessions;
+  ParkingSession& session = sessionPool[s];
+  freeSessions = session.nextFree;
+  session.id = nextSessionId++;
+  session.bay = bay;
+  session.startUs = monoUs();
+  session.startTime = wallClock();
+  session.tag[0] = '\0';
+  baySession[bay] = s;
+  sessionsOpened++;
+  sessionPrefs.putUInt("next", nextSessionId);
+}
+
+// Ends the bay's open session, if any, and logs it
+void closeSession(int bay) {
+  int16_t s = baySession[bay];
+  if (s < 0) {
+    return;
+  }
+  ParkingSession& session = sessionPool[s];
+  EventLogRecord record = {};
+  record.type = LOG_SESSION_CLOSED;
+  record.bay = bay;
+  record.sessionId = session.id;
+  record.startTime = session.startTime;
+  record.endTime = wallClock();
+  record.durationS = (monoUs() - session.startUs) / MONO_S;
+  memcpy(record.tag, session.tag, SESSION_TAG_LENGTH);
+  appendEventLog(record);
+  Serial.printf("Session %lu: bay %d free after %lu s\n", (unsigned long)session.id, bay, (unsigned long)record.durationS);
+
+  baySession[bay] = -1;
+  session.nextFree = freeSessions;
+  freeSessions = s;
+  sessionsClosed++;
+}
+
+// Attaches a tag ID to the bay's open session. Tags are letters, digits, '-' and '_'.
+bool setSessionTag(int bay, const String& tag) {
+  if (baySession[bay] < 0 || tag.length() >= (unsigned)SESSION_TAG_LENGTH) {
+    return false;
+  }
+  for (unsigned i = 0; i < tag.length(); i++) {
+    if (!isalnum(tag[i]) && tag[i] != '-' && tag[i] != '_') {
+      return false;
+    }
+  }
+  strcpy(sessionPool[baySession[bay]].tag, tag.c_str());
+  return true;
+}
+
+// ------------------------------------
+// 8. PARKING LOGIC & STATUS UPDATE
+// ------------------------------------
+
+// Batch filter state for all bays, one entry per bay (see batch_filter.h)
+int16_t filterPrev1[BAY_COUNT];
+int16_t filterPrev2[BAY_COUNT];
+int32_t filterEma[BAY_COUNT];
+BatchFilterState bayFilter = { BAY_COUNT, filterPrev1, filterPrev2, filterEma };
+bool bayFilterPrimed = false;
+
+// Sensor health. A failed HC-SR04 (unplugged, wet or dead) times out on every reading,
+// which reads as MAX_PARKING_DISTANCE and would show its bay free for as long as it is
+// broken; a stuck one repeats the same echo time, which a live echo never does for
+// long. A bay whose sensor has failed keeps the state it was last sensed in, unless the
+// lane counters settle it (see serviceFailedBays() in section 9), and is marked faulty
+// so that it is never offered as free. The sensor is trusted again after
+// SENSOR_RECOVER_READINGS good readings in a row, with the bay's filter restarted at
+// the latest reading.
+int failedSensors = 0;
+unsigned long sensorFailures = 0;
+unsigned long sensorRecoveries = 0;
+
+// Follows a bay's sensor health from its latest reading. Returns true if the sensor
+// has just failed or recovered.
+bool checkSensorHealth(int i) {
+  Bay& bay = bays[i];
+  bool outOfRange = bay.rawCm <= 0 || bay.rawCm >= MAX_PARKING_DISTANCE;
+  bool same = !outOfRange && bay.rawCm == bay.previousRawCm;
+  bay.previousRawCm = bay.rawCm;
+  bay.badReadings = outOfRange ? min(bay.badReadings + 1, (int)UINT16_MAX) : 0;
+  bay.sameReadings = same ? min(bay.sameReadings + 1, (int)UINT16_MAX) : 0;
+
+  if (!bay.sensorFailed) {
+    if (bay.badReadings < SENSOR_FAIL_READINGS && bay.sameReadings < SENSOR_STUCK_READINGS) {
+      return false;
+    }
+    bay.sensorFailed = true;
+    bay.source = SOURCE_HELD;
+    bay.failedUs = bay.sampleUs;
+    bay.goodReadings = 0;
+    bay.crossingUs = 0;
+    bay.counterAnchored = false;
+    failedSensors++;
+    sensorFailures++;
+    Serial.printf("Bay %d: sensor FAILED (%s), holding it %s\n", i,
+                  bay.badReadings >= SENSOR_FAIL_READINGS ? "no echo" : "stuck reading",
+                  bay.occupied ? "occupied" : "free");
+    return true;
+  }
+
+  bay.goodReadings = outOfRange || same ? 0 : bay.goodReadings + 1;
+  if (bay.goodReadings < SENSOR_RECOVER_READINGS) {
+    return false;
+  }
+  bay.sensorFailed = false;
+  bay.source = SOURCE_SENSOR;
+  failedSensors--;
+  sensorRecoveries++;
+  Serial.printf("Bay %d: sensor recovered after %lld s\n", i, (long long)((bay.sampleUs - bay.failedUs) / MONO_S));
+  bay.failedUs = 0;
+  return true;
+}
+
+// Moves a bay to a new state, opening or closing its session and publishing the change
+void setBayOccupied(int i, bool occupied, int64_t edgeUs) {
+  Bay& bay = bays[i];
+  bay.occupied = occupied;
+  bay.crossingUs = 0;
+  if (occupied) {
+    openSession(i);
+    publishEvent(EVENT_BAY_OCCUPIED, i, edgeUs);
+  } else {
+    closeSession(i);
+    publishEvent(EVENT_BAY_FREED, i, edgeUs);
+  }
+}
+
+void updateStatus() {
+  int irValue = digitalRead(IR_PIN);
+
+  // Take every bay's reading into one row (in millimetres), then filter the row in one pass
+  int16_t rawMm[BAY_COUNT];
+  int16_t filteredMm[BAY_COUNT];
+  for (int i = 0; i < BAY_COUNT; i++) {
+    rawMm[i] = (int16_t)lroundf(bays[i].rawCm * 10);
+    if (checkSensorHealth(i) && !bays[i].sensorFailed && bayFilterPrimed) {
+      // Whatever the filter made of the fault is no guide to the bay now
+      batchFilterResetSensor(bayFilter, i, rawMm[i]);
+    }
+    if (bays[i].badReadings > 0 && bayFilterPrimed) {
+      // A timeout says nothing about the bay: the filter gets its previous input again,
+      // so that a failing sensor cannot drag the bay to free before it counts as failed
+      rawMm[i] = bayFilter.prev1[i];
+    }
+    if (!bays[i].sensorFailed) {
+      feedCalibration(i, bays[i].rawCm);
+    }
+  }
+  if (!bayFilterPrimed) {
+    batchFilterReset(bayFilter, rawMm);
+    bayFilterPrimed = true;
+  }
+  batchFilter(bayFilter, rawMm, filteredMm, 1);
+
+  for (int i = 0; i < BAY_COUNT; i++) {
+    Bay& bay = bays[i];
+    float distance = filteredMm[i] / 10.0;
+    bay.distanceCm = distance;
+
+    // A bay whose sensor has failed keeps its state; the readings say nothing about it
+    if (!bay.sensorFailed) {
+      // The change is dated from the first raw reading past the band, so the latency
+      // reported for it includes the time the filter took to confirm it
+      float half = bay.hysteresisCm / 2;
+      bool valid = bay.badReadings == 0;
+      bool rawOccupied = valid && bay.rawCm < bay.thresholdCm - half;
+      bool rawFree = valid && bay.rawCm > bay.thresholdCm + half;
+      if (bay.occupied ? rawFree : rawOccupied) {
+        if (bay.crossingUs == 0) {
+          bay.crossingUs = bay.sampleUs;
+        }
+      } else if (bay.occupied ? rawOccupied : rawFree) {
+        bay.crossingUs = 0;
+      }
+
+      // Hold the current state while the reading is inside the hysteresis band
+      int64_t edgeUs = bay.crossingUs != 0 ? bay.crossingUs : bay.sampleUs;
+      if (!bay.occupied && distance < bay.thresholdCm - half) {
+        setBayOccupied(i, true, edgeUs);
+      } else if (bay.occupied && distance > bay.thresholdCm + half) {
+        setBayOccupied(i, false, edgeUs);
+      }
+    }
+    setBayBit(occupiedBays, i, bay.occupied);
+    setBayBit(faultyBays, i, bay.sensorFailed || bay.rawCm <= 0 || bay.rawCm >= MAX_PARKING_DISTANCE);
+    updateFreeBay(i);
+    crdtPublishBay(i, bay.occupied);
+
+    Serial.printf("Bay %d | Distance: %.2f cm (raw %.2f) | Occupied: %s (%s) | IR Status: %s\n",
+                  i, distance, bay.rawCm, bay.occupied ? "YES" : "NO", OCCUPANCY_SOURCE_NAMES[bay.source],
+                  irValue == LOW ? "DETECTED" : "CLEAR");
+  }
+  markStateChanged();
+}
+
+unsigned long sensorRounds = 0; // Wake-ups of the sensor sequence, part of an updated image's health check
+
+// Measures every bay in turn once per sensor interval, then updates the parking state.
+// Each echo is awaited rather than timed with pulseIn(), so requests are served while
+// the sound is in flight.
+CoTask sensorSequence() {
+  while (true) {
+    int64_t dueUs = sequences.nowUs + config.sensorIntervalMs * MONO_MS;
+    co_await coSleep(sequences, config.sensorIntervalMs * MONO_MS);
+    recordTiming(sensorWakeLate, monoUs() - dueUs);
+    sensorRounds++;
+    if (!isActiveController()) {
+      continue; // The bay sensors belong to the primary
+    }
+    for (int i = 0; i < BAY_COUNT; i++) {
+      while (!claimEcho()) {
+        echoesDeferred++;
+        co_await coSleep(sequences, MONO_MS); // A flash burst takes a few tens of ms at most
+      }
+      uint64_t triggerUs = monoUs();
+      triggerEcho(BAY_TRIG_PINS[i], BAY_ECHO_PINS[i]);
+      bool received = co_await coWaitFor(echoSignal, ECHO_TIMEOUT_US);
+      echo.pin = -1;
+      echoInFlight = false;
+      bays[i].rawCm = echoDistanceCm(received);
+      bays[i].sampleUs = triggerUs;
+      recordDistance(i, bays[i].rawCm, triggerUs);
+      streamSample(i, triggerUs, received, bays[i].rawCm);
+
+      // A sensor that heard nothing is still holding ECHO high; let it finish before the
+      // next one fires, so the two pulses cannot overlap
+      while (digitalRead(BAY_ECHO_PINS[i]) == HIGH && monoUs() - triggerUs < ECHO_RELEASE_US) {
+        co_await coSleep(sequences, MONO_MS);
+      }
+    }
+    updateStatus();
+  }
+}
+
+// ------------------------------------
+// 9. LANE COUNTING (TWO IR BEAMS)
+// ------------------------------------
+
+// A beam edge captured by the IR interrupts. Timestamps are taken in the ISR so the
+// decoder sees the true order and spacing of edges even if loop() is busy.
+struct BeamEdge {
+  uint8_t beam;          // 0 = beam A, 1 = beam B
+  uint8_t blocked;       // 1 when the beam was interrupted, 0 when it cleared
+  int64_t timeUs;        // monoUs() at the edge
+};
+
+const int EDGE_QUEUE_SIZE = 32; // Must be a power of two
+BeamEdge edgeQueue[EDGE_QUEUE_SIZE];
+volatile uint8_t edgeHead = 0;  // Written by the ISRs
+volatile uint8_t edgeTail = 0;  // Written by loop()
+volatile unsigned long droppedEdges = 0;
+portMUX_TYPE edgeMux = portMUX_INITIALIZER_UNLOCKED;
+
+// One vehicle (or pedestrian) crossing both beams, from first block to last clear
+struct Passage {
+  int firstBeam;              // Beam blocked first, -1 when no passage is in progress
+  bool overlapped;            // Both beams were blocked at the same time
+  int64_t blockUs[2];         // Time each beam was first blocked
+  int64_t clearUs[2];         // Time each beam last cleared
+  bool blocked[2];            // Current beam state as seen by the decoder
+  bool broken[2];             // Beam has been blocked at least once in this passage
+  int lastClearedBeam;
+};
+
+Passage passage = { -1, false, {0, 0}, {0, 0}, {false, false}, {false, false}, -1 };
+unsigned long vehiclesIn = 0;
+unsigned long vehiclesOut = 0;
+unsigned long rejectedPassages = 0; // Pedestrians, reversals and other incomplete crossings
+
+// Vehicle size classes, by estimated length
+enum VehicleClass { VEHICLE_UNKNOWN, VEHICLE_MOTORCYCLE, VEHICLE_CAR, VEHICLE_VAN, VEHICLE_LONG };
+const char* VEHICLE_CLASS_NAMES[] = { "unknown", "motorcycle", "car", "van", "long" };
+
+// Speed and length of the most recent counted vehicle
+float lastSpeedKmh = 0;
+float lastLengthM = 0;
+VehicleClass lastVehicleClass = VEHICLE_UNKNOWN;
+float avgSpeedMps = 0;   // Smoothed over recent vehicles, 0 until the first one is measured
+float avgLengthM = 0;
+
+// Arrivals at and departures from the entry barrier, for the queue estimate
+LaneQueue laneQueue;
+unsigned long laneOverloads = 0;
+int64_t laneQueueCheckAt = 0;
+int64_t failedBaysCheckAt = 0;
+
+void IRAM_ATTR queueBeamEdge(uint8_t beam, int pin) {
+  portENTER_CRITICAL_ISR(&edgeMux);
+  uint8_t next = (edgeHead + 1) & (EDGE_QUEUE_SIZE - 1);
+  if (next == edgeTail) {
+    droppedEdges = droppedEdges + 1;
+  } else {
+    edgeQueue[edgeHead].beam = beam;
+    edgeQueue[edgeHead].blocked = digitalRead(pin) == LOW; // LOW means the beam is interrupted
+    edgeQueue[edgeHead].timeUs = monoUs();
+    edgeHead = next;
+  }
+  portEXIT_CRITICAL_ISR(&edgeMux);
+}
+
+void IRAM_ATTR onBeamAEdge() {
+  queueBeamEdge(0, IR_PIN);
+}
+
+void IRAM_ATTR onBeamBEdge() {
+  queueBeamEdge(1, IR_PIN_B);
+}
+
+// Spaces left in the lot according to the entry/exit counters alone
+int lotFreeSpaces() {
+  long parked = (long)vehiclesIn - (long)vehiclesOut;
+  return constrain(config.lotCapacity - parked, 0L, config.lotCapacity);
+}
+
+VehicleClass classifyVehicle(float lengthM) {
+  if (lengthM < 2.5) return VEHICLE_MOTORCYCLE;
+  if (lengthM < 5.5) return VEHICLE_CAR;
+  if (lengthM < 8.0) return VEHICLE_VAN;
+  return VEHICLE_LONG;
+}
+
+// Time the gate should stay open for a vehicle of the given length moving at the given speed
+unsigned long holdTimeMs(float speedMps, float lengthM) {
+  unsigned long holdMs = GATE_HOLD_DEFAULT_MS;
+  if (speedMps > 0) {
+    holdMs = (unsigned long)((lengthM + GATE_CLEARANCE_M) / speedMps * 1000.0);
+  }
+  // The default is clamped too: the limits are the operator's, whatever the estimate
+  return constrain(holdMs, (unsigned long)config.gateHoldMinMs, (unsigned long)config.gateHoldMaxMs);
+}
+
+// Derives speed and length from the beam timestamps of a counted passage.
+// Speed comes from the front and rear edges crossing the known beam spacing;
+// length is speed times how long each beam stayed blocked.
+void estimateVehicle(int first, int second) {
+  int64_t frontUs = passage.blockUs[second] - passage.blockUs[first];
+  int64_t rearUs = passage.clearUs[second] - passage.clearUs[first];
+  if (frontUs <= 0 || rearUs <= 0) {
+    return; // Vehicle stopped or rocked between the beams; timings are meaningless
+  }
+  float speedMps = (BEAM_SPACING_M * 1e6 / (float)frontUs + BEAM_SPACING_M * 1e6 / (float)rearUs) / 2;
+  float breakS = ((passage.clearUs[0] - passage.blockUs[0]) + (passage.clearUs[1] - passage.blockUs[1])) / 2e6;
+  float lengthM = speedMps * breakS;
+
+  lastSpeedKmh = speedMps * 3.6;
+  lastLengthM = lengthM;
+  lastVehicleClass = classifyVehicle(lengthM);
+  if (avgSpeedMps == 0) {
+    avgSpeedMps = speedMps;
+    avgLengthM = lengthM;
+  } else {
+    avgSpeedMps += (speedMps - avgSpeedMps) * 0.25;
+    avgLengthM += (lengthM - avgLengthM) * 0.25;
+  }
+  gateHoldMs = holdTimeMs(avgSpeedMps, avgLengthM);
+
+  // The vehicle's rear has just cleared the beams: close once it has also cleared the arm
+  if (isGateOpen) {
+    gateCloseAt = monoUs() + holdTimeMs(speedMps, 0) * MONO_MS;
+  }
+  Serial.printf("Lane: %s, %.1f km/h, %.1f m (next hold %lu ms)\n",
+                VEHICLE_CLASS_NAMES[lastVehicleClass], lastSpeedKmh, lastLengthM, gateHoldMs);
+}
+
+// Closes the gate once its hold time has passed, but never onto a vehicle still in the beams
+void serviceGateHold() {
+  if (!isGateOpen || gateCloseAt == 0 || monoUs() < gateCloseAt) {
+    return;
+  }
+  if (passage.blocked[0] || passage.blocked[1]) {
+    return; // Slow or long vehicle still under the arm; check again next loop
+  }
+  Serial.println("Gate: hold time elapsed");
+  closeGate();
+}
+
+// Called once both beams are clear again: decide whether a vehicle went in, out, or neither
+void finishPassage() {
+  markStateChanged();
+  int first = passage.firstBeam;
+  int second = 1 - first;
+  passage.firstBeam = -1;
+  if (!passage.broken[second]) {
+    laneQueueDepart(laneQueue, passage.clearUs[first], false);
+    rejectedPassages++;
+    Serial.println("Lane: passage rejected (only one beam broken)");
+    return;
+  }
+  unsigned long breakA = passage.clearUs[0] - passage.blockUs[0];
+  unsigned long breakB = passage.clearUs[1] - passage.blockUs[1];
+  unsigned long minBreakUs = config.minVehicleBreakMs * MONO_MS;
+  bool longEnough = breakA >= minBreakUs && breakB >= minBreakUs;
+
+  // A vehicle blocks both beams at once and leaves through the beam it reached last
+  if (passage.overlapped && longEnough && passage.lastClearedBeam == second) {
+    estimateVehicle(first, second);
+    int64_t edgeUs = passage.clearUs[second]; // The edge that completed the passage
+    if (first == 0) {
+      vehiclesIn++;
+      laneQueueDepart(laneQueue, edgeUs, true);
+      publishEvent(EVENT_VEHICLE_IN, -1, edgeUs);
+      crdtCountVehicle(1);
+      Serial.printf("Lane: vehicle IN (in=%lu out=%lu free=%d)\n", vehiclesIn, vehiclesOut, lotFreeSpaces());
+    } else {
+      vehiclesOut++;
+      publishEvent(EVENT_VEHICLE_OUT, -1, edgeUs);
+      crdtCountVehicle(-1);
+      Serial.printf("Lane: vehicle OUT (in=%lu out=%lu free=%d)\n", vehiclesIn, vehiclesOut, lotFreeSpaces());
+    }
+  } else {
+    laneQueueDepart(laneQueue, passage.clearUs[passage.lastClearedBeam], false);
+    rejectedPassages++;
+    Serial.printf("Lane: passage rejected (A %lu ms, B %lu ms, overlap %s)\n",
+                  breakA / 1000, breakB / 1000, passage.overlapped ? "yes" : "no");
+  }
+}
+
+// Feeds one beam edge through the direction-decoding state machine
+void decodeBeamEdge(const BeamEdge& edge) {
+  int beam = edge.beam;
+  bool blocked = edge.blocked;
+  if (passage.blocked[beam] == blocked) {
+    return; // Duplicate level from contact bounce
+  }
+  passage.blocked[beam] = blocked;
+  markStateChanged();
+
+  if (blocked) {
+    if (passage.firstBeam < 0) {
+      passage.firstBeam = beam;
+      passage.overlapped = false;
+      passage.broken[0] = passage.broken[1] = false;
+      if (beam == 0) {
+        laneQueueArrive(laneQueue, edge.timeUs); // An entering vehicle has reached the barrier
+      }
+    }
+    if (!passage.broken[beam]) {
+      passage.broken[beam] = true;
+      passage.blockUs[beam] = edge.timeUs;
+    }
+    if (passage.blocked[0] && passage.blocked[1]) {
+      passage.overlapped = true;
+    }
+  } else if (passage.firstBeam >= 0) {
+    passage.clearUs[beam] = edge.timeUs;
+    passage.lastClearedBeam = beam;
+    if (!passage.blocked[0] && !passage.blocked[1]) {
+      finishPassage();
+    }
+  }
+}
+
+// Drains the edge queue filled by the IR interrupts
+void processBeamEdges() {
+  while (true) {
+    BeamEdge edge;
+    portENTER_CRITICAL(&edgeMux);
+    bool empty = edgeTail == edgeHead;
+    if (!empty) {
+      edge = edgeQueue[edgeTail];
+      edgeTail = (edgeTail + 1) & (EDGE_QUEUE_SIZE - 1);
+    }
+    portEXIT_CRITICAL(&edgeMux);
+    if (empty) {
+      break;
+    }
+    if (isActiveController()) {
+      decodeBeamEdge(edge);
+    } else {
+      passage.blocked[edge.beam] = edge.blocked; // Standby: track levels only, the primary counts
+    }
+  }
+}
+
+// Raises or clears the entry overload alarm, once a second
+void serviceLaneQueue() {
+  int64_t now = monoUs();
+  if (now < laneQueueCheckAt) {
+    return;
+  }
+  laneQueueCheckAt = now + MONO_S;
+  int change = laneQueueCheck(laneQueue, now, QUEUE_OVERLOAD_RHO, QUEUE_CLEAR_RHO, QUEUE_OVERLOAD_RUN,
+                              QUEUE_MIN_SERVICES);
+  if (change == 0) {
+    return;
+  }
+  markStateChanged();
+  if (change > 0) {
+    laneOverloads++;
+    publishEvent(EVENT_LANE_OVERLOAD, -1);
+  } else {
+    publishEvent(EVENT_LANE_OVERLOAD_CLEARED, -1);
+  }
+  Serial.printf("Lane: %s (%.1f arrivals/min, %.1f served/min, %u queued in a row)\n",
+                change > 0 ? "OVERLOAD, arrivals are outrunning the barrier" : "overload cleared",
+                laneArrivalRate(laneQueue, now) * 60, laneServiceRate(laneQueue) * 60, (unsigned)laneQueue.backToBack);
+}
+
+// Settles the bays whose sensors have failed from the entry/exit counters, once a
+// second, where the counters leave no doubt. The counters start at zero on every boot,
+// so they say nothing about the vehicles already parked; only what they counted since
+// the bay was anchored (when its sensor failed, or the counters last settled it) is
+// used. Vehicles counted in since then and not seen arriving in another bay went to
+// this bay, a space without a sensor, or another failed bay; once there are more of
+// them than those others can hold, this bay is occupied. Likewise, once more vehicles
+// have left unseen than the others can have held, it is free. Until then it keeps the
+// state it was last in.
+void serviceFailedBays() {
+  int64_t now = monoUs();
+  if (failedSensors == 0 || now < failedBaysCheckAt) {
+    return;
+  }
+  failedBaysCheckAt = now + MONO_S;
+  long occupied = 0;
+  for (int i = 0; i < BAY_COUNT; i++) {
+    occupied += bays[i].occupied;
+  }
+  long counted = (long)vehiclesIn - (long)vehiclesOut;
+  long unsensedSpaces = max(config.lotCapacity - BAY_COUNT, 0L);
+
+  bool changed = false;
+  for (int i = 0; i < BAY_COUNT; i++) {
+    Bay& bay = bays[i];
+    if (!bay.sensorFailed) {
+      continue;
+    }
+    long others = occupied - bay.occupied;
+    long unexplained = counted - others;
+    if (!bay.counterAnchored) {
+      bay.counterAnchor = unexplained;
+      bay.counterAnchored = true;
+      continue;
+    }
+    // Net vehicles in since the anchor, and what else could have taken them in or out
+    long flow = unexplained - bay.counterAnchor;
+    long elsewhere = unsensedSpaces + failedSensors - 1;
+    if (bay.occupied ? -flow <= elsewhere : flow <= elsewhere) {
+      continue;
+    }
+    setBayOccupied(i, !bay.occupied, now);
+    bay.source = SOURCE_COUNTERS;
+    bay.counterAnchor = unexplained; // Start over from the state just set
+    occupied = others + bay.occupied;
+    setBayBit(occupiedBays, i, bay.occupied);
+    updateFreeBay(i);
+    crdtPublishBay(i, bay.occupied);
+    changed = true;
+    Serial.printf("Bay %d: %s according to the lane counters (sensor failed, %ld net %s unseen)\n", i,
+                  bay.occupied ? "occupied" : "free", labs(flow), flow > 0 ? "in" : "out");
+  }
+  if (changed) {
+    markStateChanged();
+  }
+}
+
+// ------------------------------------
+// 10. WEB SERVER HANDLERS
+// ------------------------------------
+
+// Sends a file from the asset partition straight out of mapped flash; false if there is none
+bool sendAsset(const char* name) {
+  const AssetEntry* file = assetFind(assets, name);
+  if (file == nullptr) {
+    return false;
+  }
+  if (file->flags & ASSET_GZIP) {
+    server.sendHeader("Content-Encoding", "gzip");
+  }
+  server.send_P(200, ASSET_MIME_TYPES[file->mime], (PGM_P)assetData(assets, file), file->length);
+  assetsServed++;
+  return true;
+}
+
+// Serves index.html from the asset partition, or the dashboard built into the sketch
+void handleRoot() {
+  if (sendAsset("index.html")) {
+    return;
+  }
+  // The HTML content with Tailwind CSS CDN for styling and embedded JavaScript for AJAX
+  const char* htmlContent = R"rawliteral(
+<!DOCTYPE html>
+<html lang="en">
+<head>
+    <meta charset="UTF-8">
+    <meta name="viewport" content="width=device-width, initial-scale=1.0">
+    <title>Smart Parking Dashboard</title>
+    <!-- Tailwind CSS CDN -->
+    <script src="https://cdn.tailwindcss.com"></script>
+    <style>
+        body { font-family: 'Inter', sans-serif; background-color: #f7f9fc; }
+        .status-card { transition: all 0.3s ease; }
+        #slotGrid { position: relative; height: 320px; overflow-y: auto; contain: strict; }
+        #slotGridSpacer { position: relative; width: 1px; }
+        .slot-cell { position: absolute; top: 0; left: 0; width: 32px; height: 32px; border-radius: 6px;
+                     font: 10px monospace; line-height: 32px; text-align: center; color: #fff; will-change: transform; }
+        .slot-free { background: #22c55e; }
+        .slot-occupied { background: #ef4444; }
+    </style>
+</head>
+<body class="p-4 md:p-8">
+    <div class="max-w-4xl mx-auto">
+        <h1 class="text-3xl font-bold text-gray-800 mb-6 border-b pb-2">Smart Parking System (ESP32)</h1>
+
+        <div class="grid md:grid-cols-3 gap-6 mb-8">
+            <!-- Parking Spot Status Card -->
+            <div id="parkingStatusCard" class="status-card bg-white p-6 rounded-xl shadow-lg border-2 border-gray-100 md:col-span-2">
+                <h2 class="text-xl font-semibold mb-4 text-gray-700 flex items-center">
+                    <svg class="w-6 h-6 mr-2 text-indigo-500" fill="none" stroke="currentColor" viewBox="0 0 24 24" xmlns="http://www.w3.org/2000/svg"><path stroke-linecap="round" stroke-linejoin="round" stroke-width="2" d="M17.657 16.657L13.414 20.9a1.998 1.998 0 01-2.828 0l-4.244-4.243a8 8 0 1111.314 0z"></path><path stroke-linecap="round" stroke-linejoin="round" stroke-width="2" d="M15 11a3 3 0 11-6 0 3 3 0 016 0z"></path></svg>
+                    Parking Spot Status
+                </h2>
+                <p class="text-gray-500 mb-4">Spot distance: <span id="distanceCm" class="font-mono text-sm bg-gray-100 px-2 py-1 rounded">-- cm</span></p>
+                <p class="text-gray-500 mb-4">Threshold: <span id="thresholdCm" class="font-mono text-sm bg-gray-100 px-2 py-1 rounded">-- cm</span></p>
+                <div class="flex items-center space-x-3">
+                    <span id="occupancyIndicator" class="w-4 h-4 rounded-full"></span>
+                    <p id="occupancyText" class="text-2xl font-bold">---</p>
+                </div>
+                <p id="sensorQualityText" class="text-sm font-medium text-yellow-600 mt-2"></p>
+            </div>
+
+            <!-- Gate Control Card -->
+            <div class="bg-white p-6 rounded-xl shadow-lg border-2 border-gray-100">
+                <h2 class="text-xl font-semibold mb-4 text-gray-700 flex items-center">
+                    <svg class="w-6 h-6 mr-2 text-green-500" fill="none" stroke="currentColor" viewBox="0 0 24 24" xmlns="http://www.w3.org/2000/svg"><path stroke-linecap="round" stroke-linejoin="round" stroke-width="2" d="M12 15v2m-6-6v6m-6-6v6m18-6v6m-6-6v6m-6-6v6m-6-6v6M3 9a9 9 0 0118 0v7a2 2 0 01-2 2H5a2 2 0 01-2-2V9z"></path></svg>
+                    Barrier Gate Control
+                </h2>
+                <p id="gateStatusText" class="text-lg font-medium mb-4">Status: <span class="font-bold text-gray-600">--</span></p>
+                <div class="flex space-x-3">
+                    <button onclick="sendCommand('open')" id="openBtn" class="bg-green-500 hover:bg-green-600 text-white font-bold py-2 px-4 rounded-lg shadow-md transition duration-150 active:scale-95">Open Gate</button>
+                    <button onclick="sendCommand('close')" id="closeBtn" class="bg-red-500 hover:bg-red-600 text-white font-bold py-2 px-4 rounded-lg shadow-md transition duration-150 active:scale-95">Close Gate</button>
+                </div>
+            </div>
+        </div>
+        
+        <!-- System Status Card -->
+        <div class="bg-white p-6 rounded-xl shadow-lg border-2 border-gray-100">
+            <h2 class="text-xl font-semibold mb-4 text-gray-700 flex items-center">
+                <svg class="w-6 h-6 mr-2 text-yellow-500" fill="none" stroke="currentColor" viewBox="0 0 24 24" xmlns="http://www.w3.org/2000/svg"><path stroke-linecap="round" stroke-linejoin="round" stroke-width="2" d="M13 10V3L4 14h7v7l9-11h-7z"></path></svg>
+                System Information
+            </h2>
+            <div class="grid grid-cols-2 gap-4">
+                <p><strong>IR Sensor:</strong> <span id="irStatusText" class="font-medium">---</span></p>
+                <p><strong>Gate Angle:</strong> <span id="gateAngleText" class="font-medium">--°</span></p>
+                <p><strong>Vehicles In / Out:</strong> <span id="laneCountText" class="font-medium">-- / --</span></p>
+                <p><strong>Lot Free Spaces:</strong> <span id="lotFreeText" class="font-medium">--</span></p>
+                <p><strong>Last Vehicle:</strong> <span id="lastVehicleText" class="font-medium">--</span></p>
+                <p><strong>Gate Hold:</strong> <span id="gateHoldText" class="font-medium">-- s</span></p>
+                <p><strong>Entry Lane:</strong> <span id="laneQueueText" class="font-medium">--</span></p>
+                <p><strong>Sensor → Publish:</strong> <span id="detectLatencyText" class="font-medium">--</span></p>
+                <p><strong>Publish → Screen:</strong> <span id="renderLatencyText" class="font-medium">--</span></p>
+            </div>
+        </div>
+
+        <!-- Lot Overview Card -->
+        <div class="bg-white p-6 rounded-xl shadow-lg border-2 border-gray-100 mt-8">
+            <h2 class="text-xl font-semibold mb-4 text-gray-700">Lot Overview</h2>
+            <p class="text-gray-500 mb-4">
+                <span id="slotSummaryText">-- free of --</span>
+                <span class="float-right font-mono text-xs" id="slotRenderText"></span>
+            </p>
+            <div id="slotGrid"><div id="slotGridSpacer"></div></div>
+        </div>
+
+        <!-- Distance Histogram Card -->
+        <div class="bg-white p-6 rounded-xl shadow-lg border-2 border-gray-100 mt-8">
+            <h2 class="text-xl font-semibold mb-4 text-gray-700">Distance Histogram</h2>
+            <p class="text-gray-500 mb-4">
+                Bay <input id="histBay" type="number" min="0" value="0" class="w-16 border rounded px-1">
+                <select id="histWindow" class="border rounded px-1 ml-2">
+                    <option value="hour">last hour</option>
+                    <option value="day">last day</option>
+                </select>
+                <span class="float-right font-mono text-xs" id="histSummaryText"></span>
+            </p>
+            <canvas id="histCanvas" class="w-full" height="160"></canvas>
+        </div>
+
+    </div>
+
+    <script>
+        const API_URL = '/status';
+        const PARKED_COLOR = 'bg-red-500';
+        const AVAILABLE_COLOR = 'bg-green-500';
+        
+        let shownChange = null; // seq of the last change shown, null before the first status
+
+        async function fetchStatus() {
+            try {
+                const sent = performance.now();
+                const response = await fetch(API_URL);
+                if (!response.ok) throw new Error('Network response was not ok');
+                const received = performance.now();
+                const data = await response.json();
+                updateDashboard(data);
+                trackLatency(data, response.headers.get('X-Change-Age-Ms'), sent, received);
+            } catch (error) {
+                console.error("Could not fetch status:", error);
+                document.getElementById('occupancyText').textContent = 'ERROR';
+            }
+        }
+
+        function updateDashboard(data) {
+            // 1. Parking Spot Status
+            const statusCard = document.getElementById('parkingStatusCard');
+            const indicator = document.getElementById('occupancyIndicator');
+            const text = document.getElementById('occupancyText');
+            const distanceText = document.getElementById('distanceCm');
+
+            distanceText.textContent = `${data.distance_cm.toFixed(2)} cm`;
+            const bay = data.bays[0];
+            document.getElementById('thresholdCm').textContent =
+                `${bay.threshold_cm.toFixed(1)} ± ${(bay.hysteresis_cm / 2).toFixed(1)} cm` + (bay.calibrating ? ' (learning)' : '');
+            
+            if (data.is_occupied) {
+                indicator.className = 'w-4 h-4 rounded-full ' + PARKED_COLOR;
+                text.textContent = 'OCCUPIED';
+                text.className = 'text-2xl font-bold text-red-600';
+                statusCard.classList.remove('border-green-300');
+                statusCard.classList.add('border-red-300');
+            } else {
+                indicator.className = 'w-4 h-4 rounded-full ' + AVAILABLE_COLOR;
+                text.textContent = 'AVAILABLE';
+                text.className = 'text-2xl font-bold text-green-600';
+                statusCard.classList.remove('border-red-300');
+                statusCard.classList.add('border-green-300');
+            }
+            document.getElementById('sensorQualityText').textContent = bay.sensor != 'failed' ? '' :
+                bay.source == 'counters' ? 'Sensor failed: state from the lane counters' : 'Sensor failed: last known state';
+
+            // 2. Gate Status
+            const gateText = document.getElementById('gateStatusText').querySelector('span');
+            const gateAngleText = document.getElementById('gateAngleText');
+
+            if (data.is_gate_open) {
+                gateText.textContent = 'OPEN';
+                gateText.className = 'font-bold text-green-500';
             } else {
                 gateText.textContent = 'CLOSED';
                 gateText.className = 'font-bold text-red-500';
             }
-            gateAngleText.textContent = `${data.current_angle}°`;
+            gateAngleText.textContent = `${data.current_angle}°`;
+
+            // 3. IR Sensor Status
+            const irText = document.getElementById('irStatusText');
+            if (data.ir_status == 0) {
+                irText.textContent = 'OBJECT DETECTED';
+                irText.className = 'font-bold text-yellow-600';
+            } else {
+                irText.textContent = 'CLEAR';
+                irText.className = 'font-medium text-gray-500';
+            }
+
+            // 4. Lane Counters
+            document.getElementById('laneCountText').textContent = `${data.vehicles_in} / ${data.vehicles_out}`;
+            document.getElementById('lotFreeText').textContent = `${data.lot_free} of ${data.lot_capacity}`;
+            document.getElementById('lastVehicleText').textContent = data.last_vehicle_class == 'unknown' ? '--' :
+                `${data.last_vehicle_class}, ${data.last_speed_kmh.toFixed(1)} km/h, ${data.last_length_m.toFixed(1)} m`;
+            document.getElementById('gateHoldText').textContent = `${(data.gate_hold_ms / 1000).toFixed(1)} s`;
+            const laneText = document.getElementById('laneQueueText');
+            laneText.textContent = data.lane_overloaded ? 'OVERLOADED' : 'OK';
+            laneText.className = data.lane_overloaded ? 'font-bold text-red-600' : 'font-medium text-gray-500';
+        }
+
+        // Times each new change from its publication on the board to the frame that shows it,
+        // and reports it to /latency. Changes older than the page are shown but not timed.
+        function trackLatency(data, ageHeader, sent, received) {
+            const change = data.last_change;
+            if (!change || change.seq === shownChange) return;
+            const first = shownChange === null;
+            shownChange = change.seq;
+            document.getElementById('detectLatencyText').textContent = `${change.latency_ms.toFixed(0)} ms`;
+            if (first || ageHeader === null) return;
+            requestAnimationFrame(() => {
+                // Age on the board when sent + half the round trip + time until this frame
+                const renderMs = Number(ageHeader) + (received - sent) / 2 + (performance.now() - received);
+                document.getElementById('renderLatencyText').textContent = `${renderMs.toFixed(0)} ms`;
+                fetch(`/latency?render_ms=${Math.round(renderMs)}`).catch(() => {});
+            });
+        }
+
+        async function sendCommand(command) {
+            console.log(`Sending command: ${command}`);
+            const openBtn = document.getElementById('openBtn');
+            const closeBtn = document.getElementById('closeBtn');
+
+            // Simple button disable/re-enable for feedback
+            openBtn.disabled = true;
+            closeBtn.disabled = true;
+
+            try {
+                // Using fetch for GET command to keep server simple, but POST is better practice
+                const response = await fetch(`/gate?action=${command}`);
+                if (!response.ok) throw new Error('Command failed on server');
+                // The status will be updated by the next scheduled fetchStatus()
+            } catch (error) {
+                console.error("Error sending command:", error);
+                alert('Failed to send command to ESP32!'); // Using custom modal in a real app
+            } finally {
+                openBtn.disabled = false;
+                closeBtn.disabled = false;
+                // Wait a moment before manually refreshing status to show change
+                setTimeout(fetchStatus, 600);
+            }
+        }
+
+        // ---- Lot overview grid ----
+        // Occupancy arrives as a packed bitmap (uint32 slot count, then one bit per slot, LSB first)
+        // and is decoded into a typed array. Only the cells in view exist in the DOM; each cell
+        // remembers what it shows, so an update only touches cells whose slot changed.
+        const BITMAP_URL = '/occupancy.bin';
+        const CELL_PITCH = 36; // Cell size plus gap, px
+        const DEMO_SLOTS = parseInt(new URLSearchParams(location.search).get('demo') || '0');
+        let slotState = new Uint8Array(0);
+        let cellPool = [];
+        let renderPending = false;
+
+        function decodeBitmap(buffer) {
+            const count = new DataView(buffer).getUint32(0, true);
+            const bits = new Uint8Array(buffer, 4);
+            const state = new Uint8Array(count);
+            for (let i = 0; i < count; i++) state[i] = (bits[i >> 3] >> (i & 7)) & 1;
+            return state;
+        }
+
+        // Random bitmap for trying large lots without hardware (/?demo=2000)
+        function demoBitmap(count) {
+            const buffer = new ArrayBuffer(4 + ((count + 7) >> 3));
+            new DataView(buffer).setUint32(0, count, true);
+            crypto.getRandomValues(new Uint8Array(buffer, 4));
+            return buffer;
+        }
+
+        async function fetchOccupancy() {
+            try {
+                let buffer;
+                if (DEMO_SLOTS > 0) {
+                    buffer = demoBitmap(DEMO_SLOTS);
+                } else {
+                    const response = await fetch(BITMAP_URL);
+                    if (!response.ok) throw new Error('Network response was not ok');
+                    buffer = await response.arrayBuffer();
+                }
+                slotState = decodeBitmap(buffer);
+                scheduleGridRender();
+            } catch (error) {
+                console.error("Could not fetch occupancy:", error);
+            }
+        }
+
+        function scheduleGridRender() {
+            if (!renderPending) {
+                renderPending = true;
+                requestAnimationFrame(renderGrid);
+            }
+        }
+
+        function renderGrid() {
+            renderPending = false;
+            const started = performance.now();
+            const grid = document.getElementById('slotGrid');
+            const count = slotState.length;
+            const cols = Math.max(1, Math.floor(grid.clientWidth / CELL_PITCH));
+            const rows = Math.ceil(count / cols);
+            document.getElementById('slotGridSpacer').style.height = `${rows * CELL_PITCH}px`;
+
+            // Grow the pool to cover the visible rows plus one partially visible row
+            const firstRow = Math.floor(grid.scrollTop / CELL_PITCH);
+            const visibleRows = Math.ceil(grid.clientHeight / CELL_PITCH) + 1;
+            const needed = visibleRows * cols;
+            while (cellPool.length < needed) {
+                const cell = document.createElement('div');
+                cell.slot = -1;
+                cell.state = -1;
+                cell.cols = 0;
+                grid.appendChild(cell);
+                cellPool.push(cell);
+            }
+
+            const first = firstRow * cols;
+            for (let k = 0; k < cellPool.length; k++) {
+                const cell = cellPool[k];
+                const slot = first + k;
+                if (k >= needed || slot >= count) {
+                    if (cell.slot !== -1) { cell.style.display = 'none'; cell.slot = -1; cell.state = -1; }
+                    continue;
+                }
+                if (cell.slot !== slot || cell.cols !== cols) {
+                    // A resize changes the columns, and with them where the same slot goes
+                    if (cell.slot === -1) cell.style.display = '';
+                    if (cell.slot !== slot) cell.textContent = slot + 1;
+                    cell.slot = slot;
+                    cell.cols = cols;
+                    cell.style.transform = `translate(${(slot % cols) * CELL_PITCH}px, ${Math.floor(slot / cols) * CELL_PITCH}px)`;
+                }
+                const state = slotState[slot];
+                if (cell.state !== state) {
+                    cell.state = state;
+                    cell.className = 'slot-cell ' + (state ? 'slot-occupied' : 'slot-free');
+                }
+            }
+
+            let occupied = 0;
+            for (let i = 0; i < count; i++) occupied += slotState[i];
+            document.getElementById('slotSummaryText').textContent = `${count - occupied} free of ${count}`;
+            document.getElementById('slotRenderText').textContent = `render ${(performance.now() - started).toFixed(1)} ms`;
+        }
+
+        // ---- Distance histogram ----
+        // Raw readings of one bay per distance bin; the last bin counts timeouts and
+        // out-of-range readings. A red line marks the bay's current threshold.
+        async function fetchHistogram() {
+            const bay = document.getElementById('histBay').value;
+            const win = document.getElementById('histWindow').value;
+            try {
+                const response = await fetch(`/histogram?window=${win}&bay=${bay}`);
+                if (!response.ok) throw new Error('Network response was not ok');
+                const data = await response.json();
+                requestAnimationFrame(() => drawHistogram(data));
+            } catch (error) {
+                console.error("Could not fetch histogram:", error);
+            }
+        }
+
+        function drawHistogram(data) {
+            const canvas = document.getElementById('histCanvas');
+            canvas.width = canvas.clientWidth;
+            const ctx = canvas.getContext('2d');
+            const h = data.bays[0];
+            const bins = h.counts.length;
+            const barWidth = canvas.width / bins;
+            const top = Math.max(1, ...h.counts);
+            const plotHeight = canvas.height - 14;
+            ctx.clearRect(0, 0, canvas.width, canvas.height);
+            for (let b = 0; b < bins; b++) {
+                const barHeight = h.counts[b] / top * plotHeight;
+                ctx.fillStyle = b == bins - 1 ? '#9ca3af' : '#6366f1';
+                ctx.fillRect(b * barWidth, plotHeight - barHeight, Math.max(1, barWidth - 1), barHeight);
+            }
+            const thresholdX = h.threshold_cm / data.bin_cm * barWidth;
+            ctx.fillStyle = '#ef4444';
+            ctx.fillRect(thresholdX, 0, 2, plotHeight);
+            ctx.fillStyle = '#6b7280';
+            ctx.font = '10px monospace';
+            for (let cm = 0; cm < (bins - 1) * data.bin_cm; cm += 50) {
+                ctx.fillText(cm, cm / data.bin_cm * barWidth, canvas.height - 2);
+            }
+            ctx.fillText('none', (bins - 1) * barWidth - 20, canvas.height - 2);
+            document.getElementById('histSummaryText').textContent = `${h.samples} readings, ${data.bin_cm} cm bins`;
+        }
+
+        // Start fetching status updates every 1 second
+        document.addEventListener('DOMContentLoaded', () => {
+            fetchStatus();
+            fetchOccupancy();
+            setInterval(fetchStatus, 1000);
+            setInterval(fetchOccupancy, 1000);
+            fetchHistogram();
+            setInterval(fetchHistogram, 10000);
+            document.getElementById('histBay').addEventListener('change', fetchHistogram);
+            document.getElementById('histWindow').addEventListener('change', fetchHistogram);
+            document.getElementById('slotGrid').addEventListener('scroll', scheduleGridRender, { passive: true });
+            window.addEventListener('resize', scheduleGridRender);
+        });
+    </script>
+</body>
+</html>
+)rawliteral";
+
+  server.send_P(200, "text/html", htmlContent, strlen(htmlContent));
+}
+
+// Any other path: a file from the asset partition, if it has one by that name
+void handleNotFound() {
+  String uri = server.uri();
+  if (uri.length() > 1 && sendAsset(uri.c_str() + 1)) {
+    return;
+  }
+  server.send(404, "text/plain", "Not found.");
+}
+
+// Lists the asset partition's records as JSON
+void handleAssets() {
+  if (assets == nullptr) {
+    server.send(200, "application/json", "{\"mapped\":false}");
+    return;
+  }
+  String json = "{\"mapped\":true,\"generation\":" + String((unsigned long)assets->generation);
+  json += ",\"bytes\":" + String((unsigned long)assets->totalBytes);
+  json += ",\"partition_bytes\":" + String((unsigned long)assetsPartition->size);
+  json += ",\"records\":[";
+  for (int i = 0; i < assets->count; i++) {
+    const AssetEntry& e = assetIndex(assets)[i];
+    if (i > 0) json += ",";
+    json += "{\"name\":\"" + String(e.name) + "\",\"bytes\":" + String((unsigned long)e.length);
+    json += ",\"type\":\"" + String(e.type == ASSET_CONFIG ? "config" : ASSET_MIME_TYPES[e.mime]) + "\"";
+    json += ",\"gzip\":" + String(e.flags & ASSET_GZIP ? "true" : "false") + "}";
+  }
+  json += "]}";
+  server.send(200, "application/json", json);
+}
+
+// A serialised response together with the state version it was built from
+struct CachedResponse {
+  uint32_t version;
+  String body;
+};
+
+CachedResponse statusCache = { 0, "" };
+SemaphoreHandle_t statusCacheLock; // Guards statusCache.body against readers in the HTTPS task
+int64_t statusChangePublishUs = 0; // lastChange.publishUs as of statusCache, also under the lock
+
+String buildStatusJson() {
+  String json = "{";
+  json += "\"is_occupied\":" + String(bays[0].occupied ? "true" : "false") + ",";
+  json += "\"distance_cm\":" + String(bays[0].distanceCm, 2) + ",";
+  json += "\"bays\":[";
+  for (int i = 0; i < BAY_COUNT; i++) {
+    const Bay& bay = bays[i];
+    if (i > 0) json += ",";
+    json += "{\"occupied\":" + String(bay.occupied ? "true" : "false");
+    json += ",\"distance_cm\":" + String(bay.distanceCm, 2);
+    json += ",\"raw_distance_cm\":" + String(bay.rawCm, 2);
+    json += ",\"threshold_cm\":" + String(bay.thresholdCm, 1);
+    json += ",\"hysteresis_cm\":" + String(bay.hysteresisCm, 1);
+    json += ",\"baseline_cm\":" + String(bay.baselineCm, 1);
+    json += ",\"occupied_cm\":" + String(bay.occupiedCm, 1);
+    json += ",\"calibrating\":" + String(bay.calibrating ? "true" : "false");
+    json += ",\"calibration_samples\":" + String(bay.calSamples);
+    json += ",\"sensor\":\"" + String(bay.sensorFailed ? "failed" : "ok") + "\"";
+    json += ",\"source\":\"" + String(OCCUPANCY_SOURCE_NAMES[bay.source]) + "\"}";
+  }
+  json += "],";
+  json += "\"data_quality\":\"" + String(failedSensors > 0 ? "degraded" : "ok") + "\",";
+  json += "\"failed_sensors\":" + String(failedSensors) + ",";
+  json += "\"ir_status\":" + String(passage.blocked[0] ? 0 : 1) + ","; // 0 means detected, 1 means clear
+  json += "\"is_gate_open\":" + String(isGateOpen ? "true" : "false") + ",";
+  json += "\"current_angle\":" + String(gateServo.read()) + ",";
+  json += "\"vehicles_in\":" + String(vehiclesIn) + ",";
+  json += "\"vehicles_out\":" + String(vehiclesOut) + ",";
+  json += "\"rejected_passages\":" + String(rejectedPassages) + ",";
+  json += "\"lot_free\":" + String(lotFreeSpaces()) + ",";
+  json += "\"lot_capacity\":" + String(config.lotCapacity) + ",";
+  json += "\"last_speed_kmh\":" + String(lastSpeedKmh, 1) + ",";
+  json += "\"last_length_m\":" + String(lastLengthM, 2) + ",";
+  json += "\"last_vehicle_class\":\"" + String(VEHICLE_CLASS_NAMES[lastVehicleClass]) + "\",";
+  json += "\"gate_hold_ms\":" + String(gateHoldMs) + ",";
+  json += "\"lane_overloaded\":" + String(laneQueue.overloaded ? "true" : "false") + ",";
+  json += "\"role\":\"" + String(replicationRoleName()) + "\",";
+  if (lastChange.publishUs != 0) {
+    json += "\"last_change\":{\"seq\":" + String(lastChange.seq);
+    json += ",\"type\":\"" + String(PARKING_EVENT_NAMES[lastChange.type]) + "\"";
+    json += ",\"bay\":" + String(lastChange.bay);
+    json += ",\"edge_us\":" + String((long long)lastChange.edgeUs);
+    json += ",\"publish_us\":" + String((long long)lastChange.publishUs);
+    json += ",\"latency_ms\":" + String((lastChange.publishUs - lastChange.edgeUs) / 1000.0, 1) + "},";
+  }
+  json += "\"state_version\":" + String(stateVersion);
+  json += "}";
+  return json;
+}
+
+// Rebuilds the status JSON if the state has changed since it was last built. Called from
+// loop() so that the HTTPS task, which cannot touch the state itself, always finds it fresh.
+void refreshStatusCache() {
+  if (statusCache.version == stateVersion) {
+    return;
+  }
+  // Changes reported for the first time are published now
+  int64_t now = monoUs();
+  for (int i = 0; i < unpublishedCount; i++) {
+    recordLatency(publishLatency, now - unpublishedEdges[i]);
+  }
+  if (unpublishedCount > 0) {
+    lastChange.publishUs = now;
+    unpublishedCount = 0;
+  }
+  String fresh = buildStatusJson();
+  xSemaphoreTake(statusCacheLock, portMAX_DELAY);
+  statusCache.body = fresh;
+  statusCache.version = stateVersion;
+  statusChangePublishUs = lastChange.publishUs;
+  xSemaphoreGive(statusCacheLock);
+}
+
+// Serves the real-time status as JSON. Sensing happens in loop(); this only serialises
+// the latest state, and only once per state version however many clients poll.
+// X-Change-Age-Ms tells the dashboard how long ago last_change was published, for its
+// publish-to-render measurement without relying on the two clocks agreeing.
+void handleStatus() {
+  refreshStatusCache();
+  if (statusChangePublishUs != 0) {
+    server.sendHeader("X-Change-Age-Ms", String((long)((monoUs() - statusChangePublishUs) / MONO_MS)));
+  }
+  server.send(200, "application/json", statusCache.body);
+}
+
+// Records a publish-to-render time measured by the dashboard (/latency?render_ms=N)
+void handleLatency() {
+  long ms = server.hasArg("render_ms") ? server.arg("render_ms").toInt() : -1;
+  if (ms < 0 || ms > 600000) {
+    server.send(400, "text/plain", "Use /latency?render_ms=N");
+    return;
+  }
+  recordLatency(renderLatency, ms * 1000LL);
+  server.send(204, "text/plain", "");
+}
+
+// Serves bay occupancy as a packed bitmap: uint32 bay count (little-endian), then one bit
+// per bay, least significant bit first. Used by the dashboard's lot overview grid.
+void handleOccupancyBitmap() {
+  static uint8_t payload[4 + (BAY_COUNT + 7) / 8];
+  static uint32_t payloadVersion = 0;
+  if (payloadVersion != bitmapVersion) {
+    putLe32(payload, BAY_COUNT);
+    memcpy(payload + 4, occupiedBays.words, sizeof(payload) - 4); // ESP32 is little-endian
+    payloadVersion = bitmapVersion;
+  }
+  server.send_P(200, "application/octet-stream", (const char*)payload, sizeof(payload));
+}
+
+// Serves the occupied, reserved and faulty bitmaps in the compressed wire format of
+// slot_bitmap.h. With ?zone=N a query bitmap of bays in that zone that are free, not
+// reserved and not faulty is added (e.g., /state.bin?zone=3).
+void handleStateBitmaps() {
+  // The three state bitmaps are cached per bitmap version; a zone query is appended to a copy
+  static uint8_t cached[slotBitmapMaxBytes(BAY_COUNT, 3)];
+  static size_t cachedLen = 0;
+  static uint32_t cachedVersion = 0;
+  if (cachedVersion != bitmapVersion) {
+    SlotBitmapWriter writer;
+    slotBitmapBegin(writer, cached, sizeof(cached), BAY_COUNT);
+    slotBitmapAdd(writer, BITMAP_OCCUPIED, occupiedBays);
+    slotBitmapAdd(writer, BITMAP_RESERVED, reservedBays);
+    slotBitmapAdd(writer, BITMAP_FAULTY, faultyBays);
+    cachedLen = writer.len;
+    cachedVersion = bitmapVersion;
+  }
+  if (!server.hasArg("zone")) {
+    server.send_P(200, "application/octet-stream", (const char*)cached, cachedLen);
+    return;
+  }
+
+  int zone = server.arg("zone").toInt();
+  if (zone < 0 || zone >= ZONE_COUNT) {
+    server.send(400, "text/plain", "Invalid zone.");
+    return;
+  }
+  static uint8_t message[slotBitmapMaxBytes(BAY_COUNT, 4)];
+  memcpy(message, cached, cachedLen);
+  SlotBitmapWriter writer = { message, sizeof(message), cachedLen, BAY_COUNT, true };
+  BayBitmap available = zoneBays[zone];
+  available &= freeBays;
+  slotBitmapAdd(writer, BITMAP_QUERY, available);
+  server.send_P(200, "application/octet-stream", (const char*)message, writer.len);
+}
+
+// Lists bays matching all given filters, e.g. free EV bays on level 2:
+//   /slots?zone=2&state=free&ev=1
+// state is free, occupied, reserved, faulty or any (default); ev, accessible and compact
+// take 1 to require the attribute and 0 to exclude it. Matching is a handful of word-wise
+// ANDs over the bitmap indexes; at most `limit` (default 100) bay numbers are listed.
+void handleSlots() {
+  BayBitmap match;
+  match.clear();
+  match.fill(0, BAY_COUNT);
+
+  if (server.hasArg("zone")) {
+    int zone = server.arg("zone").toInt();
+    if (zone < 0 || zone >= ZONE_COUNT) {
+      server.send(400, "text/plain", "Invalid zone.");
+      return;
+    }
+    match &= zoneBays[zone];
+  }
+
+  String state = server.hasArg("state") ? server.arg("state") : "any";
+  if (state == "free") {
+    match &= freeBays;
+  } else if (state == "occupied") {
+    match &= occupiedBays;
+  } else if (state == "reserved") {
+    match &= reservedBays;
+  } else if (state == "faulty") {
+    match &= faultyBays;
+  } else if (state != "any") {
+    server.send(400, "text/plain", "Invalid state. Use free, occupied, reserved, faulty or any.");
+    return;
+  }
+
+  for (int a = 0; a < BAY_ATTRIBUTE_COUNT; a++) {
+    if (!server.hasArg(BAY_ATTRIBUTE_NAMES[a])) {
+      continue;
+    }
+    if (server.arg(BAY_ATTRIBUTE_NAMES[a]) == "0") {
+      match.andNot(attributeBays[a]);
+    } else {
+      match &= attributeBays[a];
+    }
+  }
+
+  int limit = server.hasArg("limit") ? server.arg("limit").toInt() : 100;
+  int count = match.count();
+  String json = "{\"count\":" + String(count) + ",\"slots\":[";
+  int listed = 0;
+  for (int i = match.next(0, true, BAY_COUNT); i < BAY_COUNT && listed < limit; i = match.next(i + 1, true, BAY_COUNT)) {
+    if (listed++ > 0) json += ",";
+    json += String(i);
+  }
+  json += "],\"truncated\":" + String(listed < count ? "true" : "false") + "}";
+  server.send(200, "application/json", json);
+}
+
+// Marks a bay as reserved or releases it (e.g., /reserve?bay=0&state=on)
+void handleReserve() {
+  int i = server.hasArg("bay") ? server.arg("bay").toInt() : -1;
+  if (i < 0 || i >= BAY_COUNT || !server.hasArg("state")) {
+    server.send(400, "text/plain", "Use /reserve?bay=N&state=on or /reserve?bay=N&state=off");
+    return;
+  }
+  bool reserved = server.arg("state") == "on";
+  setBayBit(reservedBays, i, reserved);
+  updateFreeBay(i);
+  markStateChanged();
+  server.send(200, "text/plain", reserved ? "Bay reserved." : "Bay released.");
+}
+
+// Lists the open parking sessions as JSON. Durations are live, so this is not cached.
+void handleSessions() {
+  int64_t now = monoUs();
+  String json = "{\"active\":[";
+  bool first = true;
+  for (int i = 0; i < BAY_COUNT; i++) {
+    if (baySession[i] < 0) {
+      continue;
+    }
+    const ParkingSession& session = sessionPool[baySession[i]];
+    if (!first) json += ",";
+    first = false;
+    json += "{\"id\":" + String(session.id);
+    json += ",\"bay\":" + String(i);
+    json += ",\"start\":" + String(session.startTime);
+    json += ",\"duration_s\":" + String((unsigned long)((now - session.startUs) / MONO_S));
+    json += ",\"tag\":\"" + String(session.tag) + "\"}";
+  }
+  json += "],\"opened\":" + String(sessionsOpened);
+  json += ",\"closed\":" + String(sessionsClosed);
+  json += ",\"next_log_record\":" + String(eventLogNextSeq) + "}";
+  server.send(200, "application/json", json);
+}
+
+// Tags a bay's open session, e.g. with an RFID card or plate read at the bay (/sessions/tag?bay=0&tag=ABC123)
+void handleSessionTag() {
+  int i = server.hasArg("bay") ? server.arg("bay").toInt() : -1;
+  if (i < 0 || i >= BAY_COUNT || !server.hasArg("tag")) {
+    server.send(400, "text/plain", "Use /sessions/tag?bay=N&tag=ID");
+    return;
+  }
+  if (!setSessionTag(i, server.arg("tag"))) {
+    server.send(409, "text/plain", "No open session on that bay, or the tag is not 1-15 letters, digits, '-' or '_'.");
+    return;
+  }
+  server.send(200, "text/plain", "Session tagged.");
+}
+
+// Appends a window's bin counts as a JSON array
+template <typename Histogram>
+void addHistogramCounts(String& json, const Histogram& h) {
+  json += "[";
+  for (int b = 0; b < HIST_BINS; b++) {
+    if (b > 0) json += ",";
+    json += String((unsigned long)h.total[b]);
+  }
+  json += "]";
+}
+
+// Raw distance histograms over the last hour or day (/histogram?window=day&bay=0; all bays without bay=)
+void handleHistogram() {
+  String window = server.hasArg("window") ? server.arg("window") : "hour";
+  int first = server.hasArg("bay") ? server.arg("bay").toInt() : 0;
+  int last = server.hasArg("bay") ? first : BAY_COUNT - 1;
+  if ((window != "hour" && window != "day") || first < 0 || last >= BAY_COUNT) {
+    server.send(400, "text/plain", "Use /histogram?window=hour|day&bay=N");
+    return;
+  }
+  bool day = window == "day";
+  int64_t now = monoUs();
+  String json = "{\"window\":\"" + window + "\"";
+  json += ",\"span_s\":" + String(day ? 86400 : 3600);
+  json += ",\"step_s\":" + String(day ? 86400 / HIST_DAY_SLICES : 3600 / HIST_HOUR_SLICES);
+  json += ",\"bin_cm\":" + String(HIST_BIN_CM) + ",\"bays\":[";
+  for (int i = first; i <= last; i++) {
+    // Drop slices that have aged out even if the bay has not been read since
+    histAdvance(hourHistograms[i], now);
+    histAdvance(dayHistograms[i], now);
+    if (i > first) json += ",";
+    json += "{\"bay\":" + String(i);
+    json += ",\"threshold_cm\":" + String(bays[i].thresholdCm, 1);
+    json += ",\"samples\":" + String((unsigned long)(day ? histCount(dayHistograms[i]) : histCount(hourHistograms[i])));
+    json += ",\"counts\":";
+    if (day) {
+      addHistogramCounts(json, dayHistograms[i]);
+    } else {
+      addHistogramCounts(json, hourHistograms[i]);
+    }
+    json += "}";
+  }
+  json += "]}";
+  server.send(200, "application/json", json);
+}
+
+// Starts, stops or resets learning of a bay's thresholds (e.g., /calibrate?bay=0&action=start)
+void handleCalibrate() {
+  int i = server.hasArg("bay") ? server.arg("bay").toInt() : 0;
+  if (i < 0 || i >= BAY_COUNT) {
+    server.send(400, "text/plain", "Invalid bay.");
+    return;
+  }
+  String action = server.hasArg("action") ? server.arg("action") : "start";
+  markStateChanged();
+  if (action == "start") {
+    startCalibration(i);
+    server.send(200, "text/plain", "Calibration started.");
+  } else if (action == "stop") {
+    bays[i].calibrating = false;
+    server.send(200, "text/plain", "Calibration stopped.");
+  } else if (action == "reset") {
+    bays[i].thresholdCm = config.thresholdCm;
+    bays[i].hysteresisCm = config.hysteresisCm;
+    bays[i].baselineCm = 0;
+    bays[i].occupiedCm = 0;
+    saveBayCalibration(i);
+    startCalibration(i);
+    server.send(200, "text/plain", "Calibration reset to defaults and restarted.");
+  } else {
+    server.send(400, "text/plain", "Invalid action. Use start, stop or reset.");
+  }
+}
+
+// Carries a config change over to the state derived from it
+void configChanged(const RuntimeConfig& previous) {
+  // Bays still on the defaults follow them; calibrated bays keep their learned values
+  for (int i = 0; i < BAY_COUNT; i++) {
+    if (bays[i].baselineCm == 0) {
+      bays[i].thresholdCm = config.thresholdCm;
+      bays[i].hysteresisCm = config.hysteresisCm;
+    }
+  }
+  gateHoldMs = holdTimeMs(avgSpeedMps, avgLengthM); // The hold limits may have changed
+  // Move the arm straight to the new angle for its current position
+  if (config.servoOpenAngle != previous.servoOpenAngle || config.servoClosedAngle != previous.servoClosedAngle) {
+    gateServo.write(isGateOpen ? config.servoOpenAngle : config.servoClosedAngle);
+  }
+  markStateChanged();
+}
+
+// Reads or updates the runtime configuration. Without arguments returns it as JSON;
+// with arguments (e.g., /config?threshold_cm=30&sensor_interval_ms=250) all of them are
+// validated together and either applied at once or rejected with nothing changed.
+void handleConfig() {
+  if (server.args() == 0) {
+    server.send(200, "application/json", configJson());
+    return;
+  }
+
+  RuntimeConfig candidate = config;
+  for (int a = 0; a < server.args(); a++) {
+    String name = server.argName(a);
+    if (name == "plain") continue; // Raw request body, not a setting
+    const ConfigField* field = findConfigField(name);
+    if (field == nullptr) {
+      server.send(400, "text/plain", "Unknown setting: " + name);
+      return;
+    }
+    // The whole argument must be a number: toFloat() would read "abc" or "" as 0
+    String text = server.arg(a);
+    char* end;
+    float value = strtof(text.c_str(), &end);
+    if (text.length() == 0 || *end != '\0') {
+      server.send(400, "text/plain", "Invalid value for " + name);
+      return;
+    }
+    setConfigValue(candidate, *field, value);
+  }
+  const char* problem = validateConfig(candidate);
+  if (problem != nullptr) {
+    server.send(400, "text/plain", "Invalid setting: " + String(problem));
+    return;
+  }
+
+  RuntimeConfig previous = config;
+  config = candidate;
+  saveConfig();
+  configChanged(previous);
+  Serial.println("Config: updated " + configJson());
+  server.send(200, "application/json", configJson());
+}
+
+// Handles gate commands (e.g., /gate?action=open or /gate?action=close)
+void handleGateControl() {
+  if (!isActiveController()) {
+    server.send(503, "text/plain", "Standby controller; use the primary.");
+    return;
+  }
+  if (server.hasArg("action")) {
+    String action = server.arg("action");
+    if (action == "open") {
+      pendingGateCommand = GATE_COMMAND_OPEN;
+      server.send(200, "text/plain", "Gate opened.");
+      return;
+    } else if (action == "close") {
+      pendingGateCommand = GATE_COMMAND_CLOSE;
+      server.send(200, "text/plain", "Gate closed.");
+      return;
+    }
+  }
+  server.send(400, "text/plain", "Invalid action. Use /gate?action=open or /gate?action=close");
+}
+
+// ------------------------------------
+// 11. HTTPS SERVER
+// ------------------------------------
+// Serves /status and /gate over TLS on port 443 from its own httpd task, next to the
+// plain server on port 80. Connections are kept alive, and session tickets let clients
+// that reconnect resume their TLS session instead of repeating the full handshake.
+// mbedTLS uses the ESP32's AES, SHA and bignum accelerators with the default sdkconfig.
+
+// Handshake counters, written by the HTTPS task and read by /metrics
+struct TlsMetrics {
+  unsigned long fullHandshakes;
+  unsigned long resumedHandshakes;
+  unsigned long untimedHandshakes;     // Completed without a ClientHello timestamp
+  uint64_t fullHandshakeUsTotal;
+  uint64_t resumedHandshakeUsTotal;
+  unsigned long fullHandshakeUsMax;
+  unsigned long resumedHandshakeUsMax;
+  unsigned long requests;
+};
+
+TlsMetrics tlsMetrics = {};
+portMUX_TYPE tlsMetricsMux = portMUX_INITIALIZER_UNLOCKED;
+
+#ifndef MBEDTLS_PRIVATE
+#define MBEDTLS_PRIVATE(member) member // mbedTLS 2.x has no private field markers
+#endif
+
+// When each in-progress handshake received its ClientHello, and whether it resumes a
+// session, keyed by TLS context. Handshakes run one at a time in the HTTPS task, so a
+// few entries are plenty.
+struct PendingHandshake {
+  const mbedtls_ssl_context* ssl;
+  int64_t helloUs;
+  bool resumed;
+};
+
+const int MAX_PENDING_HANDSHAKES = 4;
+PendingHandshake pendingHandshakes[MAX_PENDING_HANDSHAKES];
+
+#ifdef CONFIG_ESP_TLS_SERVER_SESSION_TICKETS
+// ESP-TLS's session ticket parser, wrapped so that a ticket that really resumed a session
+// can be told from one that was rejected. It runs while the ClientHello is parsed, just
+// before onClientHello(); on success mbedTLS copies the session it restored into the
+// session being negotiated, which a full handshake leaves unstarted until later.
+mbedtls_ssl_ticket_parse_t* tlsTicketParse = nullptr;
+bool ticketResumed = false;
+time_t ticketSessionStart = 0;  // Start time of the session the last good ticket restored
+
+int onTicketParse(void* ticketContext, mbedtls_ssl_session* session, unsigned char* buf, size_t len) {
+  int ret = tlsTicketParse(ticketContext, session, buf, len);
+  if (ret == 0) {
+    ticketResumed = true;
+    ticketSessionStart = session->MBEDTLS_PRIVATE(start);
+  }
+  return ret;
+}
+
+// Whether `ssl`'s ClientHello carried a ticket that resumed its session. The wrapper is
+// put in place at the first ClientHello; tickets from before a boot never resume anyway,
+// as the ticket key is made afresh at every start.
+bool resumedByTicket(mbedtls_ssl_context* ssl) {
+  mbedtls_ssl_config* conf = (mbedtls_ssl_config*)ssl->MBEDTLS_PRIVATE(conf);
+  if (tlsTicketParse == nullptr && conf->MBEDTLS_PRIVATE(f_ticket_parse) != nullptr) {
+    tlsTicketParse = conf->MBEDTLS_PRIVATE(f_ticket_parse);
+    mbedtls_ssl_conf_session_tickets_cb(conf, conf->MBEDTLS_PRIVATE(f_ticket_write), onTicketParse,
+                                        conf->MBEDTLS_PRIVATE(p_ticket));
+  }
+  // Matching the restored session guards against a ticket whose handshake failed after it
+  // was parsed, which would otherwise be credited to the next one
+  const mbedtls_ssl_session* session = ssl->MBEDTLS_PRIVATE(session_negotiate);
+  bool resumed = ticketResumed && session->MBEDTLS_PRIVATE(start) == ticketSessionStart;
+  ticketResumed = false;
+  return resumed;
+}
+#else
+bool resumedByTicket(mbedtls_ssl_context* ssl) {
+  return false; // No tickets, so no resumption: ESP-TLS keeps no session ID cache
+}
+#endif
+
+// Certificate selection hook: runs when the ClientHello has been parsed, which marks the
+// start of the server's handshake work. Keeps the configured certificate.
+int onClientHello(mbedtls_ssl_context* ssl) {
+  int slot = 0;
+  for (int i = 0; i < MAX_PENDING_HANDSHAKES; i++) {
+    if (pendingHandshakes[i].ssl == ssl || pendingHandshakes[i].ssl == nullptr) {
+      slot = i;
+      break;
+    }
+    if (pendingHandshakes[i].helloUs < pendingHandshakes[slot].helloUs) {
+      slot = i; // Reuse the oldest entry, left behind by a handshake that failed
+    }
+  }
+  pendingHandshakes[slot] = { ssl, monoUs(), resumedByTicket(ssl) };
+  return 0;
+}
+
+// Called by the HTTPS server once a TLS session has been established
+void onTlsSession(esp_https_server_user_cb_arg_t* arg) {
+  if (arg->user_cb_state != HTTPD_SSL_USER_CB_SESS_CREATE) {
+    return;
+  }
+  int64_t now = monoUs();
+  const mbedtls_ssl_context* ssl = (const mbedtls_ssl_context*)esp_tls_get_ssl_context((esp_tls_t*)arg->tls);
+  PendingHandshake* pending = nullptr;
+  for (int i = 0; i < MAX_PENDING_HANDSHAKES; i++) {
+    if (pendingHandshakes[i].ssl == ssl) {
+      pending = &pendingHandshakes[i];
+    }
+  }
+
+  bool resumed = pending != nullptr && pending->resumed;
+  unsigned long elapsedUs = pending != nullptr ? (unsigned long)(now - pending->helloUs) : 0;
+  if (pending != nullptr) {
+    pending->ssl = nullptr;
+  }
+
+  portENTER_CRITICAL(&tlsMetricsMux);
+  if (pending == nullptr) {
+    tlsMetrics.untimedHandshakes++;
+  } else if (resumed) {
+    tlsMetrics.resumedHandshakes++;
+    tlsMetrics.resumedHandshakeUsTotal += elapsedUs;
+    tlsMetrics.resumedHandshakeUsMax = max(tlsMetrics.resumedHandshakeUsMax, elapsedUs);
+  } else {
+    tlsMetrics.fullHandshakes++;
+    tlsMetrics.fullHandshakeUsTotal += elapsedUs;
+    tlsMetrics.fullHandshakeUsMax = max(tlsMetrics.fullHandshakeUsMax, elapsedUs);
+  }
+  portEXIT_CRITICAL(&tlsMetricsMux);
+}
+
+void countTlsRequest() {
+  portENTER_CRITICAL(&tlsMetricsMux);
+  tlsMetrics.requests++;
+  portEXIT_CRITICAL(&tlsMetricsMux);
+}
+
+// HTTPS /status: copies out the JSON that loop() keeps up to date
+esp_err_t handleHttpsStatus(httpd_req_t* req) {
+  countTlsRequest();
+  xSemaphoreTake(statusCacheLock, portMAX_DELAY);
+  String body = statusCache.body;
+  int64_t publishUs = statusChangePublishUs;
+  xSemaphoreGive(statusCacheLock);
+  httpd_resp_set_type(req, "application/json");
+  char age[24];
+  if (publishUs != 0) {
+    snprintf(age, sizeof(age), "%ld", (long)((monoUs() - publishUs) / MONO_MS));
+    httpd_resp_set_hdr(req, "X-Change-Age-Ms", age);
+  }
+  return httpd_resp_send(req, body.c_str(), body.length());
+}
+
+// HTTPS /gate?action=open|close: hands the command to gateSequence()
+esp_err_t handleHttpsGate(httpd_req_t* req) {
+  countTlsRequest();
+  char query[32];
+  char action[8];
+  httpd_resp_set_type(req, "text/plain");
+  if (!isActiveController()) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    return httpd_resp_send(req, "Standby controller; use the primary.", HTTPD_RESP_USE_STRLEN);
+  }
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+      httpd_query_key_value(query, "action", action, sizeof(action)) == ESP_OK) {
+    if (strcmp(action, "open") == 0) {
+      pendingGateCommand = GATE_COMMAND_OPEN;
+      return httpd_resp_send(req, "Gate opened.", HTTPD_RESP_USE_STRLEN);
+    } else if (strcmp(action, "close") == 0) {
+      pendingGateCommand = GATE_COMMAND_CLOSE;
+      return httpd_resp_send(req, "Gate closed.", HTTPD_RESP_USE_STRLEN);
+    }
+  }
+  httpd_resp_set_status(req, "400 Bad Request");
+  return httpd_resp_send(req, "Invalid action. Use /gate?action=open or /gate?action=close", HTTPD_RESP_USE_STRLEN);
+}
+
+void startHttpsServer() {
+#if HTTPS_ENABLED
+  httpd_ssl_config_t conf = HTTPD_SSL_CONFIG_DEFAULT();
+  conf.servercert = (const uint8_t*)TLS_SERVER_CERT;
+  conf.servercert_len = sizeof(TLS_SERVER_CERT); // PEM lengths include the terminating NUL
+  conf.prvtkey_pem = (const uint8_t*)TLS_SERVER_KEY;
+  conf.prvtkey_len = sizeof(TLS_SERVER_KEY);
+  conf.httpd.max_open_sockets = 4;
+  conf.httpd.lru_purge_enable = true; // Drop the longest-idle keep-alive connection when full
+  conf.user_cb = onTlsSession;
+#ifdef CONFIG_ESP_TLS_SERVER_SESSION_TICKETS
+  conf.session_tickets = true;
+#else
+  Serial.println("HTTPS: session tickets not enabled in sdkconfig, every connection does a full handshake");
+#endif
+#ifdef CONFIG_ESP_HTTPS_SERVER_CERT_SELECT_HOOK
+  conf.cert_select_cb = onClientHello;
+#else
+  Serial.println("HTTPS: certificate selection hook not enabled in sdkconfig, handshake latency is not measured");
+#endif
+
+  httpd_handle_t https = nullptr;
+  esp_err_t err = httpd_ssl_start(&https, &conf);
+  if (err != ESP_OK) {
+    Serial.printf("HTTPS: failed to start (%s)\n", esp_err_to_name(err));
+    return;
+  }
+  httpd_uri_t statusUri = { "/status", HTTP_GET, handleHttpsStatus, nullptr };
+  httpd_uri_t gateUri = { "/gate", HTTP_GET, handleHttpsGate, nullptr };
+  httpd_register_uri_handler(https, &statusUri);
+  httpd_register_uri_handler(https, &gateUri);
+  Serial.println("HTTPS Server started on port 443");
+#else
+  Serial.println("HTTPS: disabled, run tools/make_tls_cert.sh to generate tls_cert.h");
+#endif
+}
+
+// ------------------------------------
+// 12. HOT STANDBY
+// ------------------------------------
+// With PEER_IP set, two boards share the servo signal and the IR beams. The primary
+// streams its state to the standby (see replication.h); the standby keeps its servo
+// output detached and takes over when the primary falls silent. Failover time, from
+// the last message heard to the takeover, is measured here and reported in /metrics.
+
+typedef ReplicatedState<BAY_COUNT> LotReplica;
+
+WiFiUDP replicationUdp;
+IPAddress peerAddress;
+uint32_t replicatedVersion = 0;         // stateVersion last sent to the standby
+int64_t lastReplicationSend = 0;        // monoUs() of the last message sent
+unsigned long replicationSent = 0;
+
+void captureReplica(LotReplica& replica) {
+  int64_t now = monoUs();
+  replica.gateOpen = isGateOpen;
+  replica.pendingGateCommand = pendingGateCommand;
+  replica.gateCloseInMs = 0;
+  if (gateCloseAt != 0) {
+    int64_t leftMs = (gateCloseAt - now) / MONO_MS;
+    replica.gateCloseInMs = leftMs > 0 ? leftMs : 1; // Overdue: close as soon as possible
+  }
+  replica.gateHoldMs = gateHoldMs;
+  replica.vehiclesIn = vehiclesIn;
+  replica.vehiclesOut = vehiclesOut;
+  replica.rejectedPassages = rejectedPassages;
+  replica.occupied = occupiedBays;
+}
+
+// Mirrors the primary's state on the standby
+void applyReplica(const LotReplica& replica) {
+  isGateOpen = replica.gateOpen;
+  gateCloseAt = replica.gateCloseInMs > 0 ? monoUs() + replica.gateCloseInMs * MONO_MS : 0;
+  gateHoldMs = replica.gateHoldMs;
+  vehiclesIn = replica.vehiclesIn;
+  vehiclesOut = replica.vehiclesOut;
+  rejectedPassages = replica.rejectedPassages;
+  for (int i = 0; i < BAY_COUNT; i++) {
+    setBayBit(occupiedBays, i, replica.occupied.test(i));
+    bays[i].occupied = replica.occupied.test(i);
+    updateFreeBay(i);
+  }
+  // Carried out if this board takes over before the primary got to it
+  pendingGateCommand = replica.pendingGateCommand;
+  markStateChanged();
+}
+
+void sendReplicationMessage() {
+  static uint8_t buf[replicationMaxBytes(BAY_COUNT)];
+  static LotReplica replica;
+  ReplicationHeader header = replicationNextHeader(replication);
+  size_t len;
+  if (replication.role == ROLE_PRIMARY) {
+    captureReplica(replica);
+    len = replicationEncode(buf, sizeof(buf), header, &replica, BAY_COUNT);
+    replicatedVersion = stateVersion;
+  } else {
+    len = replicationEncode<BAY_COUNT>(buf, sizeof(buf), header, nullptr, BAY_COUNT);
+  }
+  replicationUdp.beginPacket(peerAddress, REPLICATION_PORT);
+  replicationUdp.write(buf, len);
+  replicationUdp.endPacket();
+  lastReplicationSend = monoUs();
+  replicationSent++;
+}
+
+// Drives the servo to the replicated gate position and carries on as primary
+void takeOver() {
+  Serial.printf("Replication: primary silent for %lu ms, taking over (epoch %lu)\n",
+                (unsigned long)(replication.lastFailoverUs / 1000), (unsigned long)replication.epoch);
+  gateServo.attach(SERVO_PIN);
+  gateServo.write(isGateOpen ? config.servoOpenAngle : config.servoClosedAngle);
+  if (isGateOpen && gateCloseAt == 0) {
+    gateCloseAt = monoUs() + gateHoldMs * MONO_MS;
+  }
+  passage.firstBeam = -1; // A passage already under way was not seen from its start
+  markStateChanged();
+  sendReplicationMessage(); // Tells the old primary, should it come back, to stand down
+}
+
+void standDown() {
+  Serial.printf("Replication: another primary is active (epoch %lu), standing by\n",
+                (unsigned long)replication.epoch);
+  gateServo.detach();
+  pinMode(SERVO_PIN, INPUT); // detach() leaves the pin as it was; let go of the shared line
+  markStateChanged();
+}
+
+// Exchanges state with the peer and fails over when needed; called from loop()
+void serviceReplication() {
+  if (!replicationEnabled) {
+    return;
+  }
+  static uint8_t buf[replicationMaxBytes(BAY_COUNT)];
+  static LotReplica replica;
+  int size;
+  while ((size = replicationUdp.parsePacket()) > 0) {
+    int len = replicationUdp.read(buf, sizeof(buf));
+    ReplicationHeader header;
+    bool hasState;
+    if (replicationUdp.remoteIP() != peerAddress ||
+        !replicationDecode(buf, len, header, replica, hasState, BAY_COUNT)) {
+      continue;
+    }
+    bool wasPrimary = replication.role == ROLE_PRIMARY;
+    if (replicationReceive(replication, header, monoUs()) && hasState) {
+      applyReplica(replica);
+    }
+    if (wasPrimary && replication.role == ROLE_STANDBY) {
+      standDown();
+    }
+  }
 
-            // 3. IR Sensor Status
-            const irText = document.getElementById('irStatusText');
-            if (data.ir_status == 0) {
-                irText.textContent = 'OBJECT DETECTED';
-                irText.className = 'font-bold text-yellow-600';
-            } else {
-                irText.textContent = 'CLEAR';
-                irText.className = 'font-medium text-gray-500';
-            }
-        }
+  if (replicationCheckTakeover(replication, monoUs())) {
+    takeOver();
+  }
+  bool changed = replication.role == ROLE_PRIMARY && replicatedVersion != stateVersion;
+  if (changed || monoUs() - lastReplicationSend >= (int64_t)HEARTBEAT_MS * MONO_MS) {
+    sendReplicationMessage();
+  }
+}
 
-        async function sendCommand(command) {
-            console.log(`Sending command: ${command}`);
-            const openBtn = document.getElementById('openBtn');
-            const closeBtn = document.getElementById('closeBtn');
+void startReplication() {
+  if (PEER_IP[0] == '\0') {
+    return;
+  }
+  if (!peerAddress.fromString(PEER_IP)) {
+    Serial.printf("Replication: invalid PEER_IP \"%s\", running standalone\n", PEER_IP);
+    gateServo.attach(SERVO_PIN);
+    closeGate();
+    return;
+  }
+  replicationUdp.begin(REPLICATION_PORT);
+  replicationInit(replication, REPLICATION_PRIORITY, FAILOVER_TIMEOUT_MS * MONO_MS, monoUs());
+  replicationEnabled = true;
+  Serial.printf("Replication: standing by for primary at %s\n", PEER_IP);
+}
 
-            // Simple button disable/re-enable for feedback
-            openBtn.disabled = true;
-            closeBtn.disabled = true;
+// ------------------------------------
+// 13. WEBHOOKS
+// ------------------------------------
+// Events are POSTed as JSON batches to each URL in WEBHOOK_URLS by a low-priority task
+// on core 0, so a slow or unreachable receiver never stalls sensing in loop(). loop()
+// only drops events into a bounded queue; the task copies them into a bounded backlog
+// per destination, sends up to WEBHOOK_BATCH_SIZE at a time, and retries a failed batch
+// with exponential backoff. Events that do not fit anywhere are dropped and counted.
+//
+// Body of each POST:
+//   {"board":"192.168.1.100","events":[{"seq":7,"time_ms":81234,"type":"bay_occupied","bay":0},...]}
 
-            try {
-                // Using fetch for GET command to keep server simple, but POST is better practice
-                const response = await fetch(`/gate?action=${command}`);
-                if (!response.ok) throw new Error('Command failed on server');
-                // The status will be updated by the next scheduled fetchStatus()
-            } catch (error) {
-                console.error("Error sending command:", error);
-                alert('Failed to send command to ESP32!'); // Using custom modal in a real app
-            } finally {
-                openBtn.disabled = false;
-                closeBtn.disabled = false;
-                // Wait a moment before manually refreshing status to show change
-                setTimeout(fetchStatus, 600);
-            }
-        }
+struct WebhookDestination {
+  const char* url;
+  ParkingEvent backlog[WEBHOOK_BACKLOG]; // Ring of undelivered events, oldest at `head`
+  int head;
+  int count;
+  int failures;                          // Consecutive failed attempts
+  int64_t retryAt;                       // monoUs() of the next attempt while backing off
+  HTTPClient http;                       // Kept between batches so the connection can be reused
+};
 
-        // Start fetching status updates every 1 second
-        document.addEventListener('DOMContentLoaded', () => {
-            fetchStatus();
-            setInterval(fetchStatus, 1000);
-        });
-    </script>
-</body>
-</html>
-)rawliteral";
+// Delivery counters per destination, written by the webhook task and read by /metrics
+struct WebhookMetrics {
+  uint32_t delivered;
+  uint32_t dropped;        // Oldest undelivered events pushed out of a full backlog
+  uint32_t posts;          // Batches sent, including failed attempts
+  uint32_t failedAttempts;
+  uint32_t pending;
+};
+
+WebhookDestination webhooks[WEBHOOK_COUNT];
+WebhookMetrics webhookMetrics[WEBHOOK_COUNT];
+portMUX_TYPE webhookMetricsMux = portMUX_INITIALIZER_UNLOCKED;
 
-  server.send(200, "text/html", htmlContent);
+void addToBacklog(int d, const ParkingEvent& event) {
+  WebhookDestination& dest = webhooks[d];
+  if (dest.count == WEBHOOK_BACKLOG) {
+    dest.head = (dest.head + 1) % WEBHOOK_BACKLOG; // Newer state beats older state
+    dest.count--;
+    portENTER_CRITICAL(&webhookMetricsMux);
+    webhookMetrics[d].dropped++;
+    portEXIT_CRITICAL(&webhookMetricsMux);
+  }
+  dest.backlog[(dest.head + dest.count) % WEBHOOK_BACKLOG] = event;
+  dest.count++;
 }
 
-// Serves the real-time status as JSON
-void handleStatus() {
-  updateStatus(); // Read sensors just before serving status
+// POSTs the oldest events of one destination; returns how many were delivered
+int sendWebhookBatch(int d, const String& board) {
+  WebhookDestination& dest = webhooks[d];
+  int n = min(dest.count, WEBHOOK_BATCH_SIZE);
+  String body;
+  body.reserve(40 + n * 72);
+  body += "{\"board\":\"" + board + "\",\"events\":[";
+  int64_t now = monoUs();
+  for (int i = 0; i < n; i++) {
+    const ParkingEvent& event = dest.backlog[(dest.head + i) % WEBHOOK_BACKLOG];
+    if (i > 0) body += ",";
+    body += "{\"seq\":" + String(event.seq);
+    body += ",\"time_ms\":" + String((unsigned long long)(event.timeUs / MONO_MS));
+    body += ",\"type\":\"" + String(PARKING_EVENT_NAMES[event.type]) + "\"";
+    if (event.bay >= 0) body += ",\"bay\":" + String(event.bay);
+    if (event.edgeUs != 0) body += ",\"latency_ms\":" + String((long)((now - event.edgeUs) / MONO_MS)); // Sensor to this POST
+    body += "}";
+  }
+  body += "]}";
 
-  String json = "{";
-  json += "\"is_occupied\":" + String(isSpotOccupied ? "true" : "false") + ",";
-  json += "\"distance_cm\":" + String(measureDistance(), 2) + ",";
-  json += "\"ir_status\":" + String(digitalRead(IR_PIN)) + ","; // LOW (0) means detected, HIGH (1) means clear
-  json += "\"is_gate_open\":" + String(isGateOpen ? "true" : "false") + ",";
-  json += "\"current_angle\":" + String(gateServo.read());
-  json += "}";
+  dest.http.begin(dest.url);
+  dest.http.addHeader("Content-Type", "application/json");
+  int code = dest.http.POST(body);
+  dest.http.end();
+  return code >= 200 && code < 300 ? n : 0;
+}
+
+// Sends a batch if one is due: full, or holding an event older than WEBHOOK_BATCH_DELAY_MS
+void serviceWebhook(int d, const String& board) {
+  WebhookDestination& dest = webhooks[d];
+  int64_t now = monoUs();
+  if (dest.count == 0 || (dest.failures > 0 && now < dest.retryAt)) {
+    return;
+  }
+  const ParkingEvent& oldest = dest.backlog[dest.head];
+  if (dest.count < WEBHOOK_BATCH_SIZE && now - oldest.timeUs < (int64_t)WEBHOOK_BATCH_DELAY_MS * MONO_MS) {
+    return;
+  }
+
+  int delivered = sendWebhookBatch(d, board);
+  if (delivered > 0) {
+    if (dest.failures > 0) {
+      Serial.printf("Webhook %d: delivered again after %d failed attempts\n", d, dest.failures);
+    }
+    int64_t now = monoUs();
+    portENTER_CRITICAL(&webhookMetricsMux);
+    for (int i = 0; i < delivered; i++) {
+      const ParkingEvent& event = dest.backlog[(dest.head + i) % WEBHOOK_BACKLOG];
+      if (event.edgeUs != 0) {
+        recordLatency(deliverLatency, now - event.edgeUs);
+      }
+    }
+    portEXIT_CRITICAL(&webhookMetricsMux);
+    dest.head = (dest.head + delivered) % WEBHOOK_BACKLOG;
+    dest.count -= delivered;
+    dest.failures = 0;
+  } else {
+    dest.failures++;
+    unsigned long backoff = WEBHOOK_BACKOFF_MIN_MS << min(dest.failures - 1, 16);
+    backoff = min(backoff, WEBHOOK_BACKOFF_MAX_MS);
+    backoff += esp_random() % (backoff / 4 + 1); // Jitter, so boards do not retry in lockstep
+    dest.retryAt = monoUs() + backoff * MONO_MS;
+    if (dest.failures == 1) {
+      Serial.printf("Webhook %d: POST to %s failed, retrying with backoff\n", d, dest.url);
+    }
+  }
+
+  portENTER_CRITICAL(&webhookMetricsMux);
+  webhookMetrics[d].posts++;
+  webhookMetrics[d].delivered += delivered;
+  webhookMetrics[d].failedAttempts += delivered > 0 ? 0 : 1;
+  webhookMetrics[d].pending = dest.count;
+  portEXIT_CRITICAL(&webhookMetricsMux);
+}
+
+void webhookTask(void*) {
+  String board = WiFi.localIP().toString();
+  while (true) {
+    // Wake up for new events, and at least every 50 ms for batches and retries that are due
+    ParkingEvent event;
+    while (xQueueReceive(eventQueue, &event, pdMS_TO_TICKS(50)) == pdTRUE) {
+      for (int d = 0; d < WEBHOOK_COUNT; d++) {
+        if (webhooks[d].url != nullptr) {
+          addToBacklog(d, event);
+        }
+      }
+      if (uxQueueMessagesWaiting(eventQueue) == 0) {
+        break;
+      }
+    }
+    for (int d = 0; d < WEBHOOK_COUNT; d++) {
+      if (webhooks[d].url != nullptr) {
+        serviceWebhook(d, board);
+      }
+    }
+  }
+}
+
+void startWebhooks() {
+  int active = 0;
+  for (int d = 0; d < WEBHOOK_COUNT; d++) {
+    webhooks[d].url = WEBHOOK_URLS[d][0] != '\0' ? WEBHOOK_URLS[d] : nullptr;
+    webhooks[d].http.setReuse(true);
+    webhooks[d].http.setConnectTimeout(WEBHOOK_TIMEOUT_MS);
+    webhooks[d].http.setTimeout(WEBHOOK_TIMEOUT_MS);
+    active += webhooks[d].url != nullptr;
+  }
+  if (active == 0) {
+    return;
+  }
+  eventQueue = xQueueCreate(EVENT_QUEUE_LENGTH, sizeof(ParkingEvent));
+  // Core 0, below loop()'s priority: delivery only gets the time sensing does not need
+  xTaskCreatePinnedToCore(webhookTask, "webhooks", 8192, nullptr, tskIDLE_PRIORITY + 1, nullptr, 0);
+  Serial.printf("Webhooks: delivering events to %d destination(s)\n", active);
+}
+
+// ------------------------------------
+// 14. PEER SYNC (CRDT)
+// ------------------------------------
+// Boards that each watch part of a lot (several lanes, overlapping rows of bays) share
+// one lot-wide view without a coordinator: every board broadcasts its own changes as
+// deltas and merges everyone else's (see crdt.h). Bay states are last-writer-wins
+// registers keyed by BAY_GLOBAL_SLOTS; the vehicle count is a PN-counter that each
+// board moves by its own lane's entries and exits. Served merged by /shared.
+
+const size_t CRDT_MAX_MESSAGE = 1400;  // Stays below the Wi-Fi MTU
+
+WiFiUDP crdtUdp;
+int64_t lastCrdtDelta = 0;
+int64_t lastCrdtFullSync = 0;
+int64_t crdtPeerSeen[CRDT_MAX_NODES]; // monoUs() a message last came from each node, 0 if never
+unsigned long crdtMessagesSent = 0, crdtBytesSent = 0;
+unsigned long crdtMessagesReceived = 0, crdtBytesReceived = 0, crdtMessagesRejected = 0;
+unsigned long crdtEntriesMerged = 0;
+
+// Merges peer messages and sends local changes; called from loop()
+void serviceCrdt() {
+  if (!crdtEnabled) {
+    return;
+  }
+  static uint8_t buf[CRDT_MAX_MESSAGE];
+  int size;
+  while ((size = crdtUdp.parsePacket()) > 0) {
+    int len = crdtUdp.read(buf, sizeof(buf));
+    int changed;
+    if (len <= 0 || !crdtApply(sharedLot, buf, len, changed)) {
+      crdtMessagesRejected++; // Malformed, or our own broadcast coming back
+      continue;
+    }
+    crdtPeerSeen[buf[3]] = monoUs();
+    crdtMessagesReceived++;
+    crdtBytesReceived += len;
+    crdtEntriesMerged += changed;
+    if (changed > 0) {
+      markStateChanged();
+    }
+  }
+
+  int64_t now = monoUs();
+  if (now - lastCrdtFullSync >= (int64_t)CRDT_FULL_SYNC_MS * MONO_MS) {
+    crdtMarkAllDirty(sharedLot);
+    lastCrdtFullSync = now;
+  }
+  if (now - lastCrdtDelta < (int64_t)CRDT_DELTA_MS * MONO_MS) {
+    return;
+  }
+  lastCrdtDelta = now;
+  size_t len;
+  while ((len = crdtEncodeDelta(sharedLot, buf, sizeof(buf))) > 0) {
+    crdtUdp.beginPacket(IPAddress(255, 255, 255, 255), CRDT_PORT);
+    crdtUdp.write(buf, len);
+    crdtUdp.endPacket();
+    crdtMessagesSent++;
+    crdtBytesSent += len;
+  }
+}
+
+// Peers heard from within three full-sync periods
+int crdtPeersUp() {
+  int64_t now = monoUs();
+  int up = 0;
+  for (int n = 0; n < CRDT_MAX_NODES; n++) {
+    up += crdtPeerSeen[n] != 0 && now - crdtPeerSeen[n] < 3 * (int64_t)CRDT_FULL_SYNC_MS * MONO_MS;
+  }
+  return up;
+}
 
+// Serves the merged lot-wide view as JSON
+void handleShared() {
+  if (!crdtEnabled) {
+    server.send(404, "text/plain", "Peer sync is off (CRDT_NODE_ID is -1).");
+    return;
+  }
+  int occupied = 0;
+  String slots;
+  for (int s = 0; s < CRDT_SLOT_COUNT; s++) {
+    if (sharedLot.slots[s].value == 1) {
+      if (occupied++ > 0) slots += ",";
+      slots += String(s);
+    }
+  }
+  int vehicles = pnValue(sharedLot.counters[CRDT_VEHICLES]);
+  String json = "{\"node\":" + String(CRDT_NODE_ID);
+  json += ",\"peers_up\":" + String(crdtPeersUp());
+  json += ",\"vehicles\":" + String(vehicles);
+  json += ",\"free_by_count\":" + String(constrain(config.lotCapacity - vehicles, 0L, config.lotCapacity));
+  json += ",\"slots\":" + String(CRDT_SLOT_COUNT);
+  json += ",\"occupied_count\":" + String(occupied);
+  json += ",\"occupied\":[" + slots + "]}";
   server.send(200, "application/json", json);
 }
 
-// Handles gate commands (e.g., /gate?action=open or /gate?action=close)
-void handleGateControl() {
-  if (server.hasArg("action")) {
-    String action = server.arg("action");
-    if (action == "open") {
-      openGate();
-      server.send(200, "text/plain", "Gate opened.");
+void startCrdt() {
+  if (CRDT_NODE_ID < 0) {
+    return;
+  }
+  if (CRDT_NODE_ID >= CRDT_MAX_NODES) {
+    Serial.printf("Peer sync: CRDT_NODE_ID must be 0..%d, turned off\n", CRDT_MAX_NODES - 1);
+    return;
+  }
+  crdtInit(sharedLot, CRDT_NODE_ID);
+  crdtUdp.begin(CRDT_PORT);
+  crdtEnabled = true;
+  for (int i = 0; i < BAY_COUNT; i++) {
+    crdtPublishBay(i, bays[i].occupied);
+  }
+  Serial.printf("Peer sync: node %d, %d lot-wide slots, UDP port %d\n", CRDT_NODE_ID, CRDT_SLOT_COUNT, CRDT_PORT);
+}
+
+// ------------------------------------
+// 15. RAW SAMPLE STREAM
+// ------------------------------------
+// /stream sends every echo to one client as it is measured, for tuning a bay. The
+// sensor sequence queues samples in a lock-free ring (see section 4); a task on core 0
+// writes them out as HTTP chunks, so a slow client costs dropped samples rather than
+// a stalled loop(). The client's connection is taken over from the web server.
+//
+// Body, in chunked transfer encoding: blocks of
+//   count(2) reserved(2) dropped(4)   dropped: samples lost since the stream began
+//   count samples of 16 bytes: timeUs(8) echoUs(4) mm(2) bay(1) flags(1)
+
+WiFiClient streamClient;        // Owned by the stream task while streamActive
+unsigned long streamSamplesSent = 0;
+unsigned long streamSamplesDroppedBefore = 0; // Dropped during earlier streams, for /metrics
+unsigned long streamClients = 0;
+
+// Writes one HTTP chunk of a chunked response; returns false if the client has gone
+bool writeChunk(WiFiClient& client, const uint8_t* data, size_t len) {
+  char size[12];
+  int sizeLen = snprintf(size, sizeof(size), "%X\r\n", (unsigned)len);
+  return client.write((const uint8_t*)size, sizeLen) == (size_t)sizeLen && client.write(data, len) == len &&
+         client.write((const uint8_t*)"\r\n", 2) == 2;
+}
+
+// Writes one block as one HTTP chunk; returns false if the client has gone
+bool sendStreamBlock(const RawSample* samples, uint32_t count) {
+  static uint8_t block[8 + STREAM_BATCH * sizeof(RawSample)];
+  block[0] = count;
+  block[1] = count >> 8;
+  block[2] = 0;
+  block[3] = 0;
+  putLe32(block + 4, rawSamplesDropped);
+  memcpy(block + 8, samples, count * sizeof(RawSample));
+  return writeChunk(streamClient, block, 8 + count * sizeof(RawSample));
+}
+
+void streamTask(void*) {
+  static RawSample batch[STREAM_BATCH];
+  while (true) {
+    if (!streamActive) {
+      vTaskDelay(pdMS_TO_TICKS(50));
+      continue;
+    }
+    uint32_t n = spscPop(rawSamples, batch, STREAM_BATCH);
+    bool ok = n > 0 ? sendStreamBlock(batch, n) : streamClient.connected();
+    if (!ok) {
+      streamClient.stop();
+      streamActive = false;
+      Serial.printf("Stream: client gone, %lu samples dropped\n", (unsigned long)rawSamplesDropped);
+      continue;
+    }
+    streamSamplesSent += n;
+    if (n < STREAM_BATCH) {
+      vTaskDelay(pdMS_TO_TICKS(20)); // Let a few samples collect rather than send them one by one
+    }
+  }
+}
+
+// Attaches the requesting client to the sample stream; one client at a time
+void handleStream() {
+  if (streamActive) {
+    server.send(409, "text/plain", "Another client is streaming; try again when it disconnects.");
+    return;
+  }
+  streamClient = server.client();
+  streamClient.print("HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+                     "Transfer-Encoding: chunked\r\nCache-Control: no-store\r\nConnection: close\r\n\r\n");
+  // Neither side touches the ring while no client is attached, so it can be reset here
+  spscClear(rawSamples);
+  streamSamplesDroppedBefore += rawSamplesDropped;
+  rawSamplesDropped = 0;
+  streamClients++;
+  streamActive = true;
+  Serial.println("Stream: client attached");
+}
+
+void startStream() {
+  // Core 0, below loop()'s priority, like the webhook task
+  xTaskCreatePinnedToCore(streamTask, "stream", 4096, nullptr, tskIDLE_PRIORITY + 1, nullptr, 0);
+}
+
+// ------------------------------------
+// 16. EVENT LOG EXPORT
+// ------------------------------------
+// /export streams event log records (section 7) straight from LittleFS as CSV or
+// NDJSON, for billing. A task on core 0 reads EXPORT_BATCH records at a time, oldest
+// file first, and writes them as one HTTP chunk, so RAM use is the same for ten
+// records as for twenty thousand and loop() is never held up. The client's
+// connection is taken over from the web server, as for /stream.
+//
+// from= and to= are record numbers (both inclusive and optional), and every row
+// starts with its record number: a client that is cut off asks again with from= one
+// past the last complete row it got. Records in one file are numbered consecutively,
+// so a record is found by computing its offset rather than by scanning. The range
+// actually served is in the X-Export-From / X-Export-Records headers; records rotated
+// out of /events.1 are gone. A complete export ends with the terminating zero-length
+// chunk, so a client can tell it from one cut short.
+
+enum ExportFormat : uint8_t {
+  EXPORT_CSV,     // Header row, then seq,type,bay,session_id,start,end,duration_s,tag; times ISO 8601 UTC
+  EXPORT_NDJSON,  // One JSON object per line; times UTC seconds, as in /sessions
+};
+
+WiFiClient exportClient;            // Owned by the export task while exportActive
+volatile bool exportActive = false;
+ExportFormat exportFormat = EXPORT_CSV;
+uint32_t exportNext = 0;            // Next record to send
+uint32_t exportLeft = 0;            // Records still to send
+uint32_t exportSent = 0;            // Records sent by the current export
+int64_t exportStartUs = 0;
+unsigned long exportRecordsTotal = 0;
+unsigned long exportsCompleted = 0;
+unsigned long exportsAborted = 0;
+float exportLastRate = 0;           // Records per second of the last finished export
+
+// Reads up to `max` records starting at record number `seq` into `out`; returns how
+// many it read, 0 past the end of the log. If `seq` has been rotated away, moves it
+// to the oldest record kept and returns 0.
+int readEventLog(uint32_t& seq, EventLogRecord* out, int max) {
+  const char* paths[] = { EVENT_LOG_PATH, EVENT_LOG_OLD_PATH };
+  uint32_t oldest = seq;
+  for (const char* path : paths) {
+    File file = LittleFS.open(path, FILE_READ);
+    if (!file) {
+      continue;
+    }
+    EventLogRecord first;
+    if (file.read((uint8_t*)&first, sizeof(first)) != sizeof(first) || seq < first.seq) {
+      oldest = file.size() >= sizeof(first) ? first.seq : oldest;
+      file.close();
+      continue;
+    }
+    file.seek((seq - first.seq) * sizeof(EventLogRecord));
+    int n = file.read((uint8_t*)out, max * sizeof(EventLogRecord)) / sizeof(EventLogRecord);
+    file.close();
+    // A record torn by a failed write would break the numbering; stop short of it
+    int good = 0;
+    while (good < n && out[good].seq == seq + good) {
+      good++;
+    }
+    return good;
+  }
+  seq = oldest;
+  return 0;
+}
+
+// Formats a UTC time as ISO 8601, or as nothing if the clock was not set
+void formatUtc(char* out, size_t size, uint32_t t) {
+  if (t == 0) {
+    out[0] = '\0';
+    return;
+  }
+  time_t when = t;
+  struct tm utc;
+  gmtime_r(&when, &utc);
+  strftime(out, size, "%Y-%m-%dT%H:%M:%SZ", &utc);
+}
+
+// Appends one record as a row; returns its length. Tags hold only letters, digits,
+// '-' and '_' (see setSessionTag()), so they need no quoting or escaping.
+int formatExportRow(char* out, size_t size, const EventLogRecord& r) {
+  const char* type = r.type == LOG_SESSION_CLOSED ? "session_closed" : "unknown";
+  if (exportFormat == EXPORT_NDJSON) {
+    return snprintf(out, size,
+                    "{\"seq\":%lu,\"type\":\"%s\",\"bay\":%d,\"session_id\":%lu,\"start\":%lu,\"end\":%lu,"
+                    "\"duration_s\":%lu,\"tag\":\"%.*s\"}\n",
+                    (unsigned long)r.seq, type, r.bay, (unsigned long)r.sessionId, (unsigned long)r.startTime,
+                    (unsigned long)r.endTime, (unsigned long)r.durationS, SESSION_TAG_LENGTH, r.tag);
+  }
+  char start[24], end[24];
+  formatUtc(start, sizeof(start), r.startTime);
+  formatUtc(end, sizeof(end), r.endTime);
+  return snprintf(out, size, "%lu,%s,%d,%lu,%s,%s,%lu,%.*s\n", (unsigned long)r.seq, type, r.bay,
+                  (unsigned long)r.sessionId, start, end, (unsigned long)r.durationS, SESSION_TAG_LENGTH, r.tag);
+}
+
+void finishExport(bool complete) {
+  if (complete) {
+    exportClient.write((const uint8_t*)"0\r\n\r\n", 5);
+  }
+  exportClient.stop();
+  float seconds = (monoUs() - exportStartUs) / 1e6;
+  exportLastRate = seconds > 0 ? exportSent / seconds : 0;
+  if (complete) {
+    exportsCompleted++;
+  } else {
+    exportsAborted++;
+  }
+  Serial.printf("Export: %s after %lu records (next #%lu), %.0f records/s\n", complete ? "done" : "client gone",
+                (unsigned long)exportSent, (unsigned long)exportNext, exportLastRate);
+  exportActive = false;
+}
+
+void exportTask(void*) {
+  static EventLogRecord records[EXPORT_BATCH];
+  static char text[EXPORT_BATCH * 192]; // Longest NDJSON row is 164 bytes
+  while (true) {
+    if (!exportActive) {
+      vTaskDelay(pdMS_TO_TICKS(50));
+      continue;
+    }
+    if (exportLeft == 0) {
+      finishExport(true);
+      continue;
+    }
+    uint32_t seq = exportNext;
+    int n = readEventLog(seq, records, exportLeft < (uint32_t)EXPORT_BATCH ? exportLeft : EXPORT_BATCH);
+    if (n == 0 && seq != exportNext) {
+      // Rotated away while the export ran; go on from the oldest record kept
+      exportLeft = seq - exportNext < exportLeft ? exportLeft - (seq - exportNext) : 0;
+      exportNext = seq;
+      continue;
+    }
+    if (n == 0) {
+      finishExport(true); // A torn record ends the log early
+      continue;
+    }
+    size_t len = 0;
+    for (int i = 0; i < n; i++) {
+      len += formatExportRow(text + len, sizeof(text) - len, records[i]);
+    }
+    if (!writeChunk(exportClient, (const uint8_t*)text, len)) {
+      finishExport(false);
+      continue;
+    }
+    exportNext += n;
+    exportLeft -= n;
+    exportSent += n;
+    exportRecordsTotal += n;
+  }
+}
+
+// Attaches the requesting client to an export (/export?from=0&to=999&format=csv); one at a time
+void handleExport() {
+  String format = server.hasArg("format") ? server.arg("format") : "csv";
+  if (format != "csv" && format != "ndjson") {
+    server.send(400, "text/plain", "Use /export?from=N&to=M&format=csv|ndjson");
+    return;
+  }
+  if (!eventLogReady) {
+    server.send(503, "text/plain", "The event log is not available.");
+    return;
+  }
+  if (exportActive) {
+    server.send(409, "text/plain", "Another export is running; try again when it finishes.");
+    return;
+  }
+  // Records appended from now on are left for the next export
+  uint32_t last = eventLogNextSeq > 0 ? eventLogNextSeq - 1 : 0;
+  uint32_t from = server.hasArg("from") ? strtoul(server.arg("from").c_str(), nullptr, 10) : 0;
+  uint32_t to = server.hasArg("to") ? strtoul(server.arg("to").c_str(), nullptr, 10) : last;
+  to = to < last ? to : last;
+  uint32_t oldest = from;
+  EventLogRecord probe;
+  readEventLog(oldest, &probe, 1);
+  from = from > oldest ? from : oldest;
+  uint32_t count = eventLogNextSeq == 0 || from > to ? 0 : to - from + 1;
+
+  exportFormat = format == "ndjson" ? EXPORT_NDJSON : EXPORT_CSV;
+  exportClient = server.client();
+  exportClient.printf("HTTP/1.1 200 OK\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n"
+                      "X-Export-From: %lu\r\nX-Export-Records: %lu\r\nCache-Control: no-store\r\nConnection: close\r\n\r\n",
+                      exportFormat == EXPORT_NDJSON ? "application/x-ndjson" : "text/csv", (unsigned long)from,
+                      (unsigned long)count);
+  if (exportFormat == EXPORT_CSV) {
+    const char* header = "seq,type,bay,session_id,start,end,duration_s,tag\n";
+    writeChunk(exportClient, (const uint8_t*)header, strlen(header));
+  }
+  exportNext = from;
+  exportLeft = count;
+  exportSent = 0;
+  exportStartUs = monoUs();
+  exportActive = true;
+  Serial.printf("Export: %lu records from #%lu as %s\n", (unsigned long)count, (unsigned long)from, format.c_str());
+}
+
+void startExport() {
+  // Core 0, below loop()'s priority, like the stream task
+  xTaskCreatePinnedToCore(exportTask, "export", 4096, nullptr, tskIDLE_PRIORITY + 1, nullptr, 0);
+}
+
+// ------------------------------------
+// 17. FIRMWARE UPDATE
+// ------------------------------------
+// POST /ota?url=...&sha256=... makes the board download an image and stream it into the
+// inactive app partition (see ota_stream.h) from a low-priority task on core 0. Flash is
+// written one sector per burst, only between echoes and passages, with a pause after
+// each, so sensing and the gate keep running; /metrics shows the bursts next to the
+// sensor and loop() timing they affect. A verified image is made the boot partition and
+// the board restarts into it.
+//
+// The new image boots on trial. It is kept once it has Wi-Fi and its sensor sequence
+// has run OTA_HEALTH_SENSOR_ROUNDS rounds; if that has not happened within
+// OTA_HEALTH_TIMEOUT_MS it rolls itself back, and if it resets before then the
+// bootloader boots the previous image.
+//
+// With target=assets the same path rewrites the asset partition (section 3) instead.
+// The dashboard falls back to the built-in one while it is written, and loop() maps
+// the new blob once it is verified; no restart is needed.
+
+enum OtaState : uint8_t { OTA_IDLE, OTA_DOWNLOADING, OTA_VERIFYING, OTA_REBOOTING, OTA_DONE, OTA_FAILED };
+const char* OTA_STATE_NAMES[] = { "idle", "downloading", "verifying", "rebooting", "done", "failed" };
+
+volatile OtaState otaState = OTA_IDLE;
+String otaUrl;
+uint8_t otaExpected[32];
+const esp_partition_t* otaPartition = nullptr;
+bool otaAssets = false;           // Writing the asset partition rather than firmware
+volatile bool assetsRemapPending = false; // Set by the update task, handled by loop()
+OtaWriter otaWriter;              // Owned by the update task while it runs
+int otaHttpCode = 0;
+TimingStats otaBurstTime;         // Length of each flash burst
+unsigned long otaBurstsDeferred = 0; // Bursts held back for an echo or a passage
+bool otaPendingVerify = false;    // Running a new image that has not passed its health check yet
+
+// Arduino core hook: leave a freshly updated image on trial, so that serviceOtaHealth()
+// decides whether to keep it
+bool verifyRollbackLater() {
+  return true;
+}
+
+bool otaPartitionErase(void* ctx, uint32_t offset, uint32_t len) {
+  return esp_partition_erase_range((const esp_partition_t*)ctx, offset, len) == ESP_OK;
+}
+
+bool otaPartitionWrite(void* ctx, uint32_t offset, const uint8_t* data, uint32_t len) {
+  return esp_partition_write((const esp_partition_t*)ctx, offset, data, len) == ESP_OK;
+}
+
+bool otaPartitionRead(void* ctx, uint32_t offset, uint8_t* data, uint32_t len) {
+  return esp_partition_read((const esp_partition_t*)ctx, offset, data, len) == ESP_OK;
+}
+
+// Runs one writer step as a flash burst, once no echo is in flight and no vehicle is
+// between the beams (its edges would be timestamped late); returns the step's result
+bool otaBurst(bool (*step)(OtaWriter&)) {
+  while (true) {
+    portENTER_CRITICAL(&flashMux);
+    bool clear = !echoInFlight && passage.firstBeam < 0;
+    if (clear) {
+      flashBusy = true;
+    }
+    portEXIT_CRITICAL(&flashMux);
+    if (clear) {
+      break;
+    }
+    otaBurstsDeferred++;
+    vTaskDelay(1);
+  }
+  int64_t start = monoUs();
+  bool result = step(otaWriter);
+  recordTiming(otaBurstTime, monoUs() - start);
+  flashBusy = false;
+  vTaskDelay(pdMS_TO_TICKS(OTA_BURST_GAP_MS));
+  return result;
+}
+
+void otaFail(const char* why) {
+  Serial.printf("Update: failed (%s, %s)\n", why, OTA_ERROR_NAMES[otaWriter.error]);
+  otaState = OTA_FAILED;
+}
+
+void otaTask(void*) {
+  HTTPClient http;
+  http.setTimeout(OTA_STALL_TIMEOUT_MS);
+  http.begin(otaUrl);
+  otaHttpCode = http.GET();
+  int size = http.getSize();
+  OtaFlash flash = { (void*)otaPartition, otaPartition->size, otaPartitionErase, otaPartitionWrite, otaPartitionRead };
+  if (otaHttpCode != 200 || size <= 0) {
+    otaFail("download refused");
+  } else if (!otaBegin(otaWriter, flash, size, otaExpected, otaAssets ? (uint8_t)ASSET_MAGIC : OTA_IMAGE_MAGIC)) {
+    otaFail("image does not fit");
+  } else {
+    WiFiClient* stream = http.getStreamPtr();
+    static uint8_t buf[1024];
+    while (otaWriter.error == OTA_OK && otaWriter.written < otaWriter.imageSize) {
+      uint32_t want = min((uint32_t)sizeof(buf), otaWriter.imageSize - otaWriter.written - otaWriter.fill);
+      size_t n = want > 0 ? stream->readBytes(buf, want) : 0; // Waits up to the HTTP timeout
+      if (want > 0 && n == 0) {
+        break; // Stalled or closed early
+      }
+      for (size_t used = 0; used < n || otaSectorReady(otaWriter);) {
+        used += otaFeed(otaWriter, buf + used, n - used);
+        if (otaSectorReady(otaWriter)) {
+          otaBurst(otaWriteSector);
+        }
+        if (otaWriter.error != OTA_OK) {
+          break;
+        }
+      }
+    }
+    if (otaWriter.error != OTA_OK || otaWriter.written < otaWriter.imageSize) {
+      otaFail(otaWriter.error != OTA_OK ? "write" : "download cut short");
+    } else {
+      otaState = OTA_VERIFYING;
+      while (otaBurst(otaVerifyStep)) {}
+      if (otaWriter.error != OTA_OK) {
+        otaFail("verify");
+      } else if (otaAssets) {
+        otaState = OTA_DONE;
+        Serial.printf("Update: %lu bytes of assets verified\n", (unsigned long)otaWriter.written);
+      } else if (esp_ota_set_boot_partition(otaPartition) != ESP_OK) {
+        otaWriter.error = OTA_ERR_IMAGE; // Rejected by the ESP-IDF image check
+        otaFail("set boot partition");
+      } else {
+        otaState = OTA_REBOOTING;
+        Serial.printf("Update: %lu bytes verified, restarting into %s\n", (unsigned long)otaWriter.written,
+                      otaPartition->label);
+      }
+    }
+  }
+  http.end();
+  if (otaAssets) {
+    assetsRemapPending = true; // Maps the new blob, or finds the partition no longer valid
+  }
+  if (otaState == OTA_REBOOTING) {
+    vTaskDelay(pdMS_TO_TICKS(1000)); // Lets /ota report it
+    ESP.restart();
+  }
+  vTaskDelete(nullptr);
+}
+
+// POST starts an update; GET reports its progress as JSON
+void handleOta() {
+  if (server.method() == HTTP_POST) {
+    // The SHA-256 only proves the image arrived intact; the token is what says who sent it
+    if (OTA_TOKEN[0] == '\0') {
+      server.send(403, "text/plain", "Updates are disabled: set OTA_TOKEN in the sketch.");
       return;
-    } else if (action == "close") {
-      closeGate();
-      server.send(200, "text/plain", "Gate closed.");
+    }
+    if (server.arg("token") != OTA_TOKEN) {
+      server.send(403, "text/plain", "Wrong or missing token.");
+      return;
+    }
+    if (otaState == OTA_DOWNLOADING || otaState == OTA_VERIFYING || otaState == OTA_REBOOTING || assetsRemapPending) {
+      server.send(409, "text/plain", "An update is already running.");
       return;
     }
+    if (!server.arg("url").startsWith("http://") || !sha256FromHex(server.arg("sha256").c_str(), otaExpected)) {
+      server.send(400, "text/plain", "Give the image as url=http://... and its SHA-256 as sha256=<64 hex digits>.");
+      return;
+    }
+    otaAssets = server.arg("target") == "assets";
+    otaPartition = otaAssets ? assetsPartition : esp_ota_get_next_update_partition(nullptr);
+    if (otaPartition == nullptr) {
+      server.send(503, "text/plain", otaAssets ? "No asset partition; flash with the sketch's partitions.csv."
+                                               : "No OTA partition; use a partition scheme with two app slots.");
+      return;
+    }
+    if (otaAssets) {
+      unmapAssets(); // Nothing may read the partition while it is rewritten
+    }
+    otaUrl = server.arg("url");
+    otaWriter.error = OTA_OK;
+    otaWriter.written = 0;
+    otaWriter.imageSize = 0;
+    otaHttpCode = 0;
+    otaState = OTA_DOWNLOADING;
+    Serial.printf("Update: fetching %s into %s\n", otaUrl.c_str(), otaPartition->label);
+    // Core 0, below loop()'s priority, like the webhook task
+    xTaskCreatePinnedToCore(otaTask, "ota", 8192, nullptr, tskIDLE_PRIORITY + 1, nullptr, 0);
   }
-  server.send(400, "text/plain", "Invalid action. Use /gate?action=open or /gate?action=close");
+
+  String json = "{\"state\":\"" + String(OTA_STATE_NAMES[otaState]) + "\"";
+  json += ",\"target\":\"" + String(otaAssets ? "assets" : "firmware") + "\"";
+  json += ",\"error\":\"" + String(OTA_ERROR_NAMES[otaWriter.error]) + "\"";
+  json += ",\"http_code\":" + String(otaHttpCode);
+  json += ",\"size\":" + String((unsigned long)otaWriter.imageSize);
+  json += ",\"written\":" + String((unsigned long)otaWriter.written);
+  json += ",\"verified\":" + String((unsigned long)otaWriter.verified);
+  json += ",\"bursts\":" + String((unsigned long)otaBurstTime.count);
+  json += ",\"burst_max_ms\":" + String(otaBurstTime.maxUs / 1000.0, 1);
+  json += ",\"running\":\"" + String(esp_ota_get_running_partition()->label) + "\"";
+  json += ",\"on_trial\":" + String(otaPendingVerify ? "true" : "false") + "}";
+  server.send(server.method() == HTTP_POST ? 202 : 200, "application/json", json);
+}
+
+// Notes whether this boot runs a freshly updated image that has to prove itself
+void startOtaHealthCheck() {
+  esp_ota_img_states_t state;
+  otaPendingVerify = esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK &&
+                     state == ESP_OTA_IMG_PENDING_VERIFY;
+  if (otaPendingVerify) {
+    Serial.printf("Update: new image on trial for %lu s\n", OTA_HEALTH_TIMEOUT_MS / 1000);
+  }
+}
+
+// Keeps a new image once it is healthy, or rolls back to the previous one; called from loop()
+void serviceOtaHealth() {
+  if (!otaPendingVerify) {
+    return;
+  }
+  if (WiFi.status() == WL_CONNECTED && sensorRounds >= OTA_HEALTH_SENSOR_ROUNDS) {
+    esp_ota_mark_app_valid_cancel_rollback();
+    otaPendingVerify = false;
+    Serial.println("Update: new image healthy, keeping it");
+  } else if (monoUs() > (int64_t)OTA_HEALTH_TIMEOUT_MS * MONO_MS) {
+    Serial.println("Update: new image failed its health check, rolling back");
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+  }
+}
+
+// ------------------------------------
+// 18. METRICS
+// ------------------------------------
+
+// Appends one Prometheus sample line
+void addMetric(String& out, const char* name, const char* labels, double value) {
+  out += name;
+  if (labels[0] != '\0') {
+    out += "{";
+    out += labels;
+    out += "}";
+  }
+  out += " ";
+  out += String(value, 6);
+  out += "\n";
+}
+
+// Appends a latency histogram as Prometheus parking_latency_seconds samples
+void addLatencyHistogram(String& out, const char* stage, const LatencyHistogram& h) {
+  String prefix = "stage=\"" + String(stage) + "\",le=\"";
+  uint32_t cumulative = 0;
+  for (int b = 0; b < LATENCY_BUCKET_COUNT; b++) {
+    cumulative += h.buckets[b];
+    String labels = prefix + String(LATENCY_BUCKETS_MS[b] / 1000.0, 3) + "\"";
+    addMetric(out, "parking_latency_seconds_bucket", labels.c_str(), cumulative);
+  }
+  String labels = prefix + "+Inf\"";
+  addMetric(out, "parking_latency_seconds_bucket", labels.c_str(), h.count);
+  labels = "stage=\"" + String(stage) + "\"";
+  addMetric(out, "parking_latency_seconds_sum", labels.c_str(), h.sumUs / 1e6);
+  addMetric(out, "parking_latency_seconds_count", labels.c_str(), h.count);
+}
+
+// Appends mean and max of a timing as Prometheus parking_timing_seconds gauges
+void addTimingStats(String& out, const char* name, const TimingStats& t) {
+  String labels = "timing=\"" + String(name) + "\",stat=\"mean\"";
+  addMetric(out, "parking_timing_seconds", labels.c_str(), t.count > 0 ? t.sumUs / 1e6 / t.count : 0);
+  labels = "timing=\"" + String(name) + "\",stat=\"max\"";
+  addMetric(out, "parking_timing_seconds", labels.c_str(), t.maxUs / 1e6);
+}
+
+// Serves counters in the Prometheus text format
+void handleMetrics() {
+  portENTER_CRITICAL(&tlsMetricsMux);
+  TlsMetrics tls = tlsMetrics;
+  portEXIT_CRITICAL(&tlsMetricsMux);
+
+  String out;
+  out.reserve(1024);
+  out += "# TYPE parking_vehicles_total counter\n";
+  addMetric(out, "parking_vehicles_total", "direction=\"in\"", vehiclesIn);
+  addMetric(out, "parking_vehicles_total", "direction=\"out\"", vehiclesOut);
+  addMetric(out, "parking_rejected_passages_total", "", rejectedPassages);
+  int64_t now = monoUs();
+  out += "# TYPE parking_lane_queue_length gauge\n";
+  addMetric(out, "parking_lane_queue_length", "", laneQueueLength(laneQueue, now));
+  addMetric(out, "parking_lane_arrivals_per_minute", "", laneArrivalRate(laneQueue, now) * 60);
+  addMetric(out, "parking_lane_service_per_minute", "", laneServiceRate(laneQueue) * 60);
+  addMetric(out, "parking_lane_utilization", "", laneUtilization(laneQueue, now));
+  addMetric(out, "parking_lane_queued_in_a_row", "", laneQueue.backToBack);
+  addMetric(out, "parking_lane_overloaded", "", laneQueue.overloaded);
+  addMetric(out, "parking_lane_overloads_total", "", laneOverloads);
+  out += "# TYPE parking_sensors_failed gauge\n";
+  addMetric(out, "parking_sensors_failed", "", failedSensors);
+  addMetric(out, "parking_sensor_failures_total", "", sensorFailures);
+  addMetric(out, "parking_sensor_recoveries_total", "", sensorRecoveries);
+  out += "# TYPE parking_https_handshakes_total counter\n";
+  addMetric(out, "parking_https_handshakes_total", "type=\"full\"", tls.fullHandshakes);
+  addMetric(out, "parking_https_handshakes_total", "type=\"resumed\"", tls.resumedHandshakes);
+  addMetric(out, "parking_https_handshakes_total", "type=\"untimed\"", tls.untimedHandshakes);
+  out += "# TYPE parking_https_handshake_seconds summary\n";
+  addMetric(out, "parking_https_handshake_seconds_sum", "type=\"full\"", tls.fullHandshakeUsTotal / 1e6);
+  addMetric(out, "parking_https_handshake_seconds_count", "type=\"full\"", tls.fullHandshakes);
+  addMetric(out, "parking_https_handshake_seconds_sum", "type=\"resumed\"", tls.resumedHandshakeUsTotal / 1e6);
+  addMetric(out, "parking_https_handshake_seconds_count", "type=\"resumed\"", tls.resumedHandshakes);
+  out += "# TYPE parking_https_handshake_seconds_max gauge\n";
+  addMetric(out, "parking_https_handshake_seconds_max", "type=\"full\"", tls.fullHandshakeUsMax / 1e6);
+  addMetric(out, "parking_https_handshake_seconds_max", "type=\"resumed\"", tls.resumedHandshakeUsMax / 1e6);
+  out += "# TYPE parking_https_requests_total counter\n";
+  addMetric(out, "parking_https_requests_total", "", tls.requests);
+
+  WebhookMetrics hooks[WEBHOOK_COUNT];
+  LatencyHistogram delivered;
+  portENTER_CRITICAL(&webhookMetricsMux);
+  memcpy(hooks, webhookMetrics, sizeof(hooks));
+  delivered = deliverLatency;
+  portEXIT_CRITICAL(&webhookMetricsMux);
+  out += "# TYPE parking_latency_seconds histogram\n";
+  addLatencyHistogram(out, "publish", publishLatency);
+  addLatencyHistogram(out, "deliver", delivered);
+  addLatencyHistogram(out, "render", renderLatency);
+  out += "# TYPE parking_timing_seconds gauge\n";
+  addTimingStats(out, "sensor_wake_late", sensorWakeLate);
+  addTimingStats(out, "loop_gap", loopGap);
+  addTimingStats(out, "ota_burst", otaBurstTime);
+  out += "# TYPE parking_ota_bursts_total counter\n";
+  addMetric(out, "parking_ota_bursts_total", "", otaBurstTime.count);
+  addMetric(out, "parking_ota_bursts_deferred_total", "", otaBurstsDeferred);
+  addMetric(out, "parking_echoes_deferred_total", "", echoesDeferred);
+  addMetric(out, "parking_assets_served_total", "", assetsServed);
+  addMetric(out, "parking_assets_generation", "", assets != nullptr ? assets->generation : 0);
+  addMetric(out, "parking_uptime_seconds", "", monoUs() / 1e6);
+  out += "# TYPE parking_sessions_total counter\n";
+  addMetric(out, "parking_sessions_total", "state=\"opened\"", sessionsOpened);
+  addMetric(out, "parking_sessions_total", "state=\"closed\"", sessionsClosed);
+  addMetric(out, "parking_event_log_records", "", eventLogNextSeq);
+  addMetric(out, "parking_event_log_write_errors_total", "", eventLogWriteErrors);
+  out += "# TYPE parking_events_total counter\n";
+  addMetric(out, "parking_events_total", "", eventSeq);
+  addMetric(out, "parking_events_dropped_total", "reason=\"queue_full\"", eventsDroppedQueueFull);
+  for (int d = 0; d < WEBHOOK_COUNT; d++) {
+    if (webhooks[d].url == nullptr) {
+      continue;
+    }
+    String label = "destination=\"" + String(d) + "\"";
+    addMetric(out, "parking_webhook_events_delivered_total", label.c_str(), hooks[d].delivered);
+    addMetric(out, "parking_webhook_events_dropped_total", label.c_str(), hooks[d].dropped);
+    addMetric(out, "parking_webhook_events_pending", label.c_str(), hooks[d].pending);
+    addMetric(out, "parking_webhook_posts_total", label.c_str(), hooks[d].posts);
+    addMetric(out, "parking_webhook_failed_attempts_total", label.c_str(), hooks[d].failedAttempts);
+  }
+  out += "# TYPE parking_stream_samples_total counter\n";
+  addMetric(out, "parking_stream_samples_total", "result=\"sent\"", streamSamplesSent);
+  addMetric(out, "parking_stream_samples_total", "result=\"dropped\"", streamSamplesDroppedBefore + rawSamplesDropped);
+  addMetric(out, "parking_stream_clients_total", "", streamClients);
+  addMetric(out, "parking_stream_active", "", streamActive);
+  out += "# TYPE parking_export_records_total counter\n";
+  addMetric(out, "parking_export_records_total", "", exportRecordsTotal);
+  addMetric(out, "parking_exports_total", "result=\"completed\"", exportsCompleted);
+  addMetric(out, "parking_exports_total", "result=\"aborted\"", exportsAborted);
+  addMetric(out, "parking_export_records_per_second", "", exportLastRate);
+  addMetric(out, "parking_export_active", "", exportActive);
+  if (crdtEnabled) {
+    out += "# TYPE parking_crdt_messages_total counter\n";
+    addMetric(out, "parking_crdt_messages_total", "direction=\"sent\"", crdtMessagesSent);
+    addMetric(out, "parking_crdt_messages_total", "direction=\"received\"", crdtMessagesReceived);
+    addMetric(out, "parking_crdt_messages_total", "direction=\"rejected\"", crdtMessagesRejected);
+    out += "# TYPE parking_crdt_bytes_total counter\n";
+    addMetric(out, "parking_crdt_bytes_total", "direction=\"sent\"", crdtBytesSent);
+    addMetric(out, "parking_crdt_bytes_total", "direction=\"received\"", crdtBytesReceived);
+    addMetric(out, "parking_crdt_entries_merged_total", "", crdtEntriesMerged);
+    addMetric(out, "parking_crdt_peers_up", "", crdtPeersUp());
+  }
+  if (replicationEnabled) {
+    out += "# TYPE parking_replication_primary gauge\n";
+    addMetric(out, "parking_replication_primary", "", replication.role == ROLE_PRIMARY);
+    addMetric(out, "parking_replication_peer_up", "", replicationPeerUp(replication, now));
+    addMetric(out, "parking_replication_epoch", "", replication.epoch);
+    out += "# TYPE parking_replication_messages_total counter\n";
+    addMetric(out, "parking_replication_messages_total", "direction=\"sent\"", replicationSent);
+    addMetric(out, "parking_replication_messages_total", "direction=\"received\"", replication.received);
+    addMetric(out, "parking_replication_messages_total", "direction=\"missed\"", replication.missed);
+    addMetric(out, "parking_replication_messages_total", "direction=\"stale\"", replication.stale);
+    out += "# TYPE parking_replication_failovers_total counter\n";
+    addMetric(out, "parking_replication_failovers_total", "", replication.failovers);
+    addMetric(out, "parking_replication_demotions_total", "", replication.demotions);
+    out += "# TYPE parking_replication_last_failover_seconds gauge\n";
+    addMetric(out, "parking_replication_last_failover_seconds", "", replication.lastFailoverUs / 1e6);
+  }
+  server.send(200, "text/plain; version=0.0.4", out);
 }
 
 // ------------------------------------
-// 7. SETUP AND LOOP
+// 19. SETUP AND LOOP
 // ------------------------------------
 
 void setup() {
   Serial.begin(115200);
+  startOtaHealthCheck();
+  mapAssets();
+  loadConfig();
+  gateHoldMs = holdTimeMs(avgSpeedMps, avgLengthM); // Within the configured limits from the start
 
   // Sensor Pin Setup
-  pinMode(TRIG_PIN, OUTPUT);
-  digitalWrite(TRIG_PIN, LOW); // Start low
-  pinMode(ECHO_PIN, INPUT);
+  for (int i = 0; i < BAY_COUNT; i++) {
+    pinMode(BAY_TRIG_PINS[i], OUTPUT);
+    digitalWrite(BAY_TRIG_PINS[i], LOW); // Start low
+    pinMode(BAY_ECHO_PINS[i], INPUT);
+    attachInterruptArg(digitalPinToInterrupt(BAY_ECHO_PINS[i]), onEchoEdge, (void*)(intptr_t)BAY_ECHO_PINS[i], CHANGE);
+  }
+  loadBayCalibration();
+  initBayBitmaps();
+  initDistanceHistograms();
+  laneQueueInit(laneQueue, QUEUE_WINDOW_MS * MONO_MS, QUEUE_MOVE_UP_MS * MONO_MS, monoUs());
+  initEventLog();
+  initSessions();
   pinMode(IR_PIN, INPUT_PULLUP); // IR sensor typically works best with pullup
+  pinMode(IR_PIN_B, INPUT_PULLUP);
 
-  // Servo Setup
-  gateServo.attach(SERVO_PIN);
-  closeGate(); // Ensure gate is closed on startup
+  // Beam edges are timestamped in interrupts and decoded in loop()
+  attachInterrupt(digitalPinToInterrupt(IR_PIN), onBeamAEdge, CHANGE);
+  attachInterrupt(digitalPinToInterrupt(IR_PIN_B), onBeamBEdge, CHANGE);
+
+  // Servo Setup (with a peer, the servo stays detached until this board becomes primary)
+  if (PEER_IP[0] == '\0') {
+    gateServo.attach(SERVO_PIN);
+    closeGate(); // Ensure gate is closed on startup
+  } else {
+    pinMode(SERVO_PIN, INPUT); // The signal line is shared with the peer
+  }
 
   // Wi-Fi Connection
   Serial.print("Connecting to Wi-Fi...");
@@ -355,23 +3847,87 @@ void setup() {
   Serial.println("\nConnected!");
   Serial.print("IP Address: ");
   Serial.println(WiFi.localIP());
+  configTime(0, 0, NTP_SERVER); // UTC, for session start and end times
+  startReplication();
+  startWebhooks();
+  startCrdt();
+  startStream();
+  startExport();
 
   // Web Server Routing
   server.on("/", handleRoot);
   server.on("/status", handleStatus);
+  server.on("/latency", handleLatency);
   server.on("/gate", handleGateControl);
+  server.on("/calibrate", handleCalibrate);
+  server.on("/histogram", handleHistogram);
+  server.on("/occupancy.bin", handleOccupancyBitmap);
+  server.on("/state.bin", handleStateBitmaps);
+  server.on("/reserve", handleReserve);
+  server.on("/slots", handleSlots);
+  server.on("/config", handleConfig);
+  server.on("/metrics", handleMetrics);
+  server.on("/sessions", handleSessions);
+  server.on("/sessions/tag", handleSessionTag);
+  server.on("/shared", handleShared);
+  server.on("/stream", handleStream);
+  server.on("/export", handleExport);
+  server.on("/ota", handleOta);
+  server.on("/assets", handleAssets);
+  server.onNotFound(handleNotFound);
 
   // Start Server
   server.begin();
   Serial.println("HTTP Server started on port 80");
+
+  statusCacheLock = xSemaphoreCreateMutex();
+  refreshStatusCache();
+  startHttpsServer();
+
+  coInit(sequences, monoUs());
+  coSignalInit(echoSignal, sequences);
+  coSignalInit(gateCommandSignal, sequences);
+  if (!coSpawn(sequences, sensorSequence()) || !coSpawn(sequences, gateSequence())) {
+    Serial.printf("Sequences: a coroutine frame needs more than %d bytes (%u asked), raise CORO_FRAME_BYTES\n",
+                  CORO_FRAME_BYTES, (unsigned)coFrames.largestFrame);
+  }
 }
 
 void loop() {
   server.handleClient();
+  serviceOtaHealth();
+  if (assetsRemapPending) {
+    mapAssets();
+    // The blob's config defaults take effect now, under the settings saved over /config
+    RuntimeConfig previous = config;
+    loadConfig();
+    configChanged(previous);
+    assetsRemapPending = false;
+  }
+  serviceReplication();
+  serviceCrdt();
+  processBeamEdges();
 
-  // Passive Status Update (the web interface fetches status via AJAX, but we update the internal state periodically)
-  if (millis() - lastSensorReadTime > sensorInterval) {
-    updateStatus();
-    lastSensorReadTime = millis();
+  // A standby only mirrors the primary; the gate and the bay sensors belong to the primary
+  if (isActiveController()) {
+    serviceGateHold();
+    serviceLaneQueue();
+    serviceFailedBays();
+  }
+
+  // Wake the sequences whose echo, command or timer has come
+  if (echo.done) {
+    coFire(echoSignal);
+  }
+  if (pendingGateCommand != GATE_COMMAND_NONE && isActiveController()) {
+    coFire(gateCommandSignal);
+  }
+  coRun(sequences, monoUs());
+  refreshStatusCache();
+
+  int64_t now = monoUs();
+  if (lastLoopUs != 0) {
+    recordTiming(loopGap, now - lastLoopUs);
   }
+  lastLoopUs = now;
 }
@@ -0,0 +1,36 @@
+/*
+  Monotonic Clock
+
+  The one timebase for scheduling, event and log timestamps, and latency metrics: a
+  64-bit count of microseconds since boot that never goes backwards. millis() wraps
+  after 49.7 days and micros() after 71.6 minutes, so comparisons across a wrap go
+  wrong on boards that run for months, and millisecond stamps hide the jitter the
+  latency and timing metrics are meant to show. At 64 bits the count runs for
+  292,000 years, so plain subtraction and comparison are always safe.
+
+  On the ESP32 this is esp_timer (safe to call from interrupts); on Linux, where the
+  tools and simulators share code with the sketch, it is CLOCK_MONOTONIC.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#if defined(ESP_PLATFORM)
+#include <esp_timer.h>
+
+__attribute__((always_inline)) inline int64_t monoUs() {
+  return esp_timer_get_time();
+}
+#else
+#include <time.h>
+
+inline int64_t monoUs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+#endif
+
+const int64_t MONO_MS = 1000;    // Microseconds per millisecond, e.g. monoUs() + holdMs * MONO_MS
+const int64_t MONO_S = 1000000;  // Microseconds per second
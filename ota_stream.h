@@ -0,0 +1,259 @@
+/*
+  Streaming Firmware Update
+
+  Writes a firmware image to the inactive app partition as it is downloaded, one
+  flash sector at a time, and verifies it before it may be booted. Erasing and
+  programming flash stalls every task that runs code from flash on both ESP32 cores
+  (the cache is off meanwhile), so the writer never does more than one sector per
+  call: the caller decides when each burst may run and how long to wait between
+  them, which bounds how much a burst can delay sensing.
+
+  1. otaBegin() with the image size and its expected SHA-256.
+  2. otaFeed() the download; whenever otaSectorReady(), run the burst otaWriteSector().
+  3. Once everything is written, otaVerifyStep() until it returns false. It reads the
+     image back one sector per call and compares both the streamed and the
+     read-back digest with the expected one, so a flash fault is caught as well as
+     a corrupt download.
+
+  The asset partition (assets.h) is updated the same way, with its own magic byte.
+
+  Flash is reached through OtaFlash: esp_partition_* on the board, a file-backed
+  emulator in tools/ota_test.cpp on Linux. Switching to the new image, and the health
+  check that keeps it or rolls it back, are in section 17 of main.c.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+const uint32_t OTA_SECTOR_BYTES = 4096; // Flash erase unit, and the most one burst writes
+const uint8_t OTA_IMAGE_MAGIC = 0xE9;   // First byte of every ESP32 app image
+
+// ---- SHA-256 (FIPS 180-4), small and portable so the board and the tools agree ----
+
+struct Sha256 {
+  uint32_t state[8];
+  uint64_t length;      // Bytes hashed so far
+  uint8_t block[64];
+  uint32_t fill;
+};
+
+inline uint32_t sha256Rotr(uint32_t x, int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+inline void sha256Block(Sha256& h, const uint8_t* p) {
+  static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+  };
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++) {
+    w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+  }
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = sha256Rotr(w[i - 15], 7) ^ sha256Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = sha256Rotr(w[i - 2], 17) ^ sha256Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+  uint32_t a = h.state[0], b = h.state[1], c = h.state[2], d = h.state[3];
+  uint32_t e = h.state[4], f = h.state[5], g = h.state[6], k = h.state[7];
+  for (int i = 0; i < 64; i++) {
+    uint32_t t1 = k + (sha256Rotr(e, 6) ^ sha256Rotr(e, 11) ^ sha256Rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+    uint32_t t2 = (sha256Rotr(a, 2) ^ sha256Rotr(a, 13) ^ sha256Rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    k = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  h.state[0] += a;
+  h.state[1] += b;
+  h.state[2] += c;
+  h.state[3] += d;
+  h.state[4] += e;
+  h.state[5] += f;
+  h.state[6] += g;
+  h.state[7] += k;
+}
+
+inline void sha256Init(Sha256& h) {
+  static const uint32_t H0[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+  memcpy(h.state, H0, sizeof(H0));
+  h.length = 0;
+  h.fill = 0;
+}
+
+inline void sha256Update(Sha256& h, const uint8_t* data, uint32_t len) {
+  h.length += len;
+  while (len > 0) {
+    uint32_t n = 64 - h.fill < len ? 64 - h.fill : len;
+    memcpy(h.block + h.fill, data, n);
+    h.fill += n;
+    data += n;
+    len -= n;
+    if (h.fill == 64) {
+      sha256Block(h, h.block);
+      h.fill = 0;
+    }
+  }
+}
+
+inline void sha256Final(Sha256& h, uint8_t digest[32]) {
+  uint64_t bits = h.length * 8;
+  uint8_t pad = 0x80;
+  sha256Update(h, &pad, 1);
+  pad = 0;
+  while (h.fill != 56) {
+    sha256Update(h, &pad, 1);
+  }
+  uint8_t lengthBytes[8];
+  for (int i = 0; i < 8; i++) {
+    lengthBytes[i] = bits >> (56 - 8 * i);
+  }
+  sha256Update(h, lengthBytes, 8);
+  for (int i = 0; i < 8; i++) {
+    digest[4 * i] = h.state[i] >> 24;
+    digest[4 * i + 1] = h.state[i] >> 16;
+    digest[4 * i + 2] = h.state[i] >> 8;
+    digest[4 * i + 3] = h.state[i];
+  }
+}
+
+// Parses 64 hex digits; returns false if `hex` is anything else
+inline bool sha256FromHex(const char* hex, uint8_t digest[32]) {
+  for (int i = 0; i < 64; i++) {
+    char c = hex[i];
+    int v = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    if (v < 0) {
+      return false;
+    }
+    digest[i / 2] = i % 2 == 0 ? v << 4 : digest[i / 2] | v;
+  }
+  return hex[64] == '\0';
+}
+
+// ---- Update writer ----
+
+// The target partition. Offsets are relative to its start; erase takes whole sectors.
+struct OtaFlash {
+  void* ctx;
+  uint32_t size;
+  bool (*erase)(void* ctx, uint32_t offset, uint32_t len);
+  bool (*write)(void* ctx, uint32_t offset, const uint8_t* data, uint32_t len);
+  bool (*read)(void* ctx, uint32_t offset, uint8_t* data, uint32_t len);
+};
+
+enum OtaError : uint8_t {
+  OTA_OK,
+  OTA_ERR_SIZE,      // Image empty or larger than the partition
+  OTA_ERR_IMAGE,     // Wrong magic byte: not an ESP32 app image (or asset blob)
+  OTA_ERR_FLASH,     // Erase, write or read failed
+  OTA_ERR_DIGEST,    // Streamed or read-back SHA-256 differs from the expected one
+};
+const char* const OTA_ERROR_NAMES[] = { "ok", "size", "image", "flash", "digest" };
+
+struct OtaWriter {
+  OtaFlash flash;
+  uint32_t imageSize;
+  uint32_t written;    // Bytes programmed so far
+  uint32_t verified;   // Bytes read back so far
+  uint8_t expected[32];
+  Sha256 streamed;     // Over the bytes as they arrived
+  Sha256 readBack;     // Over the bytes as they are in flash
+  uint8_t sector[OTA_SECTOR_BYTES];
+  uint32_t fill;       // Bytes waiting in `sector`
+  int magic;           // Required first byte, -1 for any
+  OtaError error;
+};
+
+inline bool otaBegin(OtaWriter& w, const OtaFlash& flash, uint32_t imageSize, const uint8_t expected[32],
+                     int magic = OTA_IMAGE_MAGIC) {
+  w.flash = flash;
+  w.magic = magic;
+  w.imageSize = imageSize;
+  w.written = 0;
+  w.verified = 0;
+  w.fill = 0;
+  memcpy(w.expected, expected, 32);
+  sha256Init(w.streamed);
+  sha256Init(w.readBack);
+  w.error = imageSize == 0 || imageSize > flash.size ? OTA_ERR_SIZE : OTA_OK;
+  return w.error == OTA_OK;
+}
+
+// True once the sector buffer is full, or holds the end of the image
+inline bool otaSectorReady(const OtaWriter& w) {
+  return w.fill == OTA_SECTOR_BYTES || (w.fill > 0 && w.written + w.fill == w.imageSize);
+}
+
+// Takes downloaded bytes into the sector buffer; returns how many it took, which is
+// fewer than `len` once a sector is ready and waiting for otaWriteSector()
+inline uint32_t otaFeed(OtaWriter& w, const uint8_t* data, uint32_t len) {
+  if (w.error != OTA_OK || otaSectorReady(w)) {
+    return 0;
+  }
+  uint32_t room = OTA_SECTOR_BYTES - w.fill;
+  uint32_t left = w.imageSize - w.written - w.fill;
+  uint32_t n = len < room ? len : room;
+  n = n < left ? n : left;
+  if (w.written + w.fill == 0 && n > 0 && w.magic >= 0 && data[0] != w.magic) {
+    w.error = OTA_ERR_IMAGE;
+    return 0;
+  }
+  memcpy(w.sector + w.fill, data, n);
+  sha256Update(w.streamed, data, n);
+  w.fill += n;
+  return n;
+}
+
+// One bounded flash burst: erases the next sector and programs the buffered bytes
+inline bool otaWriteSector(OtaWriter& w) {
+  if (w.error != OTA_OK || !otaSectorReady(w)) {
+    return false;
+  }
+  if (!w.flash.erase(w.flash.ctx, w.written, OTA_SECTOR_BYTES) ||
+      !w.flash.write(w.flash.ctx, w.written, w.sector, w.fill)) {
+    w.error = OTA_ERR_FLASH;
+    return false;
+  }
+  w.written += w.fill;
+  w.fill = 0;
+  return true;
+}
+
+// Reads back one sector; returns true while there is more to check. When it returns
+// false, w.error tells whether the image is good.
+inline bool otaVerifyStep(OtaWriter& w) {
+  if (w.error != OTA_OK) {
+    return false;
+  }
+  if (w.verified < w.written) {
+    uint32_t n = w.written - w.verified < OTA_SECTOR_BYTES ? w.written - w.verified : OTA_SECTOR_BYTES;
+    if (!w.flash.read(w.flash.ctx, w.verified, w.sector, n)) {
+      w.error = OTA_ERR_FLASH;
+      return false;
+    }
+    sha256Update(w.readBack, w.sector, n);
+    w.verified += n;
+    return true;
+  }
+  uint8_t streamed[32], readBack[32];
+  sha256Final(w.streamed, streamed);
+  sha256Final(w.readBack, readBack);
+  if (w.written != w.imageSize || memcmp(streamed, w.expected, 32) != 0 || memcmp(readBack, w.expected, 32) != 0) {
+    w.error = OTA_ERR_DIGEST;
+  }
+  return false;
+}
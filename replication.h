@@ -0,0 +1,215 @@
+/*
+  Hot-Standby Replication
+
+  Two controllers share one gate. The primary drives the servo and sends its state
+  (gate position and hold timer, pending gate command, lane counters, bay occupancy)
+  to the standby over UDP whenever it changes, and at least every heartbeat
+  interval otherwise. Every message carries the complete state, so a lost packet
+  is repaired by the next one; sequence numbers let the standby drop duplicates and
+  reordered packets and count the ones that went missing.
+
+  The standby takes over once it has not heard from the primary for the failover
+  timeout. Each takeover starts a new epoch; a primary that hears a primary with a
+  higher epoch (or the same epoch and a higher priority) steps down, so a board
+  that comes back after a crash or a network split never fights the one that took
+  over. Nodes boot as standby so a restarted board first looks for a running
+  primary; the lower-priority node waits one extra timeout at boot so the preferred
+  primary wins a simultaneous power-up.
+
+  Wire format (all integers little-endian):
+    header:  'H' 'S' version(1) role(1) priority(1) reserved(1) epoch(4) sequence(4)
+    state:   gateOpen(1) pendingGateCommand(1) gateCloseInMs(4) gateHoldMs(4)
+             vehiclesIn(4) vehiclesOut(4) rejectedPassages(4) bayCount(4) occupancy
+  Only primaries send the state; occupancy is the raw bitmap, ceil(bayCount / 8) bytes.
+
+  Used by the sketch, and by tools/sim_failover.cpp on Linux.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "slot_bitmap.h"
+
+enum ReplicationRole : uint8_t {
+  ROLE_STANDBY = 0,
+  ROLE_PRIMARY = 1,
+};
+
+const uint8_t REPLICATION_VERSION = 1;
+const size_t REPLICATION_HEADER_BYTES = 14;
+const size_t REPLICATION_STATE_BYTES = 26;  // State without the occupancy bitmap
+
+struct ReplicationHeader {
+  ReplicationRole role;
+  uint8_t priority;
+  uint32_t epoch;
+  uint32_t sequence;
+};
+
+// Everything the standby needs to carry on where the primary stopped
+template <int N>
+struct ReplicatedState {
+  uint8_t gateOpen;
+  uint8_t pendingGateCommand;
+  uint32_t gateCloseInMs;  // Time left before the gate closes itself, 0 if not scheduled
+  uint32_t gateHoldMs;
+  uint32_t vehiclesIn;
+  uint32_t vehiclesOut;
+  uint32_t rejectedPassages;
+  SlotBitmap<N> occupied;
+};
+
+// Largest message for `bayCount` bays
+constexpr size_t replicationMaxBytes(int bayCount) {
+  return REPLICATION_HEADER_BYTES + REPLICATION_STATE_BYTES + (bayCount + 7) / 8;
+}
+
+// Writes a message into `buf`; pass state = nullptr for a standby heartbeat.
+// Returns the message length, or 0 if it does not fit in `cap`.
+template <int N>
+size_t replicationEncode(uint8_t* buf, size_t cap, const ReplicationHeader& header,
+                         const ReplicatedState<N>* state, int bayCount) {
+  size_t len = REPLICATION_HEADER_BYTES + (state ? REPLICATION_STATE_BYTES + (bayCount + 7) / 8 : 0);
+  if (len > cap) return 0;
+  buf[0] = 'H';
+  buf[1] = 'S';
+  buf[2] = REPLICATION_VERSION;
+  buf[3] = header.role;
+  buf[4] = header.priority;
+  buf[5] = 0;
+  putLe32(buf + 6, header.epoch);
+  putLe32(buf + 10, header.sequence);
+  if (state == nullptr) return len;
+
+  uint8_t* out = buf + REPLICATION_HEADER_BYTES;
+  out[0] = state->gateOpen;
+  out[1] = state->pendingGateCommand;
+  putLe32(out + 2, state->gateCloseInMs);
+  putLe32(out + 6, state->gateHoldMs);
+  putLe32(out + 10, state->vehiclesIn);
+  putLe32(out + 14, state->vehiclesOut);
+  putLe32(out + 18, state->rejectedPassages);
+  putLe32(out + 22, bayCount);
+  for (int b = 0; b < (bayCount + 7) / 8; b++) {
+    out[REPLICATION_STATE_BYTES + b] = state->occupied.words[b >> 2] >> ((b & 3) * 8);
+  }
+  return len;
+}
+
+// Parses a message. `hasState` tells whether it carried a state (only primaries send one).
+// Returns false if the message is malformed or is for a different number of bays.
+template <int N>
+bool replicationDecode(const uint8_t* buf, size_t len, ReplicationHeader& header,
+                       ReplicatedState<N>& state, bool& hasState, int bayCount) {
+  if (len < REPLICATION_HEADER_BYTES || buf[0] != 'H' || buf[1] != 'S' || buf[2] != REPLICATION_VERSION ||
+      buf[3] > ROLE_PRIMARY) {
+    return false;
+  }
+  header.role = (ReplicationRole)buf[3];
+  header.priority = buf[4];
+  header.epoch = getLe32(buf + 6);
+  header.sequence = getLe32(buf + 10);
+  hasState = len > REPLICATION_HEADER_BYTES;
+  if (!hasState) return true;
+
+  const uint8_t* in = buf + REPLICATION_HEADER_BYTES;
+  if (len != replicationMaxBytes(bayCount) || getLe32(in + 22) != (uint32_t)bayCount || bayCount > N) {
+    return false;
+  }
+  state.gateOpen = in[0];
+  state.pendingGateCommand = in[1];
+  state.gateCloseInMs = getLe32(in + 2);
+  state.gateHoldMs = getLe32(in + 6);
+  state.vehiclesIn = getLe32(in + 10);
+  state.vehiclesOut = getLe32(in + 14);
+  state.rejectedPassages = getLe32(in + 18);
+  state.occupied.clear();
+  for (int b = 0; b < (bayCount + 7) / 8; b++) {
+    state.occupied.words[b >> 2] |= (uint32_t)in[REPLICATION_STATE_BYTES + b] << ((b & 3) * 8);
+  }
+  return true;
+}
+
+// Role and failover bookkeeping of one controller. Times are in microseconds from
+// any monotonic clock; the caller supplies them so the logic runs the same on the
+// board and in the simulator.
+struct ReplicationNode {
+  ReplicationRole role;
+  uint8_t priority;         // Breaks ties between two primaries of the same epoch
+  uint32_t epoch;           // Highest epoch seen or owned
+  uint32_t sequence;        // Last sequence sent
+  uint32_t peerSequence;    // Last sequence accepted from the primary of `epoch`
+  bool peerSynced;          // peerSequence is valid for `epoch`
+  int64_t timeoutUs;
+  int64_t lastPrimaryUs;    // When a primary was last heard from
+  int64_t lastPeerUs;       // When the peer was last heard from, in any role
+  uint32_t received;        // Messages accepted from the primary
+  uint32_t missed;          // Sequence numbers skipped, i.e. messages lost on the way
+  uint32_t stale;           // Duplicate, reordered or outdated messages dropped
+  uint32_t failovers;       // Takeovers by this node
+  uint32_t demotions;       // Times this node stepped down for another primary
+  int64_t lastFailoverUs;   // Primary silence that preceded the last takeover
+};
+
+inline void replicationInit(ReplicationNode& node, uint8_t priority, int64_t timeoutUs, int64_t nowUs) {
+  node = {};
+  node.role = ROLE_STANDBY;
+  node.priority = priority;
+  node.timeoutUs = timeoutUs;
+  node.lastPrimaryUs = priority > 0 ? nowUs : nowUs + timeoutUs;  // Boot grace for the lower priority
+  node.lastPeerUs = nowUs - timeoutUs;
+}
+
+// Header for the next message this node sends
+inline ReplicationHeader replicationNextHeader(ReplicationNode& node) {
+  return { node.role, node.priority, node.epoch, ++node.sequence };
+}
+
+// Handles a received header. Returns true if the message comes from the current
+// primary, in order, and its state should be applied. A primary that is outranked
+// becomes a standby here; the caller sees that as role changing to ROLE_STANDBY.
+inline bool replicationReceive(ReplicationNode& node, const ReplicationHeader& header, int64_t nowUs) {
+  node.lastPeerUs = nowUs;
+  if (header.role != ROLE_PRIMARY) return false;
+  bool outranks = header.epoch > node.epoch || (header.epoch == node.epoch && header.priority > node.priority);
+  if (node.role == ROLE_PRIMARY) {
+    if (!outranks) return false;  // An older primary; it steps down when it hears from us
+    node.role = ROLE_STANDBY;
+    node.demotions++;
+  }
+  if (header.epoch < node.epoch) {
+    node.stale++;
+    return false;
+  }
+  if (header.epoch > node.epoch || !node.peerSynced) {
+    node.epoch = header.epoch;
+    node.peerSynced = true;
+  } else if ((int32_t)(header.sequence - node.peerSequence) <= 0) {
+    node.stale++;
+    return false;
+  } else {
+    node.missed += header.sequence - node.peerSequence - 1;
+  }
+  node.peerSequence = header.sequence;
+  node.lastPrimaryUs = nowUs;
+  node.received++;
+  return true;
+}
+
+// Promotes a standby whose primary has been silent for the timeout. Returns true on takeover.
+inline bool replicationCheckTakeover(ReplicationNode& node, int64_t nowUs) {
+  if (node.role != ROLE_STANDBY || nowUs - node.lastPrimaryUs <= node.timeoutUs) return false;
+  node.role = ROLE_PRIMARY;
+  node.epoch++;
+  node.sequence = 0;
+  node.peerSynced = false;
+  node.failovers++;
+  node.lastFailoverUs = nowUs - node.lastPrimaryUs;
+  return true;
+}
+
+// True while the peer has been heard from within the failover timeout
+inline bool replicationPeerUp(const ReplicationNode& node, int64_t nowUs) {
+  return nowUs - node.lastPeerUs <= node.timeoutUs;
+}
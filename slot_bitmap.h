@@ -0,0 +1,254 @@
+/*
+  Slot Bitmaps
+
+  Fixed-size bitmaps with one bit per slot (occupied, reserved, faulty, zone
+  membership, ...), word-wise set operations for queries such as "free and not
+  reserved in zone 3", and a compact wire format for shipping them over HTTP or
+  between boards.
+
+  Wire format (all integers little-endian):
+    header:  'S' 'B' version(1) bitmapCount(1) slotCount(4)
+    bitmap:  kind(1) encoding(1) payloadLength(4) payload
+  Encoding 0 is the raw words, truncated to ceil(slotCount / 8) bytes.
+  Encoding 1 is run-length: LEB128 varints giving alternating runs of clear and
+  set bits, starting with a (possibly empty) clear run. The encoder picks
+  whichever is smaller, so the payload is never larger than the raw bitmap.
+
+  Used by the sketch, and by tools/bench_slot_bitmap.cpp on Linux.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// What a bitmap in a wire message describes
+enum SlotBitmapKind : uint8_t {
+  BITMAP_OCCUPIED = 0,
+  BITMAP_RESERVED = 1,
+  BITMAP_FAULTY = 2,
+  BITMAP_QUERY = 3,  // Result of a query, e.g. free slots in one zone
+};
+
+enum SlotBitmapEncoding : uint8_t {
+  BITMAP_RAW = 0,
+  BITMAP_RLE = 1,
+};
+
+const uint8_t SLOT_BITMAP_VERSION = 1;
+const size_t SLOT_BITMAP_HEADER_BYTES = 8;
+const size_t SLOT_BITMAP_ENTRY_BYTES = 6;
+
+template <int N>
+struct SlotBitmap {
+  static const int WORDS = (N + 31) / 32;
+  uint32_t words[WORDS];
+
+  void clear() { memset(words, 0, sizeof(words)); }
+
+  bool test(int i) const { return (words[i >> 5] >> (i & 31)) & 1; }
+
+  void set(int i, bool value) {
+    uint32_t mask = 1u << (i & 31);
+    if (value) {
+      words[i >> 5] |= mask;
+    } else {
+      words[i >> 5] &= ~mask;
+    }
+  }
+
+  int count() const {
+    int total = 0;
+    for (int w = 0; w < WORDS; w++) total += __builtin_popcount(words[w]);
+    return total;
+  }
+
+  SlotBitmap& operator&=(const SlotBitmap& other) {
+    for (int w = 0; w < WORDS; w++) words[w] &= other.words[w];
+    return *this;
+  }
+
+  SlotBitmap& operator|=(const SlotBitmap& other) {
+    for (int w = 0; w < WORDS; w++) words[w] |= other.words[w];
+    return *this;
+  }
+
+  // Clears every bit that is set in `other`
+  SlotBitmap& andNot(const SlotBitmap& other) {
+    for (int w = 0; w < WORDS; w++) words[w] &= ~other.words[w];
+    return *this;
+  }
+
+  // Index of the first bit at or after `from` whose value is `value`, or `bits` if none
+  int next(int from, bool value, int bits) const {
+    if (from >= bits) return bits;
+    int w = from >> 5;
+    uint32_t flip = value ? 0 : 0xFFFFFFFFu;
+    uint32_t word = (words[w] ^ flip) & (0xFFFFFFFFu << (from & 31));
+    while (word == 0) {
+      if (++w >= WORDS) return bits;
+      word = words[w] ^ flip;
+    }
+    int found = (w << 5) + __builtin_ctz(word);
+    return found < bits ? found : bits;
+  }
+
+  // Sets bits [from, to)
+  void fill(int from, int to) {
+    while (from < to && (from & 31)) set(from++, true);
+    while (from + 32 <= to) {
+      words[from >> 5] = 0xFFFFFFFFu;
+      from += 32;
+    }
+    while (from < to) set(from++, true);
+  }
+};
+
+inline size_t putVarint(uint8_t* out, size_t cap, size_t pos, uint32_t value) {
+  do {
+    if (pos >= cap) return 0;
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    out[pos++] = byte | (value ? 0x80 : 0);
+  } while (value);
+  return pos;
+}
+
+inline size_t getVarint(const uint8_t* in, size_t len, size_t pos, uint32_t* value) {
+  uint32_t result = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (pos >= len) return 0;
+    uint8_t byte = in[pos++];
+    result |= (uint32_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return pos;
+    }
+  }
+  return 0;
+}
+
+// Run-length encodes the first `bits` bits. Returns the payload size, or 0 if it does not fit in `cap`.
+template <int N>
+size_t rleEncode(const SlotBitmap<N>& bitmap, int bits, uint8_t* out, size_t cap) {
+  size_t pos = 0;
+  int at = 0;
+  bool value = false;
+  while (at < bits) {
+    int end = bitmap.next(at, !value, bits);
+    pos = putVarint(out, cap, pos, (uint32_t)(end - at));
+    if (pos == 0) return 0;
+    at = end;
+    value = !value;
+  }
+  return pos;
+}
+
+template <int N>
+bool rleDecode(const uint8_t* in, size_t len, int bits, SlotBitmap<N>& bitmap) {
+  bitmap.clear();
+  size_t pos = 0;
+  int at = 0;
+  bool value = false;
+  while (pos < len) {
+    uint32_t run;
+    pos = getVarint(in, len, pos, &run);
+    if (pos == 0 || run > (uint32_t)(bits - at)) return false;
+    if (value) bitmap.fill(at, at + run);
+    at += run;
+    value = !value;
+  }
+  return at == bits;
+}
+
+inline void putLe32(uint8_t* out, uint32_t value) {
+  out[0] = value;
+  out[1] = value >> 8;
+  out[2] = value >> 16;
+  out[3] = value >> 24;
+}
+
+inline uint32_t getLe32(const uint8_t* in) {
+  return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+// Builds a wire message in a caller-provided buffer
+struct SlotBitmapWriter {
+  uint8_t* buf;
+  size_t cap;
+  size_t len;
+  int slotCount;
+  bool ok;
+};
+
+// Upper bound on the message size for `bitmaps` bitmaps of `slotCount` slots
+constexpr size_t slotBitmapMaxBytes(int slotCount, int bitmaps) {
+  return SLOT_BITMAP_HEADER_BYTES + bitmaps * (SLOT_BITMAP_ENTRY_BYTES + (slotCount + 7) / 8);
+}
+
+inline void slotBitmapBegin(SlotBitmapWriter& writer, uint8_t* buf, size_t cap, int slotCount) {
+  writer = { buf, cap, SLOT_BITMAP_HEADER_BYTES, slotCount, cap >= SLOT_BITMAP_HEADER_BYTES };
+  if (!writer.ok) return;
+  buf[0] = 'S';
+  buf[1] = 'B';
+  buf[2] = SLOT_BITMAP_VERSION;
+  buf[3] = 0;
+  putLe32(buf + 4, slotCount);
+}
+
+template <int N>
+void slotBitmapAdd(SlotBitmapWriter& writer, SlotBitmapKind kind, const SlotBitmap<N>& bitmap) {
+  size_t rawBytes = (writer.slotCount + 7) / 8;
+  if (!writer.ok || writer.len + SLOT_BITMAP_ENTRY_BYTES + rawBytes > writer.cap) {
+    writer.ok = false;
+    return;
+  }
+  uint8_t* entry = writer.buf + writer.len;
+  uint8_t* payload = entry + SLOT_BITMAP_ENTRY_BYTES;
+  // Anything at least as long as the raw bitmap is not worth run-length encoding
+  size_t rleBytes = rleEncode(bitmap, writer.slotCount, payload, rawBytes > 0 ? rawBytes - 1 : 0);
+  entry[0] = kind;
+  if (rleBytes > 0 || writer.slotCount == 0) {
+    entry[1] = BITMAP_RLE;
+    putLe32(entry + 2, rleBytes);
+  } else {
+    entry[1] = BITMAP_RAW;
+    for (size_t b = 0; b < rawBytes; b++) payload[b] = bitmap.words[b >> 2] >> ((b & 3) * 8);
+    putLe32(entry + 2, rawBytes);
+    rleBytes = rawBytes;
+  }
+  writer.len += SLOT_BITMAP_ENTRY_BYTES + rleBytes;
+  writer.buf[3]++;
+}
+
+// Finds the bitmap of the given kind in a wire message and decodes it.
+// Returns false if the message is malformed, has a different slot count, or lacks that bitmap.
+template <int N>
+bool slotBitmapFind(const uint8_t* msg, size_t len, SlotBitmapKind kind, int slotCount, SlotBitmap<N>& bitmap) {
+  if (len < SLOT_BITMAP_HEADER_BYTES || msg[0] != 'S' || msg[1] != 'B' || msg[2] != SLOT_BITMAP_VERSION ||
+      getLe32(msg + 4) != (uint32_t)slotCount || slotCount > N) {
+    return false;
+  }
+  size_t pos = SLOT_BITMAP_HEADER_BYTES;
+  for (int i = 0; i < msg[3]; i++) {
+    if (pos + SLOT_BITMAP_ENTRY_BYTES > len) return false;
+    uint8_t entryKind = msg[pos];
+    uint8_t encoding = msg[pos + 1];
+    size_t payloadLen = getLe32(msg + pos + 2);
+    const uint8_t* payload = msg + pos + SLOT_BITMAP_ENTRY_BYTES;
+    pos += SLOT_BITMAP_ENTRY_BYTES;
+    if (payloadLen > len - pos) return false;
+    pos += payloadLen;
+    if (entryKind != kind) continue;
+
+    if (encoding == BITMAP_RLE) {
+      return rleDecode(payload, payloadLen, slotCount, bitmap);
+    }
+    if (encoding != BITMAP_RAW || payloadLen != (size_t)(slotCount + 7) / 8) return false;
+    bitmap.clear();
+    for (size_t b = 0; b < payloadLen; b++) bitmap.words[b >> 2] |= (uint32_t)payload[b] << ((b & 3) * 8);
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,55 @@
+/*
+  Single-Producer Single-Consumer Ring
+
+  A fixed-size queue between exactly one writer and one reader that may run on
+  different cores, with no locks: each side only advances its own index, and the
+  indexes are published with release/acquire ordering so an item is fully written
+  before the reader can see it. The producer never waits; when the ring is full the
+  push fails and the caller drops the item.
+
+  N must be a power of two. Used by the sketch's raw sample stream.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+template <typename T, uint32_t N>
+struct SpscRing {
+  static_assert((N & (N - 1)) == 0, "SpscRing size must be a power of two");
+  T items[N];
+  std::atomic<uint32_t> head{0}; // Next slot to write; only the producer stores it
+  std::atomic<uint32_t> tail{0}; // Next slot to read; only the consumer stores it
+};
+
+// Producer: appends an item; returns false (and leaves the ring alone) if it is full
+template <typename T, uint32_t N>
+bool spscPush(SpscRing<T, N>& ring, const T& item) {
+  uint32_t head = ring.head.load(std::memory_order_relaxed);
+  if (head - ring.tail.load(std::memory_order_acquire) == N) {
+    return false;
+  }
+  ring.items[head & (N - 1)] = item;
+  ring.head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+// Consumer: takes up to `max` items into `out`; returns how many
+template <typename T, uint32_t N>
+uint32_t spscPop(SpscRing<T, N>& ring, T* out, uint32_t max) {
+  uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+  uint32_t available = ring.head.load(std::memory_order_acquire) - tail;
+  uint32_t n = available < max ? available : max;
+  for (uint32_t i = 0; i < n; i++) {
+    out[i] = ring.items[(tail + i) & (N - 1)];
+  }
+  ring.tail.store(tail + n, std::memory_order_release);
+  return n;
+}
+
+// Consumer: discards everything queued, e.g. when a new reader attaches
+template <typename T, uint32_t N>
+void spscClear(SpscRing<T, N>& ring) {
+  ring.tail.store(ring.head.load(std::memory_order_acquire), std::memory_order_release);
+}
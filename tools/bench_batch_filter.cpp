@@ -0,0 +1,77 @@
+/*
+  Batch filter benchmark (Linux host)
+
+  Compares the scalar and SIMD paths of batch_filter.h across sensor counts,
+  checks that they produce bit-identical output, and prints throughput.
+
+  Build and run from the repository root:
+    g++ -O2 -msse2 -I. tools/bench_batch_filter.cpp -o bench_batch_filter && ./bench_batch_filter
+    g++ -O2 -mavx2 -I. tools/bench_batch_filter.cpp -o bench_batch_filter && ./bench_batch_filter
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "batch_filter.h"
+
+struct FilterBuffers {
+  std::vector<int16_t> prev1, prev2;
+  std::vector<int32_t> ema;
+  BatchFilterState state;
+
+  FilterBuffers(int sensors, const std::vector<int16_t>& initial)
+      : prev1(sensors), prev2(sensors), ema(sensors) {
+    state = { sensors, prev1.data(), prev2.data(), ema.data() };
+    batchFilterReset(state, initial.data());
+  }
+};
+
+typedef void (*FilterFn)(BatchFilterState&, const int16_t*, int16_t*, int);
+
+// Returns samples per second over `passes` passes of the whole block
+double measure(FilterFn fn, FilterBuffers& buf, const std::vector<int16_t>& in, std::vector<int16_t>& out,
+               int rows, int passes) {
+  auto start = std::chrono::steady_clock::now();
+  for (int p = 0; p < passes; p++) {
+    fn(buf.state, in.data(), out.data(), rows);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return (double)rows * buf.state.sensors * passes / seconds;
+}
+
+int main() {
+  const int rows = 64;
+  const long samplesPerRun = 64L * 1024 * 1024;
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> distance(0, 4000);
+
+  printf("SIMD path: %s\n", BATCH_FILTER_SIMD_NAME);
+  printf("%8s %14s %14s %8s %s\n", "sensors", "scalar MS/s", "simd MS/s", "speedup", "bit-exact");
+  for (int sensors = 1; sensors <= 8192; sensors *= 2) {
+    int count = sensors < 4 ? sensors : sensors + 3; // Odd counts exercise the scalar tail
+    std::vector<int16_t> initial(count), in((size_t)rows * count);
+    for (auto& v : initial) v = (int16_t)distance(rng);
+    for (auto& v : in) v = (int16_t)distance(rng);
+    std::vector<int16_t> outScalar(in.size()), outSimd(in.size());
+
+    FilterBuffers checkScalar(count, initial), checkSimd(count, initial);
+    bool exact = true;
+    for (int p = 0; p < 4; p++) {
+      batchFilterScalar(checkScalar.state, in.data(), outScalar.data(), rows);
+      batchFilterSimd(checkSimd.state, in.data(), outSimd.data(), rows);
+      exact = exact && outScalar == outSimd && checkScalar.ema == checkSimd.ema;
+    }
+
+    int passes = (int)(samplesPerRun / ((long)rows * count)) + 1;
+    FilterBuffers benchScalar(count, initial), benchSimd(count, initial);
+    double scalarRate = measure(batchFilterScalar, benchScalar, in, outScalar, rows, passes);
+    double simdRate = measure(batchFilterSimd, benchSimd, in, outSimd, rows, passes);
+    printf("%8d %14.1f %14.1f %7.2fx %s\n", count, scalarRate / 1e6, simdRate / 1e6, simdRate / scalarRate,
+           exact ? "yes" : "NO");
+    if (!exact) return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,94 @@
+/*
+  Sliding-window histogram benchmark (Linux host)
+
+  Feeds distance_histogram.h a day and a half of simulated readings from a bay that
+  is empty at night and busy by day, with gaps where the sensor was not read, and
+  checks after every slice that the window matches a brute-force count of the
+  readings in it. Then prints the cost of adding one reading and of rebuilding the
+  same window from a list of timestamped readings, as a query would without slices.
+
+  Build and run from the repository root:
+    g++ -O2 -std=c++17 -I. tools/bench_histogram.cpp -o bench_histogram && ./bench_histogram
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "distance_histogram.h"
+
+const int BIN_CM = 5;
+const int BINS = 400 / BIN_CM + 1;  // As in the sketch
+const int SLICES = 12;
+const int64_t SLICE_US = 300LL * 1000000;
+const int64_t INTERVAL_US = 500000;  // The sketch's default sensor interval
+
+struct Reading {
+  int64_t timeUs;
+  int bin;
+};
+
+int main() {
+  std::mt19937 rng(7);
+  std::normal_distribution<double> empty(180, 4), parked(40, 6);
+  std::uniform_real_distribution<double> unit(0, 1);
+
+  static SlidingHistogram<BINS, SLICES> h;
+  histReset(h, SLICE_US, 0);
+  std::deque<Reading> kept;  // Every reading still in the window, for the check
+  int mismatches = 0, checks = 0;
+  long readings = 0;
+  int64_t checkAt = SLICE_US;
+
+  for (int64_t t = 0; t < 36 * 3600 * 1000000LL; t += INTERVAL_US) {
+    double hour = (t / 3600e6) - 24 * (int)(t / 86400e6);
+    if (hour >= 2 && hour < 2.5) {
+      continue;  // Sensor not read for half an hour: whole slices go by empty
+    }
+    bool busy = hour >= 8 && hour < 18 && unit(rng) < 0.7;
+    double cm = unit(rng) < 0.01 ? 400 : busy ? parked(rng) : empty(rng);
+    int bin = cm >= 400 ? BINS - 1 : std::min(std::max((int)(cm / BIN_CM), 0), BINS - 2);
+    histAdd(h, bin, t);
+    kept.push_back({ t, bin });
+    readings++;
+
+    if (t >= checkAt) {
+      // The window holds the current slice and the SLICES - 1 before it
+      int64_t windowStart = h.sliceEndUs - SLICE_US * SLICES;
+      while (!kept.empty() && kept.front().timeUs < windowStart) kept.pop_front();
+      std::vector<uint32_t> expected(BINS);
+      for (const Reading& r : kept) expected[r.bin]++;
+      for (int b = 0; b < BINS; b++) mismatches += expected[b] != h.total[b];
+      checks++;
+      checkAt += SLICE_US;
+    }
+  }
+  printf("%ld readings, %d window checks, %d bin mismatches\n", readings, checks, mismatches);
+
+  const int ADDS = 20000000;
+  int64_t t = h.sliceEndUs;
+  auto start = std::chrono::steady_clock::now();
+  for (int n = 0; n < ADDS; n++) {
+    t += INTERVAL_US;
+    histAdd(h, n % BINS, t);
+  }
+  double addNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ADDS;
+
+  const int QUERIES = 200;
+  volatile uint32_t sink = 0;  // Keeps the rebuilds from being optimised away
+  start = std::chrono::steady_clock::now();
+  for (int q = 0; q < QUERIES; q++) {
+    std::vector<uint32_t> counts(BINS);
+    for (const Reading& r : kept) counts[r.bin]++;
+    sink = sink + counts[q % BINS];
+  }
+  double rebuildUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / QUERIES;
+  printf("add: %.1f ns per reading (slice turnover included)\n", addNs);
+  printf("rebuild from %zu stored readings: %.1f us per query\n", kept.size(), rebuildUs);
+  printf("memory: %zu bytes per window, vs %zu bytes to store an hour of readings\n", sizeof(h),
+         (size_t)(3600000000LL / INTERVAL_US) * sizeof(Reading));
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+/*
+  Slot bitmap benchmark (Linux host)
+
+  Measures wire-format encode/decode and set-operation throughput of
+  slot_bitmap.h at 10k slots for a few occupancy patterns, and checks that
+  every message decodes back to the bitmaps it was built from. Also times a
+  /slots query ("free EV bays in one zone", first 100 listed) at growing lot sizes.
+
+  Build and run from the repository root:
+    g++ -O2 -I. tools/bench_slot_bitmap.cpp -o bench_slot_bitmap && ./bench_slot_bitmap
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "slot_bitmap.h"
+
+const int SLOTS = 10000;
+const int ZONES = 8;
+typedef SlotBitmap<SLOTS> Bitmap;
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Occupancy where a slot's state tends to repeat its neighbour's, giving runs of about `runLength`
+void makePattern(Bitmap& bitmap, std::mt19937& rng, double density, int runLength) {
+  std::uniform_real_distribution<double> uniform(0, 1);
+  bitmap.clear();
+  bool value = uniform(rng) < density;
+  for (int i = 0; i < SLOTS; i++) {
+    if (uniform(rng) < 1.0 / runLength) value = uniform(rng) < density;
+    bitmap.set(i, value);
+  }
+}
+
+// Times the firmware's /slots query over `Slots` slots: zone AND free AND ev, count, list the first 100
+template <int Slots>
+void benchSlotsQuery(std::mt19937& rng) {
+  typedef SlotBitmap<Slots> Index;
+  std::unique_ptr<Index[]> index(new Index[3 + ZONES]);
+  Index& all = index[0];
+  Index& freeSlots = index[1];
+  Index& ev = index[2];
+  all.clear();
+  all.fill(0, Slots);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  freeSlots.clear();
+  ev.clear();
+  for (int i = 0; i < Slots; i++) {
+    freeSlots.set(i, uniform(rng) < 0.3);
+    ev.set(i, uniform(rng) < 0.1);
+  }
+  for (int z = 0; z < ZONES; z++) {
+    index[3 + z].clear();
+    index[3 + z].fill(z * Slots / ZONES, (z + 1) * Slots / ZONES);
+  }
+
+  const int queries = 20000000 / Slots + 1000;
+  long checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int n = 0; n < queries; n++) {
+    Index match = all;
+    match &= index[3 + n % ZONES];
+    match &= freeSlots;
+    match &= ev;
+    checksum += match.count();
+    int listed = 0;
+    for (int i = match.next(0, true, Slots); i < Slots && listed < 100; i = match.next(i + 1, true, Slots)) {
+      checksum += i;
+      listed++;
+    }
+  }
+  double seconds = secondsSince(start);
+  printf("/slots query, %6d slots: %8.2f us each (checksum %ld)\n", Slots, seconds / queries * 1e6, checksum);
+}
+
+int main() {
+  std::mt19937 rng(7);
+  struct Pattern { const char* name; double density; int runLength; };
+  const Pattern patterns[] = {
+    { "random 50%", 0.5, 1 },
+    { "sparse 5%", 0.05, 1 },
+    { "rows of ~20", 0.5, 20 },
+    { "mostly full", 0.97, 50 },
+  };
+
+  std::vector<uint8_t> buffer(slotBitmapMaxBytes(SLOTS, 3));
+  printf("%d slots, 3 bitmaps per message (raw size %zu bytes)\n", SLOTS, buffer.size());
+  printf("%-12s %10s %14s %14s\n", "pattern", "msg bytes", "encode msg/s", "decode msg/s");
+  for (const Pattern& p : patterns) {
+    Bitmap occupied, reserved, faulty;
+    makePattern(occupied, rng, p.density, p.runLength);
+    makePattern(reserved, rng, 0.02, p.runLength);
+    makePattern(faulty, rng, 0.005, 1);
+
+    SlotBitmapWriter writer;
+    const int encodes = 20000;
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < encodes; n++) {
+      slotBitmapBegin(writer, buffer.data(), buffer.size(), SLOTS);
+      slotBitmapAdd(writer, BITMAP_OCCUPIED, occupied);
+      slotBitmapAdd(writer, BITMAP_RESERVED, reserved);
+      slotBitmapAdd(writer, BITMAP_FAULTY, faulty);
+    }
+    double encodeRate = encodes / secondsSince(start);
+
+    Bitmap decoded[3];
+    start = std::chrono::steady_clock::now();
+    bool ok = true;
+    for (int n = 0; n < encodes; n++) {
+      ok &= slotBitmapFind(buffer.data(), writer.len, BITMAP_OCCUPIED, SLOTS, decoded[0]);
+      ok &= slotBitmapFind(buffer.data(), writer.len, BITMAP_RESERVED, SLOTS, decoded[1]);
+      ok &= slotBitmapFind(buffer.data(), writer.len, BITMAP_FAULTY, SLOTS, decoded[2]);
+    }
+    double decodeRate = encodes / secondsSince(start);
+    ok &= writer.ok && memcmp(decoded[0].words, occupied.words, sizeof(occupied.words)) == 0 &&
+          memcmp(decoded[1].words, reserved.words, sizeof(reserved.words)) == 0 &&
+          memcmp(decoded[2].words, faulty.words, sizeof(faulty.words)) == 0;
+    printf("%-12s %10zu %14.0f %14.0f%s\n", p.name, writer.len, encodeRate, decodeRate, ok ? "" : "  ROUND TRIP FAILED");
+    if (!ok) return 1;
+  }
+
+  // "Free and not reserved in zone z" for every zone, as the firmware answers it
+  Bitmap occupied, reserved, faulty, zones[ZONES];
+  makePattern(occupied, rng, 0.6, 4);
+  makePattern(reserved, rng, 0.05, 10);
+  makePattern(faulty, rng, 0.01, 1);
+  for (int z = 0; z < ZONES; z++) {
+    zones[z].clear();
+    zones[z].fill(z * SLOTS / ZONES, (z + 1) * SLOTS / ZONES);
+  }
+  const int queries = 1000000;
+  long found = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int n = 0; n < queries; n++) {
+    Bitmap result = zones[n % ZONES];
+    result.andNot(occupied).andNot(reserved).andNot(faulty);
+    found += result.count();
+  }
+  double seconds = secondsSince(start);
+  printf("set ops: %.0f zone queries/s (%.1f ns each, checksum %ld)\n", queries / seconds, seconds / queries * 1e9, found);
+
+  benchSlotsQuery<1000>(rng);
+  benchSlotsQuery<10000>(rng);
+  benchSlotsQuery<100000>(rng);
+  return 0;
+}
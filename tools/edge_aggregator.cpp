@@ -0,0 +1,705 @@
+/*
+  Smart Parking Edge Aggregator (Linux)
+
+  Polls /status on many ESP32 boards, keeps an in-memory model of the whole lot,
+  and serves it to dashboards, signs and phones so they never hit the boards
+  directly. Responses are serialised once per model change into immutable
+  buffers that every client connection shares (serialise-once fan-out), and are
+  served by several epoll worker threads sharing the port through SO_REUSEPORT.
+
+  Endpoints:
+    /         Small HTML dashboard
+    /lot      Lot-wide totals as JSON
+    /boards   Per-board state, including each board's last /status, as JSON
+    /metrics  Aggregator counters in the Prometheus text format
+
+  Build from the repository root:
+    g++ -O2 -std=c++17 -pthread tools/edge_aggregator.cpp -o edge_aggregator
+
+  Run against real boards:
+    ./edge_aggregator --listen 8080 --board 192.168.1.100 --board 192.168.1.101:80
+
+  Load test without hardware (200 simulated boards, 64 keep-alive clients for 10 s):
+    ./edge_aggregator --simulate 200 --load-clients 64 --load-seconds 10
+*/
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+typedef std::shared_ptr<const std::string> Response;
+
+static std::atomic<bool> running(true);
+
+static int64_t nowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// ------------------------------------
+// HTTP helpers
+// ------------------------------------
+
+static Response makeResponse(int code, const char* type, const std::string& body) {
+  const char* reason = code == 200 ? "OK" : code == 404 ? "Not Found" : "Service Unavailable";
+  auto out = std::make_shared<std::string>();
+  out->reserve(body.size() + 160);
+  *out += "HTTP/1.1 " + std::to_string(code) + " " + reason + "\r\n";
+  *out += "Content-Type: " + std::string(type) + "\r\n";
+  *out += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+  *out += "Cache-Control: no-cache\r\nAccess-Control-Allow-Origin: *\r\nConnection: keep-alive\r\n\r\n";
+  *out += body;
+  return out;
+}
+
+// Numeric value of "key": in a flat JSON object, or `fallback` if absent
+static long jsonNumber(const std::string& json, const char* key, long fallback) {
+  std::string needle = std::string("\"") + key + "\":";
+  size_t at = json.find(needle);
+  if (at == std::string::npos) return fallback;
+  return strtol(json.c_str() + at + needle.size(), nullptr, 10);
+}
+
+// Counts the objects in a board's "bays" array, and those with "occupied":true, wherever
+// that field sits in each object
+static void countBays(const std::string& json, long& bays, long& occupied) {
+  size_t at = json.find("\"bays\":[");
+  if (at == std::string::npos) return;
+  int depth = 0;
+  bool inString = false;
+  size_t objectStart = 0;
+  for (size_t i = at + 8; i < json.size(); i++) {
+    char c = json[i];
+    if (inString) {
+      if (c == '\\') i++;
+      else if (c == '"') inString = false;
+    } else if (c == '"') {
+      inString = true;
+    } else if (c == '{' || c == '[') {
+      if (depth++ == 0) objectStart = i;
+    } else if (c == '}' || c == ']') {
+      if (depth == 0) return;  // End of the array
+      if (--depth == 0) {
+        bays++;
+        occupied += json.substr(objectStart, i + 1 - objectStart).find("\"occupied\":true") != std::string::npos;
+      }
+    }
+  }
+}
+
+static void setNonBlocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+// Blocking HTTP GET with a timeout; returns false on any network or HTTP error
+static bool httpGet(const std::string& host, int port, const char* path, std::string& body, int timeoutMs) {
+  addrinfo hints = {}, *addr = nullptr;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addr) != 0) return false;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    freeaddrinfo(addr);
+    return false;
+  }
+  setNonBlocking(fd);
+  int rc = connect(fd, addr->ai_addr, addr->ai_addrlen);
+  freeaddrinfo(addr);
+  pollfd pfd = { fd, POLLOUT, 0 };
+  int err = 0;
+  socklen_t errLen = sizeof(err);
+  if ((rc < 0 && errno != EINPROGRESS) || (rc < 0 && poll(&pfd, 1, timeoutMs) != 1) ||
+      getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errLen) < 0 || err != 0) {
+    close(fd);
+    return false;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+  timeval tv = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  std::string request = std::string("GET ") + path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n";
+  if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size()) {
+    close(fd);
+    return false;
+  }
+  std::string reply;
+  char buf[4096];
+  ssize_t n;
+  while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) reply.append(buf, n);
+  close(fd);
+
+  size_t headerEnd = reply.find("\r\n\r\n");
+  // "HTTP/1.x 200": anything shorter, or not HTTP at all, is a failed poll
+  if (n < 0 || headerEnd == std::string::npos || reply.size() < 12 || reply.compare(0, 5, "HTTP/") != 0 ||
+      reply.compare(9, 3, "200") != 0) {
+    return false;
+  }
+  body = reply.substr(headerEnd + 4);
+  return true;
+}
+
+// ------------------------------------
+// Lot model
+// ------------------------------------
+
+struct Board {
+  std::string host;
+  int port;
+  bool online = false;
+  int64_t updatedMs = 0;
+  std::string status;  // Last /status body from the board
+  unsigned long polls = 0;
+  unsigned long failures = 0;
+};
+
+// Pre-serialised responses for one version of the model, shared by all clients
+struct Snapshot {
+  uint64_t version;
+  Response lot;
+  Response boards;
+};
+
+class LotModel {
+ public:
+  explicit LotModel(std::vector<Board> boards) : boards_(std::move(boards)) {
+    publish();
+  }
+
+  size_t size() const { return boards_.size(); }
+
+  Board endpoint(size_t i) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return boards_[i];
+  }
+
+  void update(size_t i, bool ok, const std::string& status) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Board& board = boards_[i];
+    board.polls++;
+    if (!ok) {
+      board.failures++;
+      if (!board.online) return;
+      board.online = false;
+    } else {
+      if (board.online && board.status == status) return;
+      board.online = true;
+      board.status = status;
+    }
+    board.updatedMs = nowMs();
+    version_++;
+  }
+
+  // Serialises the model if it changed since the last snapshot
+  void publishIfChanged() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (snapshot()->version == version_) return;
+    }
+    publish();
+  }
+
+  std::shared_ptr<const Snapshot> snapshot() const { return std::atomic_load(&snapshot_); }
+
+  void totals(unsigned long& polls, unsigned long& failures, size_t& online) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    polls = failures = online = 0;
+    for (const Board& b : boards_) {
+      polls += b.polls;
+      failures += b.failures;
+      online += b.online;
+    }
+  }
+
+ private:
+  void publish() {
+    std::string lot, list = "[";
+    long bays = 0, occupied = 0, lotFree = 0, capacity = 0, in = 0, out = 0;
+    size_t online = 0;
+    uint64_t version;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      version = version_;
+      for (size_t i = 0; i < boards_.size(); i++) {
+        const Board& b = boards_[i];
+        if (b.online) {
+          online++;
+          countBays(b.status, bays, occupied);
+          lotFree += jsonNumber(b.status, "lot_free", 0);
+          capacity += jsonNumber(b.status, "lot_capacity", 0);
+          in += jsonNumber(b.status, "vehicles_in", 0);
+          out += jsonNumber(b.status, "vehicles_out", 0);
+        }
+        if (i > 0) list += ",";
+        list += "{\"address\":\"" + b.host + ":" + std::to_string(b.port) + "\"";
+        list += ",\"online\":" + std::string(b.online ? "true" : "false");
+        list += ",\"updated_ms\":" + std::to_string(b.updatedMs);
+        list += ",\"status\":" + (b.status.empty() ? std::string("null") : b.status) + "}";
+      }
+    }
+    list += "]";
+    lot = "{\"version\":" + std::to_string(version) + ",\"boards\":" + std::to_string(boards_.size()) +
+          ",\"boards_online\":" + std::to_string(online) + ",\"bays\":" + std::to_string(bays) +
+          ",\"bays_occupied\":" + std::to_string(occupied) + ",\"lot_free\":" + std::to_string(lotFree) +
+          ",\"lot_capacity\":" + std::to_string(capacity) + ",\"vehicles_in\":" + std::to_string(in) +
+          ",\"vehicles_out\":" + std::to_string(out) + ",\"published_ms\":" + std::to_string(nowMs()) + "}";
+
+    auto next = std::make_shared<Snapshot>();
+    next->version = version;
+    next->lot = makeResponse(200, "application/json", lot);
+    next->boards = makeResponse(200, "application/json", list);
+    std::atomic_store(&snapshot_, std::shared_ptr<const Snapshot>(next));
+  }
+
+  mutable std::mutex mutex_;
+  std::vector<Board> boards_;
+  uint64_t version_ = 1;
+  std::shared_ptr<const Snapshot> snapshot_;
+};
+
+// ------------------------------------
+// Epoll HTTP server
+// ------------------------------------
+
+// Maps a request path to a ready-made response
+typedef std::function<Response(const std::string& path)> Handler;
+
+struct Listener {
+  int port;
+  Handler handler;
+};
+
+class HttpServer {
+ public:
+  HttpServer(std::vector<Listener> listeners, int workers) : listeners_(std::move(listeners)) {
+    for (int w = 0; w < workers; w++) threads_.emplace_back(&HttpServer::workerLoop, this);
+  }
+
+  ~HttpServer() {
+    for (auto& t : threads_) t.join();
+  }
+
+ private:
+  struct Connection {
+    size_t listener;
+    std::string in;
+    std::deque<Response> out;  // Shared response buffers still to be written
+    size_t outOffset = 0;      // Bytes of out.front() already written
+    bool closeAfterWrite = false;
+  };
+
+  static int openListener(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)); // Kernel spreads connections over workers
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 1024) < 0) {
+      perror("listen");
+      exit(1);
+    }
+    setNonBlocking(fd);
+    return fd;
+  }
+
+  // Parses complete requests in the input buffer and queues their responses
+  void handleInput(Connection& conn) {
+    size_t end;
+    while ((end = conn.in.find("\r\n\r\n")) != std::string::npos) {
+      size_t lineEnd = conn.in.find("\r\n");
+      std::string line = conn.in.substr(0, lineEnd);
+      std::string headers = conn.in.substr(lineEnd, end - lineEnd);
+      conn.in.erase(0, end + 4);
+      for (char& c : headers) c = tolower(c);
+      size_t pathStart = line.find(' ');
+      size_t pathEnd = line.find(' ', pathStart + 1);
+      if (pathStart == std::string::npos || pathEnd == std::string::npos) {
+        conn.closeAfterWrite = true;
+        return;
+      }
+      std::string path = line.substr(pathStart + 1, pathEnd - pathStart - 1);
+      conn.out.push_back(listeners_[conn.listener].handler(path.substr(0, path.find('?'))));
+      if (headers.find("\nconnection: close") != std::string::npos || line.compare(pathEnd + 1, 8, "HTTP/1.0") == 0) {
+        conn.closeAfterWrite = true;
+        return;
+      }
+    }
+    if (conn.in.size() > 16384) conn.closeAfterWrite = true; // Oversized or garbage request
+  }
+
+  // Writes as much queued output as the socket takes; returns false if the connection is done
+  bool flush(int fd, Connection& conn) {
+    while (!conn.out.empty()) {
+      const std::string& buf = *conn.out.front();
+      ssize_t n = send(fd, buf.data() + conn.outOffset, buf.size() - conn.outOffset, MSG_NOSIGNAL);
+      if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+      conn.outOffset += n;
+      if (conn.outOffset == buf.size()) {
+        conn.out.pop_front();
+        conn.outOffset = 0;
+      }
+    }
+    return !conn.closeAfterWrite;
+  }
+
+  void workerLoop() {
+    int ep = epoll_create1(0);
+    std::vector<int> listenFds;
+    for (size_t l = 0; l < listeners_.size(); l++) {
+      int fd = openListener(listeners_[l].port);
+      listenFds.push_back(fd);
+      epoll_event ev = {};
+      ev.events = EPOLLIN;
+      ev.data.u64 = (1ull << 32) | l;  // High bit marks a listener
+      epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    std::unordered_map<int, Connection> conns;
+    epoll_event events[256];
+    while (running) {
+      int n = epoll_wait(ep, events, 256, 200);
+      for (int e = 0; e < n; e++) {
+        if (events[e].data.u64 >> 32) {
+          size_t l = events[e].data.u64 & 0xFFFFFFFF;
+          int client;
+          while ((client = accept4(listenFds[l], nullptr, nullptr, SOCK_NONBLOCK)) >= 0) {
+            int one = 1;
+            setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            epoll_event ev = {};
+            ev.events = EPOLLIN;
+            ev.data.u64 = client;
+            epoll_ctl(ep, EPOLL_CTL_ADD, client, &ev);
+            conns[client].listener = l;
+          }
+          continue;
+        }
+
+        int fd = (int)events[e].data.u64;
+        Connection& conn = conns[fd];
+        bool alive = !(events[e].events & (EPOLLERR | EPOLLHUP));
+        if (alive && (events[e].events & EPOLLIN)) {
+          char buf[4096];
+          ssize_t got;
+          while ((got = recv(fd, buf, sizeof(buf), 0)) > 0) conn.in.append(buf, got);
+          if (got == 0) conn.closeAfterWrite = true;  // Half-closed: answer what was asked, then close
+          else if (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK) alive = false;
+          handleInput(conn);
+        }
+        alive = alive && flush(fd, conn);
+        if (!alive) {
+          close(fd); // Also removes it from the epoll set
+          conns.erase(fd);
+          continue;
+        }
+        epoll_event ev = {};
+        // A connection closing after its last response has nothing more to read
+        ev.events = (conn.closeAfterWrite ? 0 : EPOLLIN) | (conn.out.empty() ? 0 : EPOLLOUT);
+        ev.data.u64 = fd;
+        epoll_ctl(ep, EPOLL_CTL_MOD, fd, &ev);
+      }
+    }
+    for (auto& c : conns) close(c.first);
+    for (int fd : listenFds) close(fd);
+    close(ep);
+  }
+
+  std::vector<Listener> listeners_;
+  std::vector<std::thread> threads_;
+};
+
+// ------------------------------------
+// Simulated boards
+// ------------------------------------
+
+// Boards that answer /status like the firmware, with bays and lane counters drifting randomly
+class SimulatedBoards {
+ public:
+  SimulatedBoards(int count, int basePort, int bays) : bays_(bays), states_(count) {
+    std::mt19937 rng(1);
+    for (int b = 0; b < count; b++) {
+      states_[b].occupied.resize(bays);
+      for (int i = 0; i < bays; i++) states_[b].occupied[i] = rng() % 2;
+      states_[b].response = std::make_shared<std::string>();
+      rebuild(b);
+    }
+    std::vector<Listener> listeners;
+    for (int b = 0; b < count; b++) {
+      listeners.push_back({ basePort + b, [this, b](const std::string&) { return response(b); } });
+    }
+    ticker_ = std::thread(&SimulatedBoards::tick, this);
+    server_.reset(new HttpServer(listeners, 1));
+  }
+
+  ~SimulatedBoards() {
+    ticker_.join();
+  }
+
+ private:
+  struct State {
+    std::vector<bool> occupied;
+    long in = 0, out = 0, version = 1;
+    Response response;
+  };
+
+  Response response(int b) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return states_[b].response;
+  }
+
+  void rebuild(int b) {
+    State& s = states_[b];
+    long parked = 0;
+    std::string json = "{\"bays\":[";
+    for (int i = 0; i < bays_; i++) {
+      if (i > 0) json += ",";
+      json += s.occupied[i] ? "{\"occupied\":true}" : "{\"occupied\":false}";
+      parked += s.occupied[i];
+    }
+    json += "],\"vehicles_in\":" + std::to_string(s.in) + ",\"vehicles_out\":" + std::to_string(s.out);
+    json += ",\"lot_free\":" + std::to_string(bays_ - parked) + ",\"lot_capacity\":" + std::to_string(bays_);
+    json += ",\"state_version\":" + std::to_string(s.version) + "}";
+    s.response = makeResponse(200, "application/json", json);
+  }
+
+  // Every 500 ms about one board in ten sees a car arrive or leave
+  void tick() {
+    std::mt19937 rng(2);
+    while (running) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(500));
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (size_t b = 0; b < states_.size(); b++) {
+        if (rng() % 10 != 0) continue;
+        State& s = states_[b];
+        int bay = rng() % bays_;
+        s.occupied[bay] = !s.occupied[bay];
+        (s.occupied[bay] ? s.in : s.out)++;
+        s.version++;
+        rebuild(b);
+      }
+    }
+  }
+
+  int bays_;
+  std::mutex mutex_;
+  std::vector<State> states_;
+  std::thread ticker_;
+  std::unique_ptr<HttpServer> server_;
+};
+
+// ------------------------------------
+// Load generator
+// ------------------------------------
+
+// Keep-alive clients requesting `path` as fast as responses come back; returns requests completed
+static unsigned long runLoad(int port, const std::string& path, int clients, int seconds) {
+  std::atomic<unsigned long> completed(0);
+  std::vector<std::thread> threads;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+  for (int c = 0; c < clients; c++) {
+    threads.emplace_back([&]() {
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+      sockaddr_in addr = {};
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(port);
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return;
+      }
+      std::string request = "GET " + path + " HTTP/1.1\r\nHost: load\r\n\r\n";
+      std::string buf;
+      char chunk[16384];
+      while (std::chrono::steady_clock::now() < deadline) {
+        if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) <= 0) break;
+        // Read one response: headers, then Content-Length bytes of body
+        size_t headerEnd;
+        while ((headerEnd = buf.find("\r\n\r\n")) == std::string::npos) {
+          ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+          if (n <= 0) goto done;
+          buf.append(chunk, n);
+        }
+        size_t total = headerEnd + 4 + jsonNumber("\"l\":" + buf.substr(buf.find("Content-Length: ") + 16), "l", 0);
+        while (buf.size() < total) {
+          ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+          if (n <= 0) goto done;
+          buf.append(chunk, n);
+        }
+        buf.erase(0, total);
+        completed++;
+      }
+    done:
+      close(fd);
+    });
+  }
+  for (auto& t : threads) t.join();
+  return completed;
+}
+
+// ------------------------------------
+// Main
+// ------------------------------------
+
+static const char* DASHBOARD_HTML = R"html(<!DOCTYPE html>
+<html lang="en"><head><meta charset="UTF-8"><title>Lot Aggregator</title>
+<style>body{font-family:sans-serif;margin:2em}td,th{padding:4px 10px;text-align:left}.off{color:#b91c1c}</style></head>
+<body><h1>Smart Parking Lot</h1><p id="totals">--</p>
+<table><thead><tr><th>Board</th><th>Online</th><th>Free</th><th>In / Out</th></tr></thead><tbody id="rows"></tbody></table>
+<script>
+async function refresh() {
+  const lot = await (await fetch('/lot')).json();
+  document.getElementById('totals').textContent =
+    `${lot.lot_free} free of ${lot.lot_capacity} | ${lot.boards_online}/${lot.boards} boards online | in ${lot.vehicles_in} out ${lot.vehicles_out}`;
+  const boards = await (await fetch('/boards')).json();
+  document.getElementById('rows').innerHTML = boards.map(b => `<tr><td>${b.address}</td>` +
+    `<td class="${b.online ? '' : 'off'}">${b.online ? 'yes' : 'no'}</td>` +
+    `<td>${b.status ? b.status.lot_free : '--'}</td><td>${b.status ? b.status.vehicles_in + ' / ' + b.status.vehicles_out : '--'}</td></tr>`).join('');
+}
+refresh(); setInterval(refresh, 1000);
+</script></body></html>)html";
+
+static void usage() {
+  fprintf(stderr,
+          "usage: edge_aggregator [--listen PORT] [--threads N] [--poll-ms MS] [--poll-threads N]\n"
+          "                       [--board HOST[:PORT]]... [--simulate N] [--sim-port PORT] [--sim-bays N]\n"
+          "                       [--load-clients N] [--load-seconds S] [--load-path PATH]\n");
+  exit(2);
+}
+
+int main(int argc, char** argv) {
+  int listenPort = 8080, workers = (int)std::thread::hardware_concurrency(), pollMs = 1000, pollThreads = 8;
+  int simulate = 0, simPort = 9100, simBays = 8, loadClients = 0, loadSeconds = 10;
+  std::string loadPath = "/lot";
+  std::vector<Board> boards;
+  for (int a = 1; a < argc; a++) {
+    std::string arg = argv[a];
+    if (a + 1 >= argc) usage();
+    const char* value = argv[++a];
+    if (arg == "--listen") listenPort = atoi(value);
+    else if (arg == "--threads") workers = atoi(value);
+    else if (arg == "--poll-ms") pollMs = atoi(value);
+    else if (arg == "--poll-threads") pollThreads = atoi(value);
+    else if (arg == "--simulate") simulate = atoi(value);
+    else if (arg == "--sim-port") simPort = atoi(value);
+    else if (arg == "--sim-bays") simBays = atoi(value);
+    else if (arg == "--load-clients") loadClients = atoi(value);
+    else if (arg == "--load-seconds") loadSeconds = atoi(value);
+    else if (arg == "--load-path") loadPath = value;
+    else if (arg == "--board") {
+      Board b;
+      std::string spec = value;
+      size_t colon = spec.find(':');
+      b.host = spec.substr(0, colon);
+      b.port = colon == std::string::npos ? 80 : atoi(spec.c_str() + colon + 1);
+      boards.push_back(b);
+    } else {
+      usage();
+    }
+  }
+  for (int s = 0; s < simulate; s++) {
+    Board b;
+    b.host = "127.0.0.1";
+    b.port = simPort + s;
+    boards.push_back(b);
+  }
+  if (boards.empty()) usage();
+  workers = std::max(1, workers);
+
+  signal(SIGINT, [](int) { running = false; });
+  signal(SIGTERM, [](int) { running = false; });
+
+  std::unique_ptr<SimulatedBoards> sims;
+  if (simulate > 0) sims.reset(new SimulatedBoards(simulate, simPort, simBays));
+
+  LotModel model(boards);
+  Response dashboard = makeResponse(200, "text/html", DASHBOARD_HTML);
+  Response notFound = makeResponse(404, "text/plain", "Not found\n");
+  // Counted here rather than read from the server, which the workers can call into
+  // before main() has stored it
+  std::atomic<unsigned long> requests{0};
+  Handler handler = [&](const std::string& path) -> Response {
+    requests++;
+    if (path == "/lot") return model.snapshot()->lot;
+    if (path == "/boards") return model.snapshot()->boards;
+    if (path == "/") return dashboard;
+    if (path == "/metrics") {
+      unsigned long polls, failures;
+      size_t online;
+      model.totals(polls, failures, online);
+      std::string body = "aggregator_board_polls_total " + std::to_string(polls) +
+                         "\naggregator_board_poll_failures_total " + std::to_string(failures) +
+                         "\naggregator_boards_online " + std::to_string(online) +
+                         "\naggregator_http_requests_total " + std::to_string(requests.load()) +
+                         "\naggregator_model_version " + std::to_string(model.snapshot()->version) + "\n";
+      return makeResponse(200, "text/plain; version=0.0.4", body);
+    }
+    return notFound;
+  };
+
+  // Pollers: each thread owns every pollThreads-th board and polls it once per interval
+  std::vector<std::thread> pollers;
+  pollThreads = std::max(1, std::min(pollThreads, (int)boards.size()));
+  for (int t = 0; t < pollThreads; t++) {
+    pollers.emplace_back([&, t]() {
+      while (running) {
+        auto started = std::chrono::steady_clock::now();
+        for (size_t i = t; i < model.size() && running; i += pollThreads) {
+          Board b = model.endpoint(i);
+          std::string body;
+          bool ok = httpGet(b.host, b.port, "/status", body, 2000);
+          model.update(i, ok, body);
+        }
+        std::this_thread::sleep_until(started + std::chrono::milliseconds(pollMs));
+      }
+    });
+  }
+  // Publisher: serialises the model at most every 50 ms, and only when it changed
+  std::thread publisher([&]() {
+    while (running) {
+      model.publishIfChanged();
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+  });
+
+  std::unique_ptr<HttpServer> server(new HttpServer({ { listenPort, handler } }, workers));
+  printf("Aggregating %zu boards on port %d with %d worker thread(s)\n", boards.size(), listenPort, workers);
+
+  if (loadClients > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(pollMs + 500)); // Let the first poll land
+    unsigned long done = runLoad(listenPort, loadPath, loadClients, loadSeconds);
+    printf("Load: %d clients, %lu requests to %s in %d s = %.0f req/s (model version %llu)\n", loadClients, done,
+           loadPath.c_str(), loadSeconds, (double)done / loadSeconds,
+           (unsigned long long)model.snapshot()->version);
+    running = false;
+  }
+
+  for (auto& p : pollers) p.join();
+  publisher.join();
+  server.reset();
+  sims.reset();
+  return 0;
+}
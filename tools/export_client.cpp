@@ -0,0 +1,202 @@
+/*
+  Event log export client (Linux host)
+
+  Downloads a board's event log from /export (see section 16 of main.c) into a CSV or
+  NDJSON file, and survives Wi-Fi dropouts: only complete rows are written, and when
+  the connection breaks before the end of the export it reconnects and asks again from
+  the record after the last one it has. Prints the records per second it got, over
+  the whole run and per connection.
+
+  Build and run from the repository root:
+    g++ -O2 -std=c++17 tools/export_client.cpp -o export_client && ./export_client 192.168.1.100 -o events.csv
+  Options: --port PORT --format csv|ndjson --from N --to N --retries N (reconnects before giving up, default 20)
+*/
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+// Buffered reader over the socket
+struct Reader {
+  int fd;
+  uint8_t buf[16384];
+  size_t start = 0, end = 0;
+
+  bool fill() {
+    if (start > 0) {
+      memmove(buf, buf + start, end - start);
+      end -= start;
+      start = 0;
+    }
+    ssize_t n = recv(fd, buf + end, sizeof(buf) - end, 0);
+    if (n <= 0) return false;
+    end += n;
+    return true;
+  }
+  bool read(std::string& out, size_t len) {
+    while (len > 0) {
+      if (start == end && !fill()) return false;
+      size_t n = std::min(len, end - start);
+      out.append((const char*)buf + start, n);
+      start += n;
+      len -= n;
+    }
+    return true;
+  }
+  bool line(std::string& out) {
+    out.clear();
+    while (true) {
+      if (start == end && !fill()) return false;
+      char c = buf[start++];
+      if (c == '\n') {
+        if (!out.empty() && out.back() == '\r') out.pop_back();
+        return true;
+      }
+      out += c;
+    }
+  }
+};
+
+int connectTo(const char* host, const char* port) {
+  addrinfo hints = {}, *res;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, port, &hints, &res) != 0) return -1;
+  int fd = socket(res->ai_family, res->ai_socktype, 0);
+  timeval timeout = { 15, 0 };  // A stalled link counts as a dropout
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  if (connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  return fd;
+}
+
+// Record number at the start of a row: `123,...` in CSV, `{"seq":123,...` in NDJSON
+bool rowSeq(const std::string& row, unsigned long& seq) {
+  const char* p = row.c_str();
+  if (strncmp(p, "{\"seq\":", 7) == 0) p += 7;
+  char* end;
+  seq = strtoul(p, &end, 10);
+  return end != p;
+}
+
+enum Result { COMPLETE, CUT_SHORT, REFUSED };
+
+// One request from `from` on. Appends complete rows to `out`, advances `next` past
+// each, and tells whether the board finished the export.
+Result fetch(const char* host, const std::string& port, const std::string& format, unsigned long from,
+             const std::string& to, FILE* out, bool writeHeader, unsigned long& next, unsigned long& rows) {
+  int fd = connectTo(host, port.c_str());
+  if (fd < 0) return CUT_SHORT;
+  std::string request = "GET /export?format=" + format + "&from=" + std::to_string(from) +
+                        (to.empty() ? "" : "&to=" + to) + " HTTP/1.1\r\nHost: " + host + "\r\n\r\n";
+  send(fd, request.data(), request.size(), 0);
+
+  Reader in;
+  in.fd = fd;
+  std::string status, header, chunkLine, pending;
+  if (!in.line(status)) {
+    close(fd);
+    return CUT_SHORT;
+  }
+  if (status.find(" 200 ") == std::string::npos) {
+    fprintf(stderr, "board answered: %s\n", status.c_str());
+    close(fd);
+    return status.find(" 409 ") != std::string::npos ? CUT_SHORT : REFUSED;
+  }
+  while (in.line(header) && !header.empty()) {
+    if (header.rfind("X-Export-Records:", 0) == 0 && from == next) {
+      printf("board has %s record(s) from #%lu on\n", header.c_str() + 18, from);
+    }
+  }
+  Result result = CUT_SHORT;
+  while (in.line(chunkLine)) {
+    size_t chunkLen = strtoul(chunkLine.c_str(), nullptr, 16);
+    if (chunkLen == 0) {
+      result = COMPLETE;
+      break;
+    }
+    std::string crlf;
+    if (!in.read(pending, chunkLen) || !in.line(crlf)) break;
+    // Rows may not end on a chunk boundary; keep the rest for the next chunk
+    size_t done = 0, eol;
+    while ((eol = pending.find('\n', done)) != std::string::npos) {
+      std::string row = pending.substr(done, eol + 1 - done);
+      done = eol + 1;
+      unsigned long seq;
+      if (!rowSeq(row, seq)) {
+        if (writeHeader) fputs(row.c_str(), out);  // The CSV header row, only kept once
+        continue;
+      }
+      fputs(row.c_str(), out);
+      next = seq + 1;
+      rows++;
+    }
+    pending.erase(0, done);
+  }
+  close(fd);
+  fflush(out);
+  return result;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s HOST -o FILE [--port PORT] [--format csv|ndjson] [--from N] [--to N] [--retries N]\n",
+            argv[0]);
+    return 1;
+  }
+  const char* host = argv[1];
+  std::string port = "80", format = "csv", to;
+  const char* outPath = nullptr;
+  unsigned long next = 0;
+  int retries = 20;
+  for (int a = 2; a + 1 < argc; a += 2) {
+    std::string arg = argv[a];
+    if (arg == "--port") port = argv[a + 1];
+    else if (arg == "-o") outPath = argv[a + 1];
+    else if (arg == "--format") format = argv[a + 1];
+    else if (arg == "--from") next = strtoul(argv[a + 1], nullptr, 10);
+    else if (arg == "--to") to = argv[a + 1];
+    else if (arg == "--retries") retries = atoi(argv[a + 1]);
+  }
+  FILE* out = outPath ? fopen(outPath, "w") : nullptr;
+  if (!out) {
+    perror(outPath ? outPath : "-o FILE is required");
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  unsigned long rows = 0;
+  int attempts = 0, failures = 0;
+  Result result;
+  do {
+    unsigned long before = rows;
+    auto t0 = std::chrono::steady_clock::now();
+    result = fetch(host, port, format, next, to, out, attempts == 0 && format == "csv", next, rows);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    attempts++;
+    if (rows > before) failures = 0;
+    if (result == CUT_SHORT) {
+      printf("connection %d: %lu record(s) at %.0f/s, cut short; resuming from #%lu\n", attempts, rows - before,
+             (rows - before) / seconds, next);
+      std::this_thread::sleep_for(std::chrono::milliseconds(500 << std::min(failures, 5)));
+      failures++;
+    }
+  } while (result == CUT_SHORT && failures <= retries);
+  fclose(out);
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%lu record(s) in %.1f s (%.0f/s) over %d connection(s)%s\n", rows, seconds, rows / seconds, attempts,
+         result == COMPLETE ? "" : ", export incomplete");
+  return result == COMPLETE ? 0 : 1;
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Generates a self-signed EC P-256 certificate for the board's HTTPS server and
+# writes it to tls_cert.h next to the sketch. Each board should get its own key;
+# tls_cert.h is ignored by git.
+#
+# Usage (from the repository root):
+#   tools/make_tls_cert.sh [hostname-or-ip] [days]
+set -e
+
+NAME="${1:-smart-parking.local}"
+DAYS="${2:-825}"
+DIR="$(mktemp -d)"
+trap 'rm -rf "$DIR"' EXIT
+
+# EC keys keep the certificate small and the handshake cheaper than RSA-2048
+openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 -nodes \
+  -keyout "$DIR/key.pem" -out "$DIR/cert.pem" -days "$DAYS" \
+  -subj "/CN=$NAME" -addext "subjectAltName=$(echo "$NAME" | grep -Eq '^[0-9.]+$' && echo IP || echo DNS):$NAME"
+
+# Emits a PEM file as a C string literal, one line per PEM line
+pem_to_c() {
+  sed -e 's/.*/"&\\n"/' "$1"
+}
+
+{
+  echo "// Generated by tools/make_tls_cert.sh for CN=$NAME. Do not commit."
+  echo "#pragma once"
+  echo
+  echo "const char TLS_SERVER_CERT[] ="
+  pem_to_c "$DIR/cert.pem"
+  echo ";"
+  echo
+  echo "const char TLS_SERVER_KEY[] ="
+  pem_to_c "$DIR/key.pem"
+  echo ";"
+} > tls_cert.h
+
+cp "$DIR/cert.pem" tls_cert.pem
+echo "Wrote tls_cert.h (for the sketch) and tls_cert.pem (for clients: curl --cacert tls_cert.pem)"
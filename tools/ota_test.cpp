@@ -0,0 +1,357 @@
+/*
+  Firmware update test (Linux host)
+
+  Runs the sketch's update path (ota_stream.h) against a local HTTP server and a
+  file-backed flash emulator, and checks it end to end:
+    good        a valid image is written, read back and accepted
+    corrupt     one byte changed in transit: digest mismatch
+    truncated   the server closes halfway: the download is cut short
+    not-an-app  the image lacks the ESP32 magic byte: rejected at once
+    too-large   the image is bigger than the partition: rejected at once
+    bad-cell    flash flips a bit after programming: caught by the read-back
+
+  The emulator behaves like NOR flash: erase sets a sector to 0xFF and programming can
+  only clear bits, so a write to an unerased sector fails. Erase and program take time
+  (--erase-ms, --program-us per 256-byte page), during which the "cache is off": a
+  model of the sensing loop, which has to run code from flash, stalls. The sensing
+  model wakes every --interval-ms, claims the sensor and times a 1..25 ms echo, the
+  way the sensor sequence does. The good case is run twice, with bursts coordinated
+  with echoes as on the board and without, and compared with a run without an update:
+  how late the sensor wakes, and how many echoes a burst landed in.
+
+  Build and run from the repository root:
+    g++ -O2 -std=c++17 -pthread -I. tools/ota_test.cpp -o ota_test && ./ota_test
+  Options: --image-kb N --erase-ms N --program-us N --gap-ms N --interval-ms N --flash FILE
+*/
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mono_clock.h"
+#include "ota_stream.h"
+
+int imageKb = 1024;
+int eraseMs = 45;        // Typical 4 KB sector erase of the ESP32's SPI flash
+int programUs = 700;     // Per 256-byte page
+int gapMs = 20;          // OTA_BURST_GAP_MS
+int intervalMs = 50;     // Sensor period of the model, shorter than the sketch's to get more samples
+std::string flashPath = "/tmp/ota_flash.bin";
+const uint32_t PARTITION_BYTES = 0x140000; // An app slot of the default 4 MB partition scheme
+
+// ---- Flash emulator ----
+
+struct FlashFile {
+  int fd;
+  std::mutex cacheOff;      // Held while flash is busy; whatever runs from flash waits for it
+  int64_t flipBitAt = -1;   // Offset whose lowest bit goes bad after programming, -1 for none
+  std::atomic<long> ops{0}; // Erase, program and read operations started and finished, for spotting overlaps
+};
+
+void sleepUs(int64_t us) {
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+bool flashErase(void* ctx, uint32_t offset, uint32_t len) {
+  FlashFile& f = *(FlashFile*)ctx;
+  if (offset % OTA_SECTOR_BYTES != 0 || len % OTA_SECTOR_BYTES != 0 || offset + len > PARTITION_BYTES) return false;
+  std::lock_guard<std::mutex> off(f.cacheOff);
+  f.ops++;
+  std::vector<uint8_t> ones(len, 0xFF);
+  sleepUs((int64_t)eraseMs * 1000 * (len / OTA_SECTOR_BYTES));
+  bool ok = pwrite(f.fd, ones.data(), len, offset) == (ssize_t)len;
+  f.ops++;
+  return ok;
+}
+
+bool flashWrite(void* ctx, uint32_t offset, const uint8_t* data, uint32_t len) {
+  FlashFile& f = *(FlashFile*)ctx;
+  if (offset + len > PARTITION_BYTES) return false;
+  std::lock_guard<std::mutex> off(f.cacheOff);
+  f.ops++;
+  std::vector<uint8_t> cells(len);
+  bool ok = pread(f.fd, cells.data(), len, offset) == (ssize_t)len;
+  for (uint32_t i = 0; i < len; i++) {
+    ok = ok && !(data[i] & ~cells[i]); // Programming cannot set a bit: sector not erased
+    cells[i] &= data[i];
+    if ((int64_t)(offset + i) == f.flipBitAt) cells[i] ^= 1;
+  }
+  sleepUs((int64_t)programUs * ((len + 255) / 256));
+  ok = ok && pwrite(f.fd, cells.data(), len, offset) == (ssize_t)len;
+  f.ops++;
+  return ok;
+}
+
+bool flashRead(void* ctx, uint32_t offset, uint8_t* data, uint32_t len) {
+  FlashFile& f = *(FlashFile*)ctx;
+  std::lock_guard<std::mutex> off(f.cacheOff);
+  f.ops++;
+  bool ok = offset + len <= PARTITION_BYTES && pread(f.fd, data, len, offset) == (ssize_t)len;
+  f.ops++;
+  return ok;
+}
+
+// ---- HTTP server: serves one image, optionally closing after `cutAt` bytes ----
+
+struct Server {
+  int fd;
+  int port;
+  std::vector<uint8_t> body;
+  size_t cutAt;
+  std::thread thread;
+};
+
+void serveOnce(Server& s) {
+  int c = accept(s.fd, nullptr, nullptr);
+  if (c < 0) return;
+  char req[1024];
+  recv(c, req, sizeof(req), 0);
+  std::string head = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: " +
+                     std::to_string(s.body.size()) + "\r\nConnection: close\r\n\r\n";
+  send(c, head.data(), head.size(), MSG_NOSIGNAL);
+  size_t end = std::min(s.cutAt, s.body.size());
+  for (size_t sent = 0; sent < end;) {
+    ssize_t n = send(c, s.body.data() + sent, std::min<size_t>(1460, end - sent), MSG_NOSIGNAL);
+    if (n <= 0) break;
+    sent += n;
+  }
+  close(c);
+}
+
+void startServer(Server& s) {
+  s.fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(s.fd, (sockaddr*)&addr, sizeof(addr));
+  socklen_t len = sizeof(addr);
+  getsockname(s.fd, (sockaddr*)&addr, &len);
+  s.port = ntohs(addr.sin_port);
+  listen(s.fd, 1);
+  s.thread = std::thread(serveOnce, std::ref(s));
+}
+
+// ---- Sensing model, coordinated with flash bursts as in sections 4 and 16 ----
+
+std::mutex flashMux;
+bool echoInFlight = false, flashBusy = false;
+bool coordinate = true;
+std::atomic<bool> sensing{false};
+
+struct SensingStats {
+  long wakes = 0, echoes = 0, echoesHit = 0, deferred = 0;
+  int64_t lateSumUs = 0, lateMaxUs = 0;
+};
+
+void sensingLoop(FlashFile& flash, SensingStats& st) {
+  std::mt19937 rng(7);
+  int64_t due = monoUs() + intervalMs * MONO_MS;
+  while (sensing) {
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::microseconds(due)));
+    { std::lock_guard<std::mutex> code(flash.cacheOff); } // Running at all needs the cache
+    int64_t late = monoUs() - due;
+    st.wakes++;
+    st.lateSumUs += late;
+    st.lateMaxUs = std::max(st.lateMaxUs, late);
+    while (coordinate) {
+      {
+        std::lock_guard<std::mutex> lock(flashMux);
+        if (!flashBusy) {
+          echoInFlight = true;
+          break;
+        }
+      }
+      st.deferred++;
+      sleepUs(MONO_MS);
+    }
+    // The echo: a flash burst landing in it would delay the echo interrupt
+    long opsBefore = flash.ops;
+    sleepUs(1000 + rng() % 24000);
+    long opsAfter = flash.ops;
+    st.echoesHit += opsBefore % 2 == 1 || opsAfter != opsBefore; // An operation was running, or ran, meanwhile
+    st.echoes++;
+    if (coordinate) {
+      std::lock_guard<std::mutex> lock(flashMux);
+      echoInFlight = false;
+    }
+    due += intervalMs * MONO_MS;
+  }
+}
+
+// ---- The update path, as the sketch's otaTask ----
+
+struct Burst {
+  long count = 0;
+  int64_t maxUs = 0, sumUs = 0;
+};
+
+bool burst(OtaWriter& w, bool (*step)(OtaWriter&), Burst& b) {
+  while (coordinate) {
+    {
+      std::lock_guard<std::mutex> lock(flashMux);
+      if (!echoInFlight) {
+        flashBusy = true;
+        break;
+      }
+    }
+    sleepUs(MONO_MS);
+  }
+  int64_t start = monoUs();
+  bool result = step(w);
+  int64_t us = monoUs() - start;
+  b.count++;
+  b.sumUs += us;
+  b.maxUs = std::max(b.maxUs, us);
+  {
+    std::lock_guard<std::mutex> lock(flashMux);
+    flashBusy = false;
+  }
+  sleepUs(gapMs * MONO_MS);
+  return result;
+}
+
+// Downloads from the local server into flash; returns the writer's outcome or a reason
+std::string runUpdate(int port, const uint8_t* expected, FlashFile& flash, Burst& b, double& seconds) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) return "connect";
+  std::string req = "GET /firmware.bin HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  send(fd, req.data(), req.size(), 0);
+
+  std::string head;
+  char c;
+  while (head.find("\r\n\r\n") == std::string::npos && recv(fd, &c, 1, 0) == 1) head += c;
+  size_t at = head.find("Content-Length: ");
+  if (head.compare(0, 12, "HTTP/1.1 200") != 0 || at == std::string::npos) return "http";
+  uint32_t size = strtoul(head.c_str() + at + 16, nullptr, 10);
+
+  static OtaWriter w;
+  OtaFlash target = { &flash, PARTITION_BYTES, flashErase, flashWrite, flashRead };
+  int64_t start = monoUs();
+  if (otaBegin(w, target, size, expected)) {
+    uint8_t buf[1024];
+    while (w.error == OTA_OK && w.written < w.imageSize) {
+      uint32_t want = std::min<uint32_t>(sizeof(buf), w.imageSize - w.written - w.fill);
+      ssize_t n = want > 0 ? recv(fd, buf, want, 0) : 0;
+      if (want > 0 && n <= 0) break;
+      for (ssize_t used = 0; used < n || otaSectorReady(w);) {
+        used += otaFeed(w, buf + used, n - used);
+        if (otaSectorReady(w)) burst(w, otaWriteSector, b);
+        if (w.error != OTA_OK) break;
+      }
+    }
+    if (w.error == OTA_OK && w.written == w.imageSize) {
+      while (burst(w, otaVerifyStep, b)) {}
+    }
+  }
+  seconds = (monoUs() - start) / 1e6;
+  close(fd);
+  if (w.error == OTA_OK && w.written < w.imageSize) return "cut short";
+  return OTA_ERROR_NAMES[w.error];
+}
+
+struct Case {
+  const char* name;
+  const char* expect;
+};
+
+int main(int argc, char** argv) {
+  for (int a = 1; a + 1 < argc; a += 2) {
+    std::string arg = argv[a];
+    if (arg == "--image-kb") imageKb = atoi(argv[a + 1]);
+    else if (arg == "--erase-ms") eraseMs = atoi(argv[a + 1]);
+    else if (arg == "--program-us") programUs = atoi(argv[a + 1]);
+    else if (arg == "--gap-ms") gapMs = atoi(argv[a + 1]);
+    else if (arg == "--interval-ms") intervalMs = atoi(argv[a + 1]);
+    else if (arg == "--flash") flashPath = argv[a + 1];
+  }
+  FlashFile flash;
+  flash.fd = open(flashPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (flash.fd < 0 || ftruncate(flash.fd, PARTITION_BYTES) != 0) {
+    perror(flashPath.c_str());
+    return 1;
+  }
+
+  std::mt19937 rng(1);
+  std::vector<uint8_t> image(imageKb * 1024 + 123); // Not sector-aligned, like a real image
+  for (uint8_t& byte : image) byte = rng();
+  image[0] = OTA_IMAGE_MAGIC;
+  uint8_t digest[32];
+  Sha256 h;
+  sha256Init(h);
+  sha256Update(h, image.data(), image.size());
+  sha256Final(h, digest);
+
+  // Sensing alone, for reference
+  SensingStats idle;
+  sensing = true;
+  std::thread quiet(sensingLoop, std::ref(flash), std::ref(idle));
+  sleepUs(3 * MONO_S);
+  sensing = false;
+  quiet.join();
+  printf("no update:      %ld wakes, late mean %.2f ms max %.2f ms, %ld echoes, %ld hit by flash\n", idle.wakes,
+         idle.lateSumUs / 1e3 / idle.wakes, idle.lateMaxUs / 1e3, idle.echoes, idle.echoesHit);
+
+  const Case cases[] = { { "good", "ok" },          { "good-uncoordinated", "ok" }, { "corrupt", "digest" },
+                         { "truncated", "cut short" }, { "not-an-app", "image" },   { "too-large", "size" },
+                         { "bad-cell", "digest" } };
+  int failures = 0;
+  for (const Case& test : cases) {
+    std::string name = test.name;
+    Server server;
+    server.body = image;
+    server.cutAt = SIZE_MAX;
+    flash.flipBitAt = -1;
+    coordinate = name != "good-uncoordinated";
+    if (name == "corrupt") server.body[server.body.size() / 2] ^= 0x40;
+    if (name == "truncated") server.cutAt = image.size() / 2;
+    if (name == "not-an-app") server.body[0] = 0;
+    if (name == "too-large") server.body.resize(PARTITION_BYTES + 1);
+    if (name == "bad-cell") flash.flipBitAt = image.size() / 3;
+    startServer(server);
+
+    SensingStats st;
+    sensing = true;
+    std::thread sensor(sensingLoop, std::ref(flash), std::ref(st));
+    Burst b;
+    double seconds = 0;
+    std::string result = runUpdate(server.port, digest, flash, b, seconds);
+    sensing = false;
+    sensor.join();
+    server.thread.join();
+    close(server.fd);
+
+    bool pass = result == test.expect;
+    if (pass && name == "good") {
+      std::vector<uint8_t> back(image.size());
+      pass = pread(flash.fd, back.data(), back.size(), 0) == (ssize_t)back.size() && back == image;
+    }
+    failures += !pass;
+    printf("%-19s %s: %s (expected %s)\n", test.name, pass ? "PASS" : "FAIL", result.c_str(), test.expect);
+    if (name.compare(0, 4, "good") == 0) {
+      printf("  %.1f s, %.0f KB/s, %ld bursts of mean %.1f ms max %.1f ms\n", seconds,
+             image.size() / 1024.0 / seconds, b.count, b.sumUs / 1e3 / b.count, b.maxUs / 1e3);
+      printf("  sensing: late mean %.2f ms max %.2f ms, %ld of %ld echoes hit by flash, %ld triggers deferred\n",
+             st.lateSumUs / 1e3 / st.wakes, st.lateMaxUs / 1e3, st.echoesHit, st.echoes, st.deferred);
+    }
+  }
+  close(flash.fd);
+  printf("%d of %zu cases failed\n", failures, sizeof(cases) / sizeof(cases[0]));
+  return failures == 0 ? 0 : 1;
+}
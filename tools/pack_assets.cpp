@@ -0,0 +1,270 @@
+/*
+  Asset partition packer (Linux host)
+
+  Builds the blob for the board's asset partition (format in assets.h) from dashboard
+  files and a file of configuration defaults, or checks and lists an existing blob the
+  way the board does, from a read-only mmap.
+
+  Files are stored under their base name; a name ending in .gz is stored compressed
+  under the name without it and sent with Content-Encoding: gzip. --from-sketch takes
+  the dashboard built into main.c as index.html, so it can be edited without
+  rebuilding the firmware. The config file has one `name = value` per line, with the
+  names /config uses; # starts a comment.
+
+  Build and run from the repository root:
+    g++ -O2 -std=c++17 -I. tools/pack_assets.cpp -o pack_assets
+    ./pack_assets -o assets.bin --from-sketch main.c --config defaults.txt style.css.gz
+    ./pack_assets --check assets.bin
+  Then upload with the printed POST /ota?target=assets command, or write it once over
+  USB at the partition's offset:
+    esptool.py write_flash 0x3C0000 assets.bin
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "assets.h"
+#include "ota_stream.h"
+
+const uint32_t PARTITION_BYTES = 0x30000; // As in partitions.csv
+
+struct Input {
+  std::string name;
+  std::string data;
+  AssetType type;
+  uint8_t flags;
+  uint8_t mime;
+};
+
+bool readFile(const std::string& path, std::string& out) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return false;
+  std::ostringstream buf;
+  buf << in.rdbuf();
+  out = buf.str();
+  return true;
+}
+
+bool endsWith(const std::string& s, const std::string& suffix) {
+  return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+uint8_t mimeFor(const std::string& name) {
+  const char* ext[] = { "", ".html", ".css", ".js", ".json", ".svg", ".png", ".ico", ".txt" };
+  for (int m = 1; m < ASSET_MIME_COUNT; m++) {
+    if (endsWith(name, ext[m])) return m;
+  }
+  return 0;
+}
+
+// The dashboard literal of handleRoot() in the sketch
+bool extractSketchHtml(const std::string& path, std::string& html) {
+  std::string sketch;
+  if (!readFile(path, sketch)) return false;
+  size_t start = sketch.find("R\"rawliteral(");
+  size_t end = sketch.find(")rawliteral\"", start);
+  if (start == std::string::npos || end == std::string::npos) return false;
+  start += 13;
+  html = sketch.substr(start, end - start);
+  return true;
+}
+
+bool parseConfig(const std::string& path, std::string& record) {
+  std::ifstream in(path);
+  if (!in) {
+    perror(path.c_str());
+    return false;
+  }
+  std::string line;
+  int lineNo = 0;
+  while (std::getline(in, line)) {
+    lineNo++;
+    line = line.substr(0, line.find('#'));
+    size_t eq = line.find('=');
+    if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+    std::string name = eq == std::string::npos ? "" : line.substr(0, eq);
+    name.erase(std::remove_if(name.begin(), name.end(), ::isspace), name.end());
+    char* end = nullptr;
+    float value = eq == std::string::npos ? 0 : strtof(line.c_str() + eq + 1, &end);
+    if (name.empty() || name.size() > (size_t)ASSET_CONFIG_NAME_BYTES || end == line.c_str() + eq + 1) {
+      fprintf(stderr, "%s:%d: expected `name = value`\n", path.c_str(), lineNo);
+      return false;
+    }
+    AssetConfigValue v = {};
+    memcpy(v.name, name.data(), name.size());
+    v.value = value;
+    record.append((const char*)&v, sizeof(v));
+  }
+  return true;
+}
+
+int pack(const std::string& outPath, std::vector<Input>& inputs, uint32_t generation) {
+  std::sort(inputs.begin(), inputs.end(), [](const Input& a, const Input& b) { return a.name < b.name; });
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (inputs[i].name.size() >= (size_t)ASSET_NAME_BYTES) {
+      fprintf(stderr, "%s: name longer than %d characters\n", inputs[i].name.c_str(), ASSET_NAME_BYTES - 1);
+      return 1;
+    }
+    if (i > 0 && inputs[i].name == inputs[i - 1].name) {
+      fprintf(stderr, "%s: given twice\n", inputs[i].name.c_str());
+      return 1;
+    }
+  }
+  std::vector<uint8_t> blob(sizeof(AssetHeader) + inputs.size() * sizeof(AssetEntry));
+  std::vector<AssetEntry> index(inputs.size());
+  for (size_t i = 0; i < inputs.size(); i++) {
+    blob.resize((blob.size() + ASSET_ALIGN - 1) / ASSET_ALIGN * ASSET_ALIGN);
+    AssetEntry& e = index[i];
+    memset(&e, 0, sizeof(e));
+    memcpy(e.name, inputs[i].name.data(), inputs[i].name.size());
+    e.offset = blob.size();
+    e.length = inputs[i].data.size();
+    e.crc32 = assetCrc32((const uint8_t*)inputs[i].data.data(), e.length);
+    e.type = inputs[i].type;
+    e.flags = inputs[i].flags;
+    e.mime = inputs[i].mime;
+    blob.insert(blob.end(), inputs[i].data.begin(), inputs[i].data.end());
+  }
+  memcpy(blob.data() + sizeof(AssetHeader), index.data(), index.size() * sizeof(AssetEntry));
+  AssetHeader h = {};
+  h.magic = ASSET_MAGIC;
+  h.version = ASSET_VERSION;
+  h.count = inputs.size();
+  h.totalBytes = blob.size();
+  h.generation = generation;
+  h.crc32 = assetCrc32(blob.data() + sizeof(AssetHeader), blob.size() - sizeof(AssetHeader));
+  memcpy(blob.data(), &h, sizeof(h));
+  if (blob.size() > PARTITION_BYTES) {
+    fprintf(stderr, "blob is %zu bytes, the partition holds %u\n", blob.size(), PARTITION_BYTES);
+    return 1;
+  }
+
+  FILE* out = fopen(outPath.c_str(), "wb");
+  if (!out || fwrite(blob.data(), 1, blob.size(), out) != blob.size() || fclose(out) != 0) {
+    perror(outPath.c_str());
+    return 1;
+  }
+  Sha256 sha;
+  uint8_t digest[32];
+  sha256Init(sha);
+  sha256Update(sha, blob.data(), blob.size());
+  sha256Final(sha, digest);
+  char hex[65];
+  for (int i = 0; i < 32; i++) snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+  printf("%s: %zu record(s), %zu bytes (%.0f%% of the partition), generation %u\n", outPath.c_str(), inputs.size(),
+         blob.size(), 100.0 * blob.size() / PARTITION_BYTES, generation);
+  printf("upload: curl -X POST \"http://BOARD/ota?target=assets&url=http://HOST:8000/%s&sha256=%s\"\n",
+         outPath.c_str(), hex);
+  return 0;
+}
+
+// Opens a blob like the board does: map it, check it, look every record up in place
+int check(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror(path.c_str());
+    return 1;
+  }
+  const uint8_t* base = (const uint8_t*)mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (base == MAP_FAILED) {
+    fprintf(stderr, "%s: cannot map an empty file\n", path.c_str());
+    return 1;
+  }
+  auto start = std::chrono::steady_clock::now();
+  const AssetHeader* h = assetsOpen(base, st.st_size);
+  double openUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  if (h == nullptr) {
+    fprintf(stderr, "%s: not a valid asset blob\n", path.c_str());
+    return 1;
+  }
+  printf("generation %u, %u record(s), %u bytes, opened and CRC-checked in %.1f us\n", h->generation, h->count,
+         h->totalBytes, openUs);
+  int bad = 0;
+  const int LOOKUPS = 100000;
+  start = std::chrono::steady_clock::now();
+  for (int n = 0; n < LOOKUPS; n++) {
+    const AssetEntry& e = assetIndex(h)[n % h->count];
+    bad += assetFind(h, e.name, e.type) != &e;
+  }
+  double findNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / LOOKUPS;
+  for (int i = 0; i < h->count; i++) {
+    const AssetEntry& e = assetIndex(h)[i];
+    bool crcOk = assetCrc32(assetData(h, &e), e.length) == e.crc32;
+    bad += !crcOk;
+    printf("  %-31s %7u bytes at %6u  %-24s%s%s\n", e.name, e.length, e.offset,
+           e.type == ASSET_CONFIG ? "config" : ASSET_MIME_TYPES[e.mime], e.flags & ASSET_GZIP ? " gzip" : "",
+           crcOk ? "" : " CRC MISMATCH");
+    if (e.type == ASSET_CONFIG) {
+      const AssetConfigValue* v = (const AssetConfigValue*)assetData(h, &e);
+      for (uint32_t k = 0; k < e.length / sizeof(AssetConfigValue); k++) {
+        printf("    %.*s = %g\n", ASSET_CONFIG_NAME_BYTES, v[k].name, v[k].value);
+      }
+    }
+  }
+  printf("lookup: %.0f ns each\n", findNs);
+  munmap((void*)base, st.st_size);
+  close(fd);
+  return bad == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  std::string outPath, checkPath;
+  std::vector<Input> inputs;
+  uint32_t generation = time(nullptr);
+  for (int a = 1; a < argc; a++) {
+    std::string arg = argv[a];
+    bool hasValue = a + 1 < argc;
+    if (arg == "-o" && hasValue) {
+      outPath = argv[++a];
+    } else if (arg == "--check" && hasValue) {
+      checkPath = argv[++a];
+    } else if (arg == "--generation" && hasValue) {
+      generation = strtoul(argv[++a], nullptr, 10);
+    } else if (arg == "--from-sketch" && hasValue) {
+      Input in = { "index.html", "", ASSET_FILE, 0, mimeFor(".html") };
+      if (!extractSketchHtml(argv[++a], in.data)) {
+        fprintf(stderr, "%s: no dashboard literal found\n", argv[a]);
+        return 1;
+      }
+      inputs.push_back(in);
+    } else if (arg == "--config" && hasValue) {
+      Input in = { "config", "", ASSET_CONFIG, 0, 0 };
+      if (!parseConfig(argv[++a], in.data)) {
+        return 1;
+      }
+      inputs.push_back(in);
+    } else {
+      Input in = { arg.substr(arg.rfind('/') + 1), "", ASSET_FILE, 0, 0 };
+      if (endsWith(in.name, ".gz")) {
+        in.name.resize(in.name.size() - 3);
+        in.flags = ASSET_GZIP;
+      }
+      in.mime = mimeFor(in.name);
+      if (!readFile(arg, in.data)) {
+        perror(arg.c_str());
+        return 1;
+      }
+      inputs.push_back(in);
+    }
+  }
+  if (!checkPath.empty()) return check(checkPath);
+  if (outPath.empty() || inputs.empty()) {
+    fprintf(stderr, "usage: %s -o BLOB [--from-sketch main.c] [--config FILE] [--generation N] FILE...\n"
+                    "       %s --check BLOB\n", argv[0], argv[0]);
+    return 1;
+  }
+  return pack(outPath, inputs, generation);
+}
@@ -0,0 +1,347 @@
+/*
+  Peer sync simulator (Linux host)
+
+  Forks one process per board. The boards exchange crdt.h deltas over UDP on the
+  loopback interface, with the same collect / send / full-sync cycle as serviceCrdt()
+  in the sketch. For a while every board changes the bays it can see (neighbouring
+  boards see some of the same bays, so they write the same slots concurrently) and
+  counts vehicles in and out of its lane; then the changes stop and the boards keep
+  syncing. Packets can be dropped and wall clocks skewed on purpose.
+
+  Each board reports its state digest to the parent through a pipe whenever it
+  changes. The parent reports the convergence time (from the last change to the
+  moment every board holds the same state), the bandwidth used, and checks the merged
+  result: the vehicle count must equal the sum of every board's own count, and every
+  slot must hold the latest write made to it.
+
+  Build and run from the repository root:
+    g++ -O2 -std=c++17 -I. tools/sim_crdt.cpp -o sim_crdt && ./sim_crdt
+  Options: --boards N --events-per-s RATE --seconds S --settle-s S --overlap SLOTS --loss FRACTION
+           --skew-ms MS --delta-ms MS --full-sync-ms MS --port PORT
+*/
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "crdt.h"
+#include "mono_clock.h"
+
+const int SLOTS = 1024;
+const int COUNTERS = 1;
+const size_t MAX_MESSAGE = 1400;
+typedef CrdtLot<COUNTERS, SLOTS> Lot;
+
+int boards = 8;
+double eventsPerSecond = 20;  // Per board
+double eventSeconds = 10;
+double settleSeconds = 12;
+int overlap = 16;             // Slots each board shares with the next one
+double lossRate = 0.1;
+int skewMs = 200;             // Board clocks are off by up to this much either way
+int deltaMs = 100;
+int fullSyncMs = 5000;
+int basePort = 47100;
+
+// Messages from a board to the parent
+enum ReportType : uint32_t { REPORT_DIGEST, REPORT_WRITE, REPORT_DONE };
+
+struct Report {
+  ReportType type;
+  uint32_t board;
+  int64_t timeUs;         // REPORT_DIGEST: when the state changed
+  uint64_t digest;        // REPORT_DIGEST: state digest; REPORT_WRITE: HLC time of the board's last write
+  int32_t slot;           // REPORT_WRITE
+  int32_t value;          // REPORT_WRITE: value written; REPORT_DONE: the board's own vehicle count
+  int32_t merged;         // REPORT_DONE: merged vehicle count; REPORT_WRITE: merged value of the slot
+  uint64_t messages;      // REPORT_DONE
+  uint64_t bytes;         // REPORT_DONE
+  uint64_t fullStateBytes; // REPORT_DONE: size of the whole state, encoded
+};
+
+uint64_t digestOf(const Lot& lot) {
+  uint64_t hash = 1469598103934665603ULL;  // FNV-1a
+  auto mix = [&](const void* data, size_t len) {
+    for (size_t i = 0; i < len; i++) hash = (hash ^ ((const uint8_t*)data)[i]) * 1099511628211ULL;
+  };
+  mix(lot.counters, sizeof(lot.counters));
+  for (const LwwRegister& reg : lot.slots) {
+    mix(&reg.time, sizeof(reg.time));
+    mix(&reg.node, 1);
+    mix(&reg.value, 1);
+  }
+  return hash;
+}
+
+void runBoard(int id, int reportFd, int64_t startUs) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(basePort + id);
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    perror("bind");
+    _exit(1);
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+
+  std::mt19937 rng(id * 7919 + 1);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  int64_t skew = skewMs > 0 ? (int64_t)(rng() % (2 * skewMs + 1)) - skewMs : 0;
+  auto physicalMs = [&]() {
+    timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (uint64_t)((int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000 + skew);
+  };
+
+  static Lot lot;
+  crdtInit(lot, id);
+  std::vector<HlcTime> lastWriteTime(SLOTS, 0);
+  std::vector<int> lastWriteValue(SLOTS, -1);
+  int32_t ownVehicles = 0;
+  uint64_t messages = 0, bytes = 0;
+
+  // This board's bays: its own share of the lot plus the first `overlap` of the next board's
+  int share = SLOTS / boards;
+  int firstSlot = id * share;
+  int slotSpan = share + overlap;
+
+  int64_t eventEndUs = startUs + (int64_t)(eventSeconds * 1e6);
+  int64_t endUs = eventEndUs + (int64_t)(settleSeconds * 1e6);
+  int64_t lastDelta = startUs, lastFull = startUs + (int64_t)id * fullSyncMs * 1000 / boards;  // Staggered
+  double eventChance = eventsPerSecond / 1000.0;  // Per 1 ms step
+  uint64_t lastDigest = digestOf(lot);
+  uint8_t buf[MAX_MESSAGE];
+
+  while (monoUs() < startUs) usleep(1000);
+  while (true) {
+    int64_t now = monoUs();
+    if (now >= endUs) break;
+
+    ssize_t len;
+    while ((len = recv(fd, buf, sizeof(buf), 0)) > 0) {
+      int changed;
+      crdtApply(lot, buf, len, changed);
+    }
+
+    if (now < eventEndUs && uniform(rng) < eventChance) {
+      if (uniform(rng) < 0.5) {
+        int slot = (firstSlot + rng() % slotSpan) % SLOTS;
+        uint8_t value = lot.slots[slot].value ^ 1;
+        crdtSetSlot(lot, slot, value, physicalMs());
+        lastWriteTime[slot] = lot.slots[slot].time;
+        lastWriteValue[slot] = value;
+      } else {
+        int32_t delta = (ownVehicles > 0 && uniform(rng) < 0.5) ? -1 : 1;
+        crdtAdd(lot, 0, delta);
+        ownVehicles += delta;
+      }
+    }
+
+    if (now - lastFull >= fullSyncMs * 1000LL) {
+      crdtMarkAllDirty(lot);
+      lastFull = now;
+    }
+    if (now - lastDelta >= deltaMs * 1000LL) {
+      lastDelta = now;
+      size_t n;
+      while ((n = crdtEncodeDelta(lot, buf, sizeof(buf))) > 0) {
+        messages++;
+        bytes += n;  // Counted once, as a broadcast goes over the air once
+        for (int peer = 0; peer < boards; peer++) {
+          if (peer == id || uniform(rng) < lossRate) continue;
+          sockaddr_in to = addr;
+          to.sin_port = htons(basePort + peer);
+          sendto(fd, buf, n, 0, (sockaddr*)&to, sizeof(to));
+        }
+      }
+    }
+
+    uint64_t digest = digestOf(lot);
+    if (digest != lastDigest) {
+      lastDigest = digest;
+      Report report = {};
+      report.type = REPORT_DIGEST;
+      report.board = id;
+      report.timeUs = now;
+      report.digest = digest;
+      write(reportFd, &report, sizeof(report));
+    }
+    usleep(1000);
+  }
+
+  for (int s = 0; s < SLOTS; s++) {
+    if (lastWriteValue[s] < 0) continue;
+    Report report = {};
+    report.type = REPORT_WRITE;
+    report.board = id;
+    report.slot = s;
+    report.digest = lastWriteTime[s];
+    report.value = lastWriteValue[s];
+    report.merged = lot.slots[s].value;
+    write(reportFd, &report, sizeof(report));
+  }
+  static Lot full;
+  full = lot;
+  crdtMarkAllDirty(full);
+  uint64_t fullBytes = 0;
+  size_t n;
+  while ((n = crdtEncodeDelta(full, buf, sizeof(buf))) > 0) fullBytes += n;
+
+  Report done = {};
+  done.type = REPORT_DONE;
+  done.board = id;
+  done.value = ownVehicles;
+  done.merged = pnValue(lot.counters[0]);
+  done.messages = messages;
+  done.bytes = bytes;
+  done.fullStateBytes = fullBytes;
+  write(reportFd, &done, sizeof(done));
+  close(reportFd);
+  _exit(0);
+}
+
+int main(int argc, char** argv) {
+  for (int a = 1; a + 1 < argc; a += 2) {
+    std::string arg = argv[a];
+    double value = atof(argv[a + 1]);
+    if (arg == "--boards") boards = value;
+    else if (arg == "--events-per-s") eventsPerSecond = value;
+    else if (arg == "--seconds") eventSeconds = value;
+    else if (arg == "--settle-s") settleSeconds = value;
+    else if (arg == "--overlap") overlap = value;
+    else if (arg == "--loss") lossRate = value;
+    else if (arg == "--skew-ms") skewMs = value;
+    else if (arg == "--delta-ms") deltaMs = value;
+    else if (arg == "--full-sync-ms") fullSyncMs = value;
+    else if (arg == "--port") basePort = value;
+  }
+  if (boards < 2 || boards > CRDT_MAX_NODES) {
+    fprintf(stderr, "--boards must be 2..%d\n", CRDT_MAX_NODES);
+    return 1;
+  }
+  printf("%d boards, %d slots (%d shared with the next board), %.0f events/s per board for %.0f s\n", boards, SLOTS,
+         overlap, eventsPerSecond, eventSeconds);
+  printf("loss %.0f%%, clock skew up to +-%d ms, deltas every %d ms, full sync every %d ms\n", lossRate * 100, skewMs,
+         deltaMs, fullSyncMs);
+  fflush(stdout);
+
+  int64_t startUs = monoUs() + 200000;  // Gives every board time to bind its socket
+  std::vector<int> pipes(boards);
+  std::vector<pid_t> pids(boards);
+  for (int b = 0; b < boards; b++) {
+    int fds[2];
+    if (pipe(fds) < 0) {
+      perror("pipe");
+      return 1;
+    }
+    pids[b] = fork();
+    if (pids[b] == 0) {
+      for (int p = 0; p < b; p++) close(pipes[p]);
+      close(fds[0]);
+      runBoard(b, fds[1], startUs);
+    }
+    close(fds[1]);
+    pipes[b] = fds[0];
+  }
+
+  // Reads every board's reports until all pipes close
+  std::vector<int64_t> lastChangeUs(boards, 0);
+  std::vector<uint64_t> finalDigest(boards, 0);
+  std::vector<Report> done(boards);
+  std::vector<HlcTime> winnerTime(SLOTS, 0);
+  std::vector<int> winnerNode(SLOTS, -1), winnerValue(SLOTS, -1);
+  std::vector<std::vector<int>> mergedValue(boards, std::vector<int>(SLOTS, -1));
+  std::vector<bool> open(boards, true);
+  std::vector<std::string> partial(boards);
+  int openCount = boards;
+  while (openCount > 0) {
+    std::vector<pollfd> polls;
+    for (int b = 0; b < boards; b++) {
+      if (open[b]) polls.push_back({ pipes[b], POLLIN, 0 });
+    }
+    poll(polls.data(), polls.size(), -1);
+    for (const pollfd& p : polls) {
+      if (!(p.revents & (POLLIN | POLLHUP))) continue;
+      int b = std::find(pipes.begin(), pipes.end(), p.fd) - pipes.begin();
+      char chunk[4096];
+      ssize_t n = read(p.fd, chunk, sizeof(chunk));
+      if (n <= 0) {
+        open[b] = false;
+        openCount--;
+        close(p.fd);
+        continue;
+      }
+      partial[b].append(chunk, n);
+      while (partial[b].size() >= sizeof(Report)) {
+        Report report;
+        memcpy(&report, partial[b].data(), sizeof(report));
+        partial[b].erase(0, sizeof(report));
+        if (report.type == REPORT_DIGEST) {
+          lastChangeUs[b] = report.timeUs;
+          finalDigest[b] = report.digest;
+        } else if (report.type == REPORT_WRITE) {
+          int s = report.slot;
+          if (report.digest > winnerTime[s] || (report.digest == winnerTime[s] && (int)b > winnerNode[s])) {
+            winnerTime[s] = report.digest;
+            winnerNode[s] = b;
+            winnerValue[s] = report.value;
+          }
+          mergedValue[b][s] = report.merged;
+        } else {
+          done[b] = report;
+        }
+      }
+    }
+  }
+  for (pid_t pid : pids) waitpid(pid, nullptr, 0);
+
+  int64_t eventEndUs = startUs + (int64_t)(eventSeconds * 1e6);
+  bool converged = std::all_of(finalDigest.begin(), finalDigest.end(), [&](uint64_t d) { return d == finalDigest[0]; });
+  int64_t convergedUs = *std::max_element(lastChangeUs.begin(), lastChangeUs.end());
+  int32_t expectedVehicles = 0;
+  uint64_t totalMessages = 0, totalBytes = 0;
+  bool countersRight = true;
+  for (int b = 0; b < boards; b++) {
+    expectedVehicles += done[b].value;
+    totalMessages += done[b].messages;
+    totalBytes += done[b].bytes;
+  }
+  for (int b = 0; b < boards; b++) countersRight = countersRight && done[b].merged == expectedVehicles;
+  int slotsWritten = 0, wrongSlots = 0;
+  for (int s = 0; s < SLOTS; s++) {
+    if (winnerNode[s] < 0) continue;
+    slotsWritten++;
+    for (int b = 0; b < boards; b++) {
+      if (mergedValue[b][s] >= 0 && mergedValue[b][s] != winnerValue[s]) {
+        wrongSlots++;
+        break;
+      }
+    }
+  }
+
+  double seconds = eventSeconds + settleSeconds;
+  printf("\nconverged: %s", converged ? "yes" : "NO");
+  if (converged) printf(", %.1f ms after the last change", std::max<int64_t>(0, convergedUs - eventEndUs) / 1000.0);
+  printf("\nvehicles: merged %d on every board: %s (sum of each board's own count %d)\n", done[0].merged,
+         countersRight ? "yes" : "NO", expectedVehicles);
+  printf("slots: %d written, %d not holding the latest write\n", slotsWritten, wrongSlots);
+  printf("traffic: %llu messages, %llu bytes, %.1f bytes/message, %.0f bytes/s per board\n",
+         (unsigned long long)totalMessages, (unsigned long long)totalBytes,
+         totalMessages ? (double)totalBytes / totalMessages : 0.0, totalBytes / seconds / boards);
+  printf("full state of one board encoded: %llu bytes\n", (unsigned long long)done[0].fullStateBytes);
+  return converged && countersRight && wrongSlots == 0 ? 0 : 1;
+}
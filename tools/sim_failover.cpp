@@ -0,0 +1,238 @@
+/*
+  Hot-standby failover simulator (Linux host)
+
+  Runs two controllers as threads that exchange replication.h messages over UDP on
+  the loopback interface, with the same receive / take over / send cycle as
+  serviceReplication() in the sketch. The primary keeps changing its lane counters;
+  each trial crashes whichever controller is primary, measures the time until the
+  other one takes over, then reboots the crashed one and checks that it comes back
+  as standby rather than fighting the new primary.
+
+  Build and run from the repository root:
+    g++ -O2 -std=c++17 -pthread -I. tools/sim_failover.cpp -o sim_failover && ./sim_failover
+  Options: --trials N --heartbeat-ms MS --timeout-ms MS --loop-ms MS --loss FRACTION --port PORT
+*/
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mono_clock.h"
+#include "replication.h"
+
+const int BAYS = 64;
+typedef ReplicatedState<BAYS> Replica;
+
+int64_t heartbeatUs = 100000;
+int64_t timeoutUs = 500000;
+int64_t loopUs = 5000;
+double lossRate = 0;
+
+// One controller: a socket, its replication node and the state it owns or mirrors
+struct Controller {
+  int id;
+  uint8_t priority;
+  int fd;
+  sockaddr_in peer;
+  std::atomic<bool> crashed{false};
+  std::atomic<bool> reboot{false};
+  std::atomic<int> role{ROLE_STANDBY};
+  std::atomic<int64_t> takeoverUs{0};
+  std::atomic<uint32_t> vehiclesIn{0};  // Published copy of state.vehiclesIn
+  std::atomic<uint32_t> missed{0}, stale{0}, demotions{0};
+};
+
+std::atomic<bool> running(true);
+
+void runController(Controller& c) {
+  std::mt19937 rng(c.id + 1);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  ReplicationNode node;
+  Replica state = {}, received;
+  uint8_t buf[replicationMaxBytes(BAYS)];
+  int64_t lastSend = 0, lastChange = 0;
+  bool dirty = false;
+  replicationInit(node, c.priority, timeoutUs, monoUs());
+
+  while (running) {
+    if (c.crashed) {
+      if (c.reboot) {
+        while (recv(c.fd, buf, sizeof(buf), 0) > 0) {} // Packets that arrived while it was down
+        replicationInit(node, c.priority, timeoutUs, monoUs());
+        state = {};
+        dirty = false;
+        c.role = node.role;
+        c.reboot = false;
+        c.crashed = false;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(loopUs));
+      continue;
+    }
+
+    ssize_t len;
+    while ((len = recv(c.fd, buf, sizeof(buf), 0)) > 0) {
+      ReplicationHeader header;
+      bool hasState;
+      if (!replicationDecode(buf, len, header, received, hasState, BAYS)) continue;
+      if (replicationReceive(node, header, monoUs()) && hasState) state = received;
+    }
+    int64_t now = monoUs();
+    if (replicationCheckTakeover(node, now)) {
+      c.takeoverUs = now;
+      dirty = true;
+    }
+
+    // The primary's lane sees a vehicle every 50 ms or so
+    if (node.role == ROLE_PRIMARY && now - lastChange > 50000) {
+      state.vehiclesIn++;
+      state.occupied.set(state.vehiclesIn % BAYS, !state.occupied.test(state.vehiclesIn % BAYS));
+      lastChange = now;
+      dirty = true;
+    }
+    if ((node.role == ROLE_PRIMARY && dirty) || now - lastSend >= heartbeatUs) {
+      ReplicationHeader header = replicationNextHeader(node);
+      size_t n = replicationEncode(buf, sizeof(buf), header, node.role == ROLE_PRIMARY ? &state : nullptr, BAYS);
+      if (uniform(rng) >= lossRate) sendto(c.fd, buf, n, 0, (sockaddr*)&c.peer, sizeof(c.peer));
+      lastSend = now;
+      dirty = false;
+    }
+
+    c.role = node.role;
+    c.vehiclesIn = state.vehiclesIn;
+    c.missed = node.missed;
+    c.stale = node.stale;
+    c.demotions = node.demotions;
+    std::this_thread::sleep_for(std::chrono::microseconds(loopUs));
+  }
+}
+
+int openSocket(int port) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    perror("bind");
+    exit(1);
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  return fd;
+}
+
+// Waits until `done` holds or `limitMs` passes; returns whether it held
+template <typename F>
+bool waitFor(F done, int limitMs) {
+  int64_t deadline = monoUs() + limitMs * 1000LL;
+  while (!done()) {
+    if (monoUs() > deadline) return false;
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  int trials = 20, port = 47000;
+  for (int a = 1; a + 1 < argc; a += 2) {
+    std::string arg = argv[a];
+    double value = atof(argv[a + 1]);
+    if (arg == "--trials") trials = value;
+    else if (arg == "--heartbeat-ms") heartbeatUs = value * 1000;
+    else if (arg == "--timeout-ms") timeoutUs = value * 1000;
+    else if (arg == "--loop-ms") loopUs = value * 1000;
+    else if (arg == "--loss") lossRate = value;
+    else if (arg == "--port") port = value;
+  }
+
+  Controller controllers[2];
+  for (int i = 0; i < 2; i++) {
+    controllers[i].id = i;
+    controllers[i].priority = i == 0 ? 1 : 0;  // Controller 0 is the preferred primary
+    controllers[i].fd = openSocket(port + i);
+    controllers[i].peer.sin_family = AF_INET;
+    controllers[i].peer.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    controllers[i].peer.sin_port = htons(port + 1 - i);
+  }
+  std::thread threads[2] = { std::thread(runController, std::ref(controllers[0])),
+                             std::thread(runController, std::ref(controllers[1])) };
+
+  // Counts moments at which both running controllers believe they are primary
+  std::atomic<long> dualPrimarySamples(0), samples(0);
+  std::thread monitor([&]() {
+    while (running) {
+      bool active0 = controllers[0].role == ROLE_PRIMARY && !controllers[0].crashed;
+      bool active1 = controllers[1].role == ROLE_PRIMARY && !controllers[1].crashed;
+      if (active0 && active1) dualPrimarySamples++;
+      samples++;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+
+  printf("heartbeat %lld ms, timeout %lld ms, loop %lld ms, loss %.0f%%\n", (long long)heartbeatUs / 1000,
+         (long long)timeoutUs / 1000, (long long)loopUs / 1000, lossRate * 100);
+  bool booted = waitFor([&]() { return controllers[0].role == ROLE_PRIMARY; }, 5000);
+  printf("cold start: %s\n", booted ? "controller 0 (preferred) became primary" : "NO PRIMARY");
+
+  std::mt19937 rng(42);
+  std::vector<double> failoverMs;
+  long lostVehicles = 0, failedTrials = 0, rebootedAsPrimary = 0;
+  for (int t = 0; t < trials && booted; t++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200 + rng() % 800));
+    int p = controllers[0].role == ROLE_PRIMARY ? 0 : 1;
+    Controller& primary = controllers[p];
+    Controller& standby = controllers[1 - p];
+
+    uint32_t vehiclesAtCrash = primary.vehiclesIn;
+    int64_t crashUs = monoUs();
+    primary.crashed = true;
+    if (!waitFor([&]() { return standby.role == ROLE_PRIMARY; }, 5000)) {
+      failedTrials++;
+      printf("trial %2d: controller %d never took over\n", t, standby.id);
+      continue;
+    }
+    double ms = (standby.takeoverUs - crashUs) / 1000.0;
+    long lost = (long)vehiclesAtCrash - (long)standby.vehiclesIn;
+    failoverMs.push_back(ms);
+    lostVehicles += std::max(0L, lost);
+    printf("trial %2d: controller %d -> %d in %6.1f ms, %ld update(s) lost\n", t, p, standby.id, ms, std::max(0L, lost));
+
+    // The crashed controller comes back and must settle as standby
+    primary.reboot = true;
+    waitFor([&]() { return !primary.crashed; }, 1000);
+    std::this_thread::sleep_for(std::chrono::microseconds(timeoutUs * 3));
+    if (primary.role == ROLE_PRIMARY) rebootedAsPrimary++;
+  }
+  running = false;
+  for (auto& t : threads) t.join();
+  monitor.join();
+
+  if (failoverMs.empty()) return 1;
+  std::sort(failoverMs.begin(), failoverMs.end());
+  double sum = 0;
+  for (double ms : failoverMs) sum += ms;
+  double bound = (timeoutUs + loopUs) / 1000.0;
+  printf("\nfailover over %zu trials: min %.1f ms, mean %.1f ms, p95 %.1f ms, max %.1f ms (timeout + one loop: %.1f ms)\n",
+         failoverMs.size(), failoverMs.front(), sum / failoverMs.size(),
+         failoverMs[std::min(failoverMs.size() - 1, failoverMs.size() * 95 / 100)],
+         failoverMs.back(), bound);
+  printf("lost updates %ld, failed takeovers %ld, rebooted controller came back as primary %ld time(s)\n",
+         lostVehicles, failedTrials, rebootedAsPrimary);
+  printf("messages missed %u / %u, stale %u / %u, demotions %u / %u, both primary in %ld of %ld samples\n",
+         controllers[0].missed.load(), controllers[1].missed.load(), controllers[0].stale.load(),
+         controllers[1].stale.load(), controllers[0].demotions.load(), controllers[1].demotions.load(),
+         dualPrimarySamples.load(), samples.load());
+  return failedTrials == 0 && rebootedAsPrimary == 0 ? 0 : 1;
+}
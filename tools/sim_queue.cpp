@@ -0,0 +1,169 @@
+/*
+  Entry lane queue simulator (Linux host)
+
+  Runs lane_queue.h against a simulated entry barrier where the true queue is known.
+  Cars arrive at random (Poisson) at a rate that follows a day with two shift
+  changes; the car at the barrier waits for its ticket and the arm, then drives
+  through; a queued car moves up when the one in front has gone. The estimator only
+  sees what the beams see: a car reaching the barrier and a car counted in.
+
+  Prints, every --report-s seconds of simulated time, the offered and estimated
+  arrival rate, the service rate, the true and estimated queue, and the alarm; then,
+  per shift change, how long the alarm was raised before the queue reached
+  --road-cars (the length at which it backs onto the road), and any alarm raised
+  while the queue never passed 2 cars.
+
+  Build and run from the repository root:
+    g++ -O2 -std=c++17 -I. tools/sim_queue.cpp -o sim_queue && ./sim_queue
+  Options: --peak-per-min N --window-s N --raise R --clear R --run N --road-cars N --report-s N --seed N
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "lane_queue.h"
+
+const int64_t S = 1000000;
+
+// Offered arrivals per minute at a given second of the day
+double offeredPerMin(double t, double peak) {
+  double hour = t / 3600;
+  double rate = hour >= 6 && hour < 22 ? 1.5 : 0.3;
+  for (double shift : { 7.0, 15.0 }) {
+    if (hour >= shift - 0.25 && hour < shift + 0.25) rate = peak;  // Half an hour around each shift change
+  }
+  return rate;
+}
+
+int main(int argc, char** argv) {
+  double peakPerMin = 10, windowS = 120, raise = 0.9, clear = 0.7, reportS = 600;
+  int roadCars = 8, run = 5;  // As QUEUE_OVERLOAD_RUN in the sketch
+  unsigned seed = 1;
+  for (int a = 1; a + 1 < argc; a += 2) {
+    std::string arg = argv[a];
+    double v = atof(argv[a + 1]);
+    if (arg == "--peak-per-min") peakPerMin = v;
+    else if (arg == "--window-s") windowS = v;
+    else if (arg == "--raise") raise = v;
+    else if (arg == "--clear") clear = v;
+    else if (arg == "--road-cars") roadCars = (int)v;
+    else if (arg == "--run") run = (int)v;
+    else if (arg == "--report-s") reportS = v;
+    else if (arg == "--seed") seed = (unsigned)v;
+  }
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> unit(0, 1);
+  auto uniform = [&](double lo, double hi) { return lo + (hi - lo) * unit(rng); };
+
+  LaneQueue q;
+  const int64_t MOVE_UP_US = 3 * S;  // As QUEUE_MOVE_UP_MS in the sketch
+  laneQueueInit(q, (int64_t)(windowS * S), MOVE_UP_US, 0);
+
+  const int64_t END = 86400 * S;
+  int waiting = 0;           // Cars behind the barrier
+  bool atBarrier = false;
+  int64_t nextArrival = 0, headReady = -1, headGone = -1;
+  int64_t nextReport = (int64_t)(reportS * S);
+  double busyUs = 0;
+  int64_t lastT = 0;
+
+  struct Episode { double roadAt = -1, alarmAt = -1; int peak = 0; };
+  std::vector<Episode> episodes;  // One per stretch with a queue of 3 or more
+  bool inEpisode = false;
+  int falseAlarms = 0;
+  int64_t alarmRaisedAt = -1;
+  int alarmPeakQueue = 0;
+  double absErrSum = 0;
+  int samples = 0;
+
+  printf("%8s %10s %10s %10s %6s %6s %8s %s\n", "time", "offer/min", "est/min", "serve/min", "queue", "est", "rho",
+         "alarm");
+  int64_t t = 0;
+  while (t < END) {
+    // Next event: an arrival upstream, the head car reaching the barrier, or leaving it
+    if (nextArrival <= t) {
+      double rate = offeredPerMin(t / (double)S, peakPerMin) / 60;
+      nextArrival = t + (int64_t)(-log(1 - unit(rng)) / rate * S);
+    }
+    int64_t next = nextArrival;
+    if (headReady >= 0 && headReady < next) next = headReady;
+    if (headGone >= 0 && headGone < next) next = headGone;
+    if (nextReport < next) next = nextReport;
+    if (atBarrier) busyUs += next - lastT;
+    lastT = t = next;
+
+    if (t == nextArrival) {
+      if (!atBarrier && headReady < 0) {
+        headReady = t;  // Empty lane: straight to the barrier
+      } else {
+        waiting++;
+      }
+    }
+    if (t == headReady) {
+      headReady = -1;
+      atBarrier = true;
+      laneQueueArrive(q, t);
+      headGone = t + (int64_t)(uniform(3, 7) * S) + (int64_t)(uniform(2.5, 4) * S);  // Ticket and arm, then through
+    }
+    if (t == headGone) {
+      headGone = -1;
+      atBarrier = false;
+      laneQueueDepart(q, t, true);
+      if (waiting > 0) {
+        waiting--;
+        headReady = t + (int64_t)(uniform(1.5, 2.5) * S);  // The next car moves up
+      }
+    }
+
+    int queue = waiting + (atBarrier || headReady >= 0 ? 1 : 0);
+    int change = laneQueueCheck(q, t, raise, clear, run, 5);
+    if (change > 0) {
+      alarmRaisedAt = t;
+      alarmPeakQueue = queue;
+    }
+    if (q.overloaded) alarmPeakQueue = std::max(alarmPeakQueue, queue);
+    if (change < 0 && alarmPeakQueue <= 2) falseAlarms++;
+    if (queue >= 3 && !inEpisode) {
+      inEpisode = true;
+      episodes.push_back(Episode());
+    }
+    if (inEpisode) {
+      Episode& e = episodes.back();
+      e.peak = std::max(e.peak, queue);
+      if (e.roadAt < 0 && queue >= roadCars) e.roadAt = t / (double)S;
+      if (e.alarmAt < 0 && q.overloaded) e.alarmAt = (alarmRaisedAt >= 0 ? alarmRaisedAt : t) / (double)S;
+      if (queue == 0 && !q.overloaded) inEpisode = false;
+    }
+
+    if (t == nextReport) {
+      nextReport += (int64_t)(reportS * S);
+      float est = laneQueueLength(q, t);
+      absErrSum += fabs(est - queue);
+      samples++;
+      int secs = (int)(t / S);
+      printf("%02d:%02d:%02d %10.1f %10.1f %10.1f %6d %6.1f %8.2f %s\n", secs / 3600, secs / 60 % 60, secs % 60,
+             offeredPerMin(t / (double)S, peakPerMin), laneArrivalRate(q, t) * 60, laneServiceRate(q) * 60, queue,
+             est, laneUtilization(q, t), q.overloaded ? "OVERLOAD" : "");
+    }
+  }
+
+  printf("\nbarrier busy %.0f%% of the day, mean |queue error| %.1f cars at the reports\n", 100 * busyUs / END,
+         absErrSum / samples);
+  int missed = 0;
+  for (const Episode& e : episodes) {
+    if (e.peak < roadCars) continue;
+    if (e.alarmAt < 0 || e.alarmAt > e.roadAt) {
+      missed++;
+      printf("queue reached %d cars at %.0f s with no alarm before it\n", roadCars, e.roadAt);
+    } else {
+      printf("queue reached %d cars at %.0f s (peak %d): alarm %.0f s before\n", roadCars, e.roadAt, e.peak,
+             e.roadAt - e.alarmAt);
+    }
+  }
+  printf("%d queue(s) reached the road unannounced, %d alarm(s) with the queue never above 2 cars\n", missed,
+         falseAlarms);
+  return missed == 0 ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+/*
+  Raw sample stream client (Linux host)
+
+  Connects to a board's /stream endpoint and decodes every echo as it arrives (see
+  section 15 of main.c for the format). Once a second it prints, per bay, the number
+  of samples, missed echoes, and the min / mean / max raw distance with a bar plot of
+  the mean, plus the samples the board dropped because this client fell behind.
+  Optionally saves every sample as CSV for plotting elsewhere.
+
+  Build and run from the repository root:
+    g++ -O2 -std=c++17 tools/stream_client.cpp -o stream_client && ./stream_client 192.168.1.100 --csv samples.csv
+  Options: --port PORT --csv FILE --seconds S (stop after S seconds, default: until interrupted)
+*/
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+
+const int MAX_DISTANCE_MM = 4000;  // MAX_PARKING_DISTANCE in the sketch
+const int BAR_WIDTH = 40;
+
+struct Sample {
+  uint64_t timeUs;
+  uint32_t echoUs;
+  uint16_t mm;
+  uint8_t bay;
+  uint8_t flags;
+};
+
+struct BayStats {
+  unsigned long samples = 0, noEcho = 0;
+  int minMm = MAX_DISTANCE_MM, maxMm = 0;
+  double sumMm = 0;
+};
+
+uint32_t getLe(const uint8_t* p, int bytes) {
+  uint32_t value = 0;
+  for (int i = bytes - 1; i >= 0; i--) value = value << 8 | p[i];
+  return value;
+}
+
+// Buffered reader over the socket
+struct Reader {
+  int fd;
+  uint8_t buf[16384];
+  size_t start = 0, end = 0;
+
+  bool fill() {
+    if (start > 0) {
+      memmove(buf, buf + start, end - start);
+      end -= start;
+      start = 0;
+    }
+    ssize_t n = recv(fd, buf + end, sizeof(buf) - end, 0);
+    if (n <= 0) return false;
+    end += n;
+    return true;
+  }
+  bool read(uint8_t* out, size_t len) {
+    while (len > 0) {
+      if (start == end && !fill()) return false;
+      size_t n = std::min(len, end - start);
+      memcpy(out, buf + start, n);
+      start += n;
+      out += n;
+      len -= n;
+    }
+    return true;
+  }
+  bool line(std::string& out) {
+    out.clear();
+    uint8_t c;
+    while (read(&c, 1)) {
+      if (c == '\n') {
+        if (!out.empty() && out.back() == '\r') out.pop_back();
+        return true;
+      }
+      out += (char)c;
+    }
+    return false;
+  }
+};
+
+int connectTo(const char* host, const char* port) {
+  addrinfo hints = {}, *res;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, port, &hints, &res) != 0) return -1;
+  int fd = socket(res->ai_family, res->ai_socktype, 0);
+  if (connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  return fd;
+}
+
+void printReport(std::map<int, BayStats>& bays, double seconds, uint32_t dropped, uint32_t droppedBefore) {
+  printf("--- %.1f s, %u sample(s) dropped by the board\n", seconds, dropped - droppedBefore);
+  for (auto& [bay, s] : bays) {
+    double mean = s.samples > s.noEcho ? s.sumMm / (s.samples - s.noEcho) : 0;
+    int bar = (int)(mean * BAR_WIDTH / MAX_DISTANCE_MM);
+    printf("bay %3d: %4lu samples, %3lu no echo, %4d / %6.1f / %4d mm |%-*s|\n", bay, s.samples, s.noEcho,
+           s.samples > s.noEcho ? s.minMm : 0, mean, s.maxMm, BAR_WIDTH, std::string(bar, '#').c_str());
+    s = BayStats();
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s HOST [--port PORT] [--csv FILE] [--seconds S]\n", argv[0]);
+    return 1;
+  }
+  const char* host = argv[1];
+  std::string port = "80";
+  const char* csvPath = nullptr;
+  double limitSeconds = 0;
+  for (int a = 2; a + 1 < argc; a += 2) {
+    std::string arg = argv[a];
+    if (arg == "--port") port = argv[a + 1];
+    else if (arg == "--csv") csvPath = argv[a + 1];
+    else if (arg == "--seconds") limitSeconds = atof(argv[a + 1]);
+  }
+
+  int fd = connectTo(host, port.c_str());
+  if (fd < 0) {
+    perror("connect");
+    return 1;
+  }
+  std::string request = "GET /stream HTTP/1.1\r\nHost: " + std::string(host) + "\r\n\r\n";
+  send(fd, request.data(), request.size(), 0);
+
+  Reader in;
+  in.fd = fd;
+  std::string status, header;
+  if (!in.line(status) || status.find(" 200 ") == std::string::npos) {
+    fprintf(stderr, "board answered: %s\n", status.c_str());
+    return 1;
+  }
+  while (in.line(header) && !header.empty()) {}
+
+  FILE* csv = csvPath ? fopen(csvPath, "w") : nullptr;
+  if (csvPath && !csv) {
+    perror(csvPath);
+    return 1;
+  }
+  if (csv) fprintf(csv, "time_us,bay,echo_us,mm,beam_a,beam_b,no_echo\n");
+
+  auto start = std::chrono::steady_clock::now();
+  auto lastReport = start;
+  std::map<int, BayStats> bays;
+  unsigned long total = 0;
+  uint32_t dropped = 0, droppedAtReport = 0;
+  std::string chunkLine;
+  // Each HTTP chunk holds one block: count(2) reserved(2) dropped(4), then the samples
+  while (in.line(chunkLine)) {
+    size_t chunkLen = strtoul(chunkLine.c_str(), nullptr, 16);
+    if (chunkLen == 0) break;  // End of the stream
+    uint8_t head[8];
+    if (chunkLen < 8 || !in.read(head, 8)) break;
+    uint32_t count = getLe(head, 2);
+    dropped = getLe(head + 4, 4);
+    if (chunkLen != 8 + count * 16) {
+      fprintf(stderr, "malformed block\n");
+      break;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      uint8_t raw[16];
+      if (!in.read(raw, 16)) break;
+      Sample s = { getLe(raw, 4) | (uint64_t)getLe(raw + 4, 4) << 32, getLe(raw + 8, 4), (uint16_t)getLe(raw + 12, 2),
+                   raw[14], raw[15] };
+      BayStats& b = bays[s.bay];
+      b.samples++;
+      if (s.flags & 4) {
+        b.noEcho++;
+      } else {
+        b.minMm = std::min<int>(b.minMm, s.mm);
+        b.maxMm = std::max<int>(b.maxMm, s.mm);
+        b.sumMm += s.mm;
+      }
+      if (csv) {
+        fprintf(csv, "%llu,%u,%u,%u,%d,%d,%d\n", (unsigned long long)s.timeUs, s.bay, s.echoUs, s.mm, s.flags & 1,
+                (s.flags >> 1) & 1, (s.flags >> 2) & 1);
+      }
+      total++;
+    }
+    std::string crlf;
+    in.line(crlf);
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastReport >= std::chrono::seconds(1)) {
+      printReport(bays, std::chrono::duration<double>(now - start).count(), dropped, droppedAtReport);
+      droppedAtReport = dropped;
+      lastReport = now;
+    }
+    if (limitSeconds > 0 && now - start >= std::chrono::duration<double>(limitSeconds)) break;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%lu samples in %.1f s (%.1f/s), %u dropped by the board\n", total, seconds, total / seconds, dropped);
+  if (csv) fclose(csv);
+  close(fd);
+  return 0;
+}
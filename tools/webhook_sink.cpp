@@ -0,0 +1,145 @@
+/*
+  Webhook sink (Linux host)
+
+  A small HTTP receiver for testing the sketch's webhooks (section 13 of main.c).
+  Prints each batch as it arrives and checks event sequence numbers per board, so
+  drops and duplicates show up. It can also fail or stall on purpose to exercise
+  the board's retries, backoff and drop accounting.
+
+  Build and run from the repository root:
+    g++ -O2 -std=c++17 -pthread tools/webhook_sink.cpp -o webhook_sink && ./webhook_sink --port 8000
+  Then set WEBHOOK_URLS in main.c to "http://<this machine>:8000/events".
+  Options: --port PORT --fail-rate FRACTION (answer 503) --delay-ms MS (before answering)
+*/
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+double failRate = 0;
+int delayMs = 0;
+
+std::mutex statsMutex;
+std::map<std::string, unsigned long> lastSeq;  // Per board
+unsigned long batches = 0, events = 0, gaps = 0, repeats = 0, failed = 0;
+
+// Numeric value following each occurrence of `key` in `text`
+template <typename F>
+void forEachNumber(const std::string& text, const char* key, F f) {
+  size_t keyLen = strlen(key);
+  for (size_t at = text.find(key); at != std::string::npos; at = text.find(key, at + keyLen)) {
+    f(strtoul(text.c_str() + at + keyLen, nullptr, 10));
+  }
+}
+
+// Records one batch; returns a one-line summary
+std::string recordBatch(const std::string& body) {
+  size_t boardAt = body.find("\"board\":\"");
+  std::string board = boardAt == std::string::npos ? "?" : body.substr(boardAt + 9, body.find('"', boardAt + 9) - boardAt - 9);
+  std::lock_guard<std::mutex> lock(statsMutex);
+  unsigned long count = 0, first = 0, last = 0, batchGaps = 0, batchRepeats = 0;
+  bool seen = lastSeq.count(board) > 0;  // No gap check for the first event from a board
+  unsigned long previous = seen ? lastSeq[board] : 0;
+  forEachNumber(body, "\"seq\":", [&](unsigned long seq) {
+    if (count++ == 0) first = seq;
+    last = seq;
+    if (seen && seq <= previous) batchRepeats++;  // Retried after the board missed our 200
+    else if (seen) batchGaps += seq - previous - 1; // Dropped on the board
+    if (!seen || seq > previous) previous = seq;
+    seen = true;
+  });
+  lastSeq[board] = previous;
+  batches++;
+  events += count;
+  gaps += batchGaps;
+  repeats += batchRepeats;
+  char line[200];
+  snprintf(line, sizeof(line), "%s: %lu event(s), seq %lu-%lu, %lu missing, %lu repeated (total %lu events, %lu missing)",
+           board.c_str(), count, first, last, batchGaps, batchRepeats, events, gaps);
+  return line;
+}
+
+void serveConnection(int fd) {
+  std::mt19937 rng(fd);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::string buf;
+  char chunk[4096];
+  while (true) {
+    size_t headerEnd;
+    while ((headerEnd = buf.find("\r\n\r\n")) == std::string::npos) {
+      ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+      if (n <= 0) {
+        close(fd);
+        return;
+      }
+      buf.append(chunk, n);
+    }
+    std::string headers = buf.substr(0, headerEnd);
+    for (char& c : headers) c = tolower(c);
+    size_t lengthAt = headers.find("content-length:");
+    size_t length = lengthAt == std::string::npos ? 0 : strtoul(headers.c_str() + lengthAt + 15, nullptr, 10);
+    while (buf.size() < headerEnd + 4 + length) {
+      ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+      if (n <= 0) {
+        close(fd);
+        return;
+      }
+      buf.append(chunk, n);
+    }
+    std::string body = buf.substr(headerEnd + 4, length);
+    buf.erase(0, headerEnd + 4 + length);
+
+    if (delayMs > 0) std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+    const char* reply;
+    if (uniform(rng) < failRate) {
+      std::lock_guard<std::mutex> lock(statsMutex);
+      failed++;
+      printf("rejected a batch of %zu bytes (%lu rejected so far)\n", body.size(), failed);
+      reply = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+    } else {
+      std::string summary = recordBatch(body);
+      printf("%s\n", summary.c_str());
+      reply = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    }
+    fflush(stdout);
+    send(fd, reply, strlen(reply), MSG_NOSIGNAL);
+  }
+}
+
+int main(int argc, char** argv) {
+  int port = 8000;
+  for (int a = 1; a + 1 < argc; a += 2) {
+    std::string arg = argv[a];
+    if (arg == "--port") port = atoi(argv[a + 1]);
+    else if (arg == "--fail-rate") failRate = atof(argv[a + 1]);
+    else if (arg == "--delay-ms") delayMs = atoi(argv[a + 1]);
+  }
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(listener, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 16) < 0) {
+    perror("listen");
+    return 1;
+  }
+  printf("Webhook sink on port %d (fail rate %.0f%%, delay %d ms)\n", port, failRate * 100, delayMs);
+  fflush(stdout);
+  while (true) {
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd >= 0) std::thread(serveConnection, fd).detach();
+  }
+}